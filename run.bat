@@ -19,22 +19,50 @@ if not exist "%EXE%" (
 REM Tuning parameters
 set WG=256
 set GROUPS_MAX=1024
+set VEC=1
+set DTYPE=float
+set OP=max
 
 REM Sizes to test (space separated)
 set SIZES=1000000 4000000 16777216 33554432 67108864
 
+REM Batched mode: BATCH segments per launch, one run per segment size
+set BATCH=256
+set SEGMENT_SIZES=10000 50000 250000
+
+REM Streaming mode: chunk size in elements, uploads overlap reduction
+set CHUNK=16777216
+
 set OUT=results.csv
 set OUTPATH=%SCRIPT_DIR%%OUT%
-echo size,variant,kernel_ms,passes,wg,items_per_thread> "%OUTPATH%"
+echo size,variant,kernel_ms,passes,wg,items_per_thread,build_ms,cache,host_mem,wall_ms,vec,dtype,op,segments> "%OUTPATH%"
 
 REM Run from the executable directory so kernels.cl is found next to the exe
 for %%I in ("%EXE%") do set EXEDIR=%%~dpI
 pushd "%EXEDIR%" >NUL
 for %%S in (%SIZES%) do (
   echo Running local ^(CL1.2^) size %%S ...
-  .\ocl_find_max.exe --size %%S --wg %WG% --groups-max %GROUPS_MAX% --quiet --csv --variant local >> "%OUTPATH%"
+  .\ocl_find_max.exe --size %%S --wg %WG% --groups-max %GROUPS_MAX% --vec %VEC% --dtype %DTYPE% --op %OP% --quiet --csv --variant local >> "%OUTPATH%"
   echo Running wg ^(CL2.0^) size %%S ...
-  .\ocl_find_max.exe --size %%S --wg %WG% --groups-max %GROUPS_MAX% --quiet --csv --variant wg >> "%OUTPATH%"
+  .\ocl_find_max.exe --size %%S --wg %WG% --groups-max %GROUPS_MAX% --vec %VEC% --dtype %DTYPE% --op %OP% --quiet --csv --variant wg >> "%OUTPATH%"
+  echo Running atomic ^(single pass^) size %%S ...
+  .\ocl_find_max.exe --size %%S --wg %WG% --groups-max %GROUPS_MAX% --vec %VEC% --dtype %DTYPE% --op %OP% --quiet --csv --variant atomic >> "%OUTPATH%"
+  echo Running subgroup ^(SIMD^) size %%S ...
+  .\ocl_find_max.exe --size %%S --wg %WG% --groups-max %GROUPS_MAX% --vec %VEC% --dtype %DTYPE% --op %OP% --quiet --csv --variant subgroup >> "%OUTPATH%"
+  echo Running autotune ^(tuned launch shape, stored in the profile^) size %%S ...
+  .\ocl_find_max.exe --size %%S --dtype %DTYPE% --op %OP% --quiet --csv --autotune >> "%OUTPATH%"
+  echo Running cpu ^(host threads^) size %%S ...
+  .\ocl_find_max.exe --size %%S --dtype %DTYPE% --op %OP% --quiet --csv --device cpu >> "%OUTPATH%"
+  echo Running hybrid ^(GPU + CPU threads^) size %%S ...
+  .\ocl_find_max.exe --size %%S --wg %WG% --groups-max %GROUPS_MAX% --vec %VEC% --dtype %DTYPE% --op %OP% --quiet --csv --hybrid >> "%OUTPATH%"
+  echo Running multi ^(all GPUs^) size %%S ...
+  .\ocl_find_max.exe --size %%S --wg %WG% --groups-max %GROUPS_MAX% --vec %VEC% --dtype %DTYPE% --op %OP% --quiet --csv --devices all >> "%OUTPATH%"
+  echo Running stream ^(chunk %CHUNK%^) size %%S ...
+  .\ocl_find_max.exe --size %%S --wg %WG% --groups-max %GROUPS_MAX% --vec %VEC% --dtype %DTYPE% --op %OP% --quiet --csv --stream --chunk %CHUNK% >> "%OUTPATH%"
+)
+for %%G in (%SEGMENT_SIZES%) do (
+  echo Running batch ^(%BATCH% segments^) segment size %%G ...
+  .\ocl_find_max.exe --batch %BATCH% --segment-size %%G --wg %WG% --dtype %DTYPE% --op %OP% --quiet --csv >> "%OUTPATH%"
 )
 popd >NUL
 
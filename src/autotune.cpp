@@ -0,0 +1,200 @@
+#include "autotune.hpp"
+#include "ocl_utils.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace findmax {
+
+int size_bucket(size_t n) {
+    int b = 0;
+    while (n > 1) {
+        n >>= 1;
+        ++b;
+    }
+    return b;
+}
+
+std::string tuning_file(const FindMaxEngine& engine) {
+    if (engine.cache_dir().empty() || engine.backend() == Backend::Cpu) return std::string();
+    uint64_t h = fnv1a64(engine.device_name());
+    h = fnv1a64(std::string(1, '\0') + get_device_string(engine.device(), CL_DRIVER_VERSION), h);
+    char name[40] = {0};
+    std::snprintf(name, sizeof(name), "tune-%016llx.txt", (unsigned long long)h);
+    return engine.cache_dir() + "/" + name;
+}
+
+namespace {
+
+// One profile line:
+// variant host_mem dtype op bucket wg groups_max items_per_thread vec kernel_ms
+struct Entry {
+    std::string key; // variant host_mem dtype op
+    int bucket = 0;
+    LaunchConfig config;
+    double kernel_ms = 0.0;
+};
+
+std::string entry_key(const FindMaxEngine& engine, DType t, Op op) {
+    // The blocked layout tunes separately; strided keys match older profiles
+    const std::string layout = engine.layout() == Layout::Blocked ? std::string("/") + layout_name(engine.layout()) : "";
+    return std::string(variant_name(engine.variant())) + layout + " " + host_mem_name(engine.host_mem()) + " " + dtype_name(t) +
+           " " + op_name(op);
+}
+
+std::vector<Entry> read_profile(const std::string& path) {
+    std::vector<Entry> out;
+    std::ifstream ifs(path);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream ls(line);
+        std::string variant, host_mem, dtype, op;
+        Entry e;
+        if (!(ls >> variant >> host_mem >> dtype >> op >> e.bucket >> e.config.wg >> e.config.groups_max >>
+              e.config.items_per_thread >> e.config.vec >> e.kernel_ms)) {
+            continue; // written by another version; ignore
+        }
+        e.key = variant + " " + host_mem + " " + dtype + " " + op;
+        out.push_back(e);
+    }
+    return out;
+}
+
+double best_kernel_ms(FindMaxEngine& engine, DType t, Op op, const void* data, size_t n, int reps) {
+    char result[16] = {0};
+    engine.reduce_host(t, op, data, n, result); // warm-up: program build, buffer allocation
+    uint64_t best = std::numeric_limits<uint64_t>::max();
+    for (int r = 0; r < reps; ++r) {
+        engine.reduce_host(t, op, data, n, result);
+        best = std::min(best, engine.last_run().kernel_ns);
+    }
+    return (double)best / 1.0e6;
+}
+
+// Powers of two up to the kernel limit (and 1024) that are multiples of the
+// preferred multiple, for the vector width currently applied
+std::vector<int> wg_candidates(FindMaxEngine& engine, DType t, Op op) {
+    size_t max_wg = 0, multiple = 1;
+    engine.kernel_wg_limits(t, op, &max_wg, &multiple);
+    std::vector<int> out;
+    for (size_t wg = 16; wg <= std::min<size_t>(max_wg, 1024); wg *= 2) {
+        if (multiple == 0 || wg % multiple == 0) out.push_back((int)wg);
+    }
+    if (out.empty()) out.push_back(engine.wg());
+    return out;
+}
+
+} // namespace
+
+bool load_tuning(const FindMaxEngine& engine, DType t, Op op, size_t n, LaunchConfig* config) {
+    const std::string path = tuning_file(engine);
+    if (path.empty()) return false;
+    const std::string key = entry_key(engine, t, op);
+    const int bucket = size_bucket(n);
+    const std::vector<Entry> entries = read_profile(path);
+    const Entry* best = nullptr;
+    for (const Entry& e : entries) {
+        if (e.key != key) continue;
+        if (!best || std::abs(e.bucket - bucket) < std::abs(best->bucket - bucket)) best = &e;
+    }
+    if (!best) return false;
+    *config = best->config;
+    return true;
+}
+
+void save_tuning(const FindMaxEngine& engine, DType t, Op op, size_t n, const LaunchConfig& config, double kernel_ms) {
+    const std::string path = tuning_file(engine);
+    if (path.empty()) return;
+    Entry mine;
+    mine.key = entry_key(engine, t, op);
+    mine.bucket = size_bucket(n);
+    mine.config = config;
+    mine.kernel_ms = kernel_ms;
+    std::vector<Entry> entries = read_profile(path);
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                 [&](const Entry& e) { return e.key == mine.key && e.bucket == mine.bucket; }),
+                  entries.end());
+    entries.push_back(mine);
+
+    std::error_code ec;
+    std::filesystem::create_directories(engine.cache_dir(), ec);
+    std::ostringstream os;
+    os << "# ocl_find_max launch tuning for " << engine.device_name() << "\n";
+    os << "# variant host_mem dtype op log2(n) wg groups_max items_per_thread vec kernel_ms\n";
+    for (const Entry& e : entries) {
+        os << e.key << " " << e.bucket << " " << e.config.wg << " " << e.config.groups_max << " "
+           << e.config.items_per_thread << " " << e.config.vec << " " << e.kernel_ms << "\n";
+    }
+    const std::string text = os.str();
+    write_file_atomically(path, text.data(), text.size());
+}
+
+TuneResult autotune(FindMaxEngine& engine, DType t, Op op, const void* data, size_t n, int reps,
+                    const TuneProgress& progress) {
+    if (engine.backend() == Backend::Cpu) throw std::runtime_error("--autotune needs the GPU backend");
+    if (reps < 1) reps = 1;
+    TuneResult res;
+    res.config = engine.launch_config();
+    res.kernel_ms = std::numeric_limits<double>::infinity();
+
+    auto measure = [&](const LaunchConfig& c) {
+        double ms = std::numeric_limits<double>::infinity();
+        try {
+            engine.set_launch_config(c);
+            ms = best_kernel_ms(engine, t, op, data, n, reps);
+        } catch (const std::exception&) {
+            // CL_OUT_OF_RESOURCES and the like: not a usable shape here
+        }
+        ++res.tried;
+        if (progress) progress(c, ms);
+        if (ms < res.kernel_ms) {
+            res.kernel_ms = ms;
+            res.config = c;
+        }
+    };
+    measure(res.config);
+
+    static const int VECS[] = { 1, 2, 4, 8, 16 };
+    static const int ITEMS[] = { 2, 4, 8, 16, 32 };
+    static const int GROUPS[] = { 128, 256, 512, 1024, 2048, 4096 };
+    for (int round = 0; round < 3; ++round) {
+        const LaunchConfig start = res.config;
+        auto sweep = [&](const std::vector<int>& values, int LaunchConfig::*field) {
+            const LaunchConfig base = res.config;
+            for (int v : values) {
+                if (v == base.*field) continue;
+                LaunchConfig c = base;
+                c.*field = v;
+                measure(c);
+            }
+        };
+        sweep(std::vector<int>(std::begin(VECS), std::end(VECS)), &LaunchConfig::vec);
+        engine.set_launch_config(res.config); // wg limits depend on the kernel built for vec
+        sweep(wg_candidates(engine, t, op), &LaunchConfig::wg);
+        sweep(std::vector<int>(std::begin(ITEMS), std::end(ITEMS)), &LaunchConfig::items_per_thread);
+        sweep(std::vector<int>(std::begin(GROUPS), std::end(GROUPS)), &LaunchConfig::groups_max);
+        const LaunchConfig& c = res.config;
+        if (c.wg == start.wg && c.groups_max == start.groups_max && c.items_per_thread == start.items_per_thread &&
+            c.vec == start.vec) {
+            break;
+        }
+    }
+
+    engine.set_launch_config(res.config);
+    if (res.kernel_ms == std::numeric_limits<double>::infinity()) {
+        throw std::runtime_error("--autotune: no launch configuration ran on this device");
+    }
+    save_tuning(engine, t, op, n, res.config, res.kernel_ms);
+    return res;
+}
+
+} // namespace findmax
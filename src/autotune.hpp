@@ -0,0 +1,51 @@
+// Per-device launch-shape tuning
+// - sweeps wg, groups_max, items_per_thread and vec for one dtype, operator
+//   and input size, timing each candidate by its kernel time
+// - wg candidates respect CL_KERNEL_WORK_GROUP_SIZE and are multiples of
+//   CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE
+// - winners are kept in a per-device profile in the cache directory, keyed
+//   by variant, host_mem, dtype, operator and power-of-two size bucket
+
+#pragma once
+
+#include "find_max.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+namespace findmax {
+
+// floor(log2(n)); 0 for n <= 1
+int size_bucket(size_t n);
+
+// Profile file of the engine's device; empty when the cache is disabled or
+// the engine runs on the CPU backend
+std::string tuning_file(const FindMaxEngine& engine);
+
+// Profile entry for op over n elements of t with the engine's variant and
+// host_mem: the exact size bucket, else the nearest tuned one. Returns false
+// when the profile has no usable entry.
+bool load_tuning(const FindMaxEngine& engine, DType t, Op op, size_t n, LaunchConfig* config);
+// Store (replace) the entry for the size bucket of n
+void save_tuning(const FindMaxEngine& engine, DType t, Op op, size_t n, const LaunchConfig& config, double kernel_ms);
+
+struct TuneResult {
+    LaunchConfig config;
+    double kernel_ms = 0.0; // best kernel time of config over the repetitions
+    int tried = 0;          // candidates timed
+};
+
+// Called after each timed candidate
+using TuneProgress = std::function<void(const LaunchConfig&, double kernel_ms)>;
+
+// Coordinate descent from the engine's current launch shape: each parameter
+// in turn is swept with the others fixed, until a round changes nothing (at
+// most three rounds). Every candidate is timed reps times on data after one
+// warm-up call. Candidates the device rejects are skipped. The winner is
+// applied to the engine and saved with save_tuning(). Throws on the CPU
+// backend.
+TuneResult autotune(FindMaxEngine& engine, DType t, Op op, const void* data, size_t n, int reps = 5,
+                    const TuneProgress& progress = TuneProgress());
+
+} // namespace findmax
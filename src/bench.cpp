@@ -0,0 +1,37 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace findmax {
+
+double percentile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty()) return 0.0;
+    const double pos = q * (double)(sorted.size() - 1);
+    const size_t lo = (size_t)pos;
+    const size_t hi = std::min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (sorted[hi] - sorted[lo]) * (pos - (double)lo);
+}
+
+Distribution summarize(std::vector<double> samples) {
+    Distribution d;
+    d.count = samples.size();
+    if (samples.empty()) return d;
+    std::sort(samples.begin(), samples.end());
+    d.min = samples.front();
+    d.max = samples.back();
+    d.median = percentile(samples, 0.5);
+    d.p95 = percentile(samples, 0.95);
+    d.p99 = percentile(samples, 0.99);
+    double sum = 0.0;
+    for (double v : samples) sum += v;
+    d.mean = sum / (double)samples.size();
+    if (samples.size() > 1) {
+        double sq = 0.0;
+        for (double v : samples) sq += (v - d.mean) * (v - d.mean);
+        d.stddev = std::sqrt(sq / (double)(samples.size() - 1));
+    }
+    return d;
+}
+
+} // namespace findmax
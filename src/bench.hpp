@@ -0,0 +1,32 @@
+// Benchmark statistics over repeated reductions
+// - order statistics (min, median, p95, p99) and mean / standard deviation
+// - effective bandwidth from bytes read and a per-run time
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace findmax {
+
+struct Distribution {
+    size_t count = 0;
+    double min = 0.0;
+    double median = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+    double mean = 0.0;
+    double stddev = 0.0; // sample standard deviation; 0 for fewer than two samples
+};
+
+// Percentiles interpolate linearly between the closest ranks
+Distribution summarize(std::vector<double> samples);
+
+// q in [0, 1] of samples sorted ascending
+double percentile(const std::vector<double>& sorted, double q);
+
+// Bytes per nanosecond, i.e. GB/s; 0 when ns is 0
+inline double gb_per_s(double bytes, double ns) { return ns > 0.0 ? bytes / ns : 0.0; }
+
+} // namespace findmax
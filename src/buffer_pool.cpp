@@ -0,0 +1,117 @@
+#include "buffer_pool.hpp"
+
+#include "ocl_utils.hpp"
+
+#include <algorithm>
+
+namespace findmax {
+
+static constexpr size_t MIN_CLASS_BYTES = 4096;
+
+BufferPool::BufferPool(cl_context ctx, size_t max_alloc) : ctx_(ctx), max_alloc_(max_alloc) {}
+
+BufferPool::~BufferPool() {
+    trim();
+    for (auto& kv : acquired_) clReleaseMemObject(kv.first);
+}
+
+size_t BufferPool::class_bytes(size_t bytes) const {
+    if (bytes <= MIN_CLASS_BYTES) return MIN_CLASS_BYTES;
+    // p < bytes <= 2p; classes step by p / 4 (at most 25% slack)
+    size_t p = MIN_CLASS_BYTES;
+    while (p < bytes - p) p *= 2;
+    const size_t step = p / 4;
+    const size_t c = p + (bytes - p + step - 1) / step * step;
+    return max_alloc_ > 0 && c > max_alloc_ && bytes <= max_alloc_ ? bytes : c;
+}
+
+cl_mem BufferPool::create(size_t bytes, cl_mem_flags flags) {
+    cl_int err = CL_SUCCESS;
+    cl_mem m = clCreateBuffer(ctx_, flags, bytes, nullptr, &err);
+    check(err, "clCreateBuffer");
+    stats_.allocated_bytes += bytes;
+    stats_.high_water_bytes = std::max(stats_.high_water_bytes, stats_.allocated_bytes);
+    return m;
+}
+
+bool BufferPool::idle(Pooled& p) {
+    if (!p.fence) return true;
+    cl_int status = CL_QUEUED;
+    if (clGetEventInfo(p.fence, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr) != CL_SUCCESS ||
+        status != CL_COMPLETE) {
+        return false;
+    }
+    clReleaseEvent(p.fence);
+    p.fence = nullptr;
+    return true;
+}
+
+cl_mem BufferPool::acquire(size_t bytes, cl_mem_flags flags, cl_command_queue q, size_t* capacity) {
+    const ClassKey key(flags, class_bytes(bytes));
+    ++stats_.requests;
+    std::vector<Pooled>& list = free_[key];
+    // Newest first: it is the likeliest to be on q already
+    for (size_t i = list.size(); i-- > 0;) {
+        Pooled& p = list[i];
+        if (p.q != q && !idle(p)) continue;
+        // On q itself the in-order queue runs the new commands after the old ones
+        if (p.fence) clReleaseEvent(p.fence);
+        cl_mem m = p.mem;
+        list.erase(list.begin() + (std::ptrdiff_t)i);
+        stats_.pooled_bytes -= key.second;
+        ++stats_.hits;
+        acquired_.emplace(m, key);
+        *capacity = key.second;
+        return m;
+    }
+    cl_mem m = create(key.second, flags);
+    acquired_.emplace(m, key);
+    *capacity = key.second;
+    return m;
+}
+
+void BufferPool::release(cl_mem buf, cl_command_queue q) {
+    auto it = acquired_.find(buf);
+    if (it == acquired_.end()) return;
+    const ClassKey key = it->second;
+    acquired_.erase(it);
+    Pooled p;
+    p.mem = buf;
+    p.q = q;
+    if (q) {
+        // The marker completes once every command enqueued on q so far has
+        if (clEnqueueMarkerWithWaitList(q, 0, nullptr, &p.fence) == CL_SUCCESS) {
+            clFlush(q);
+        } else {
+            p.fence = nullptr;
+            clFinish(q);
+        }
+    }
+    free_[key].push_back(p);
+    stats_.pooled_bytes += key.second;
+}
+
+void BufferPool::reserve(size_t bytes, cl_mem_flags flags, size_t count) {
+    const ClassKey key(flags, class_bytes(bytes));
+    for (size_t i = 0; i < count; ++i) {
+        Pooled p;
+        p.mem = create(key.second, flags);
+        free_[key].push_back(p);
+        stats_.pooled_bytes += key.second;
+    }
+}
+
+void BufferPool::trim() {
+    // The runtime keeps a released buffer alive for the commands still using it
+    for (auto& kv : free_) {
+        for (Pooled& p : kv.second) {
+            if (p.fence) clReleaseEvent(p.fence);
+            clReleaseMemObject(p.mem);
+            stats_.allocated_bytes -= kv.first.second;
+        }
+    }
+    free_.clear();
+    stats_.pooled_bytes = 0;
+}
+
+} // namespace findmax
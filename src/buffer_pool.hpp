@@ -0,0 +1,72 @@
+// Size-class pool of device buffers shared by the engine's scratch
+// - requests round up to a size class, four per power of two from 4 KiB, so
+//   inputs of slowly varying size keep one buffer instead of reallocating
+// - a released buffer stays allocated for the next request of its class and
+//   flags; until the commands queued on it before the release have run, it is
+//   only handed out again on the same (in-order) queue
+// - counts requests, hits and the high-water mark of allocated bytes
+// Not thread-safe: the engine calls it from the enqueuing thread only.
+
+#pragma once
+
+#include <CL/cl.h>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace findmax {
+
+class BufferPool {
+public:
+    struct Stats {
+        uint64_t requests = 0;        // acquire() calls
+        uint64_t hits = 0;            // served by a pooled buffer, without clCreateBuffer
+        size_t allocated_bytes = 0;   // acquired plus pooled
+        size_t pooled_bytes = 0;      // released and kept for reuse
+        size_t high_water_bytes = 0;  // largest allocated_bytes so far
+        double hit_rate() const { return requests > 0 ? (double)hits / (double)requests : 0.0; }
+    };
+
+    // max_alloc is CL_DEVICE_MAX_MEM_ALLOC_SIZE (0 if unknown): a class
+    // above it falls back to the exact request
+    BufferPool(cl_context ctx, size_t max_alloc);
+    ~BufferPool(); // releases every buffer, acquired ones included
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // A buffer of at least bytes bytes used on queue q; *capacity receives
+    // its class size. Throws when clCreateBuffer fails.
+    cl_mem acquire(size_t bytes, cl_mem_flags flags, cl_command_queue q, size_t* capacity);
+    // Return buf, from acquire(), to the pool; q is the queue its last
+    // commands were enqueued on, or null when nothing is outstanding
+    void release(cl_mem buf, cl_command_queue q);
+    // Allocate count pooled buffers of the class of bytes, e.g. at startup
+    void reserve(size_t bytes, cl_mem_flags flags, size_t count = 1);
+    // Release the pooled buffers; acquired ones are kept
+    void trim();
+
+    size_t class_bytes(size_t bytes) const;
+    const Stats& stats() const { return stats_; }
+
+private:
+    struct Pooled {
+        cl_mem mem = nullptr;
+        cl_command_queue q = nullptr; // queue of the commands fence waits for
+        cl_event fence = nullptr;     // marker enqueued at release(); null when idle
+    };
+    using ClassKey = std::pair<cl_mem_flags, size_t>;
+
+    cl_mem create(size_t bytes, cl_mem_flags flags);
+    static bool idle(Pooled& p); // fence complete (released and cleared then)
+
+    cl_context ctx_;
+    size_t max_alloc_;
+    std::map<ClassKey, std::vector<Pooled>> free_;
+    std::unordered_map<cl_mem, ClassKey> acquired_;
+    Stats stats_;
+};
+
+} // namespace findmax
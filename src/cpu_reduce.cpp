@@ -0,0 +1,544 @@
+#include "cpu_reduce.hpp"
+#include "find_max.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+// x86 with GCC or Clang compiles the AVX2 and AVX-512 folds for their ISA
+// whatever the build flags, and picks one at run time (simd() below)
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define FIND_MAX_X86_DISPATCH 1
+#include <immintrin.h>
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#define TARGET_AVX512
+#define TARGET_AVX2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace findmax {
+
+namespace {
+
+// Independent accumulators per range: 16 floats fill one AVX-512 register,
+// narrower ISAs get several registers and so more instruction-level parallelism
+constexpr size_t LANES = 16;
+// Below this many elements per worker the thread start costs more than it saves
+constexpr size_t MIN_THREAD_ELEMS = (size_t)1 << 16;
+constexpr size_t MIN_THREAD_SEGMENTS = 4;
+
+// How elements compare and accumulate on the host. half compares as float;
+// floating-point sums accumulate in double.
+template <typename T> struct Host {
+    using key_type = T;
+    static T key(T v) { return v; }
+    static T from_key(T v) { return v; }
+};
+template <> struct Host<half_t> {
+    using key_type = float;
+    static float key(half_t v) { return half_to_float(v); }
+    static half_t from_key(float v) { return float_to_half(v); }
+};
+
+// The hot loops compare plainly, which vectorizes but, like max_ps and
+// fmax, leaves the sign of a zero result open
+template <typename K> inline K loop_max(K a, K b) { return b > a ? b : a; } // keeps a when b is NaN
+template <typename K> inline K loop_min(K a, K b) { return b < a ? b : a; }
+
+// b orders above a: floating point puts -0.0 below +0.0, like the kernels
+// and the atomic variant's ordered ints. NaN never orders above anything.
+template <typename K> inline bool above(K a, K b) {
+    if constexpr (std::is_floating_point<K>::value) return b > a || (b == a && std::signbit(a) > std::signbit(b));
+    else return b > a;
+}
+// Equal in that order, so 0.0 and -0.0 differ
+template <typename K> inline bool same_key(K a, K b) { return a == b && !above(a, b) && !above(b, a); }
+
+template <typename K> inline K max_of(K a, K b) { return above(a, b) ? b : a; } // keeps a when b is NaN
+template <typename K> inline K min_of(K a, K b) { return above(b, a) ? b : a; }
+
+// A zero result of the plain loops over p[0, n) (and init) becomes the zero
+// that wins in that order, +0.0 for max and -0.0 for min, if it occurs; the
+// scan stops at the first one and only runs on zero results.
+template <typename T>
+typename Host<T>::key_type signed_zero(const T* p, size_t n, typename Host<T>::key_type init, bool is_max) {
+    using K = typename Host<T>::key_type;
+    const K win = is_max ? K(0) : -K(0);
+    if (std::signbit(init) == std::signbit(win) && init == K(0)) return win;
+    for (size_t i = 0; i < n; ++i) {
+        const K v = Host<T>::key(p[i]);
+        if (v == K(0) && std::signbit(v) == std::signbit(win)) return win;
+    }
+    return -win;
+}
+
+// Split [0, n) into contiguous ranges of at least min_part items, run
+// fn(begin, end) for each on its own thread (the last one on the caller's)
+// and return the results in order
+template <typename F>
+auto parallel_ranges(size_t n, unsigned threads, size_t min_part, F fn) -> std::vector<decltype(fn(size_t(), size_t()))> {
+    using R = decltype(fn(size_t(), size_t()));
+    if (threads == 0) threads = cpu_default_threads();
+    const size_t parts = std::max<size_t>(1, std::min<size_t>(threads, n / min_part));
+    // Element ranges start on 64-item multiples, so each one is cache-line aligned
+    const size_t align = std::min<size_t>(64, min_part);
+    const size_t step = ((n + parts - 1) / parts + align - 1) / align * align;
+    std::vector<R> out(parts);
+    std::vector<std::thread> workers;
+    workers.reserve(parts - 1);
+    for (size_t p = 0; p + 1 < parts; ++p) {
+        const size_t b = std::min(n, p * step), e = std::min(n, (p + 1) * step);
+        workers.emplace_back([&out, &fn, p, b, e]() { out[p] = fn(b, e); });
+    }
+    out[parts - 1] = fn(std::min(n, (parts - 1) * step), n);
+    for (std::thread& w : workers) w.join();
+    return out;
+}
+
+#if defined(FIND_MAX_X86_DISPATCH) || defined(__AVX512F__)
+// GCC 12 reports the _mm512_undefined_ps() inside the max/min intrinsics
+// as maybe-uninitialized once they are inlined here
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+// max_ps(v, acc) returns acc when v is NaN, like loop_max()
+TARGET_AVX512 float fold_f32_avx512(const float* p, size_t n, float init, bool is_max) {
+    __m512 a0 = _mm512_set1_ps(init), a1 = a0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m512 v0 = _mm512_loadu_ps(p + i), v1 = _mm512_loadu_ps(p + i + 16);
+        a0 = is_max ? _mm512_max_ps(v0, a0) : _mm512_min_ps(v0, a0);
+        a1 = is_max ? _mm512_max_ps(v1, a1) : _mm512_min_ps(v1, a1);
+    }
+    float lanes[16];
+    _mm512_storeu_ps(lanes, is_max ? _mm512_max_ps(a1, a0) : _mm512_min_ps(a1, a0));
+    float r = init;
+    for (float v : lanes) r = is_max ? loop_max(r, v) : loop_min(r, v);
+    for (; i < n; ++i) r = is_max ? loop_max(r, p[i]) : loop_min(r, p[i]);
+    return r;
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+#if defined(FIND_MAX_X86_DISPATCH) || defined(__AVX2__)
+TARGET_AVX2 float fold_f32_avx2(const float* p, size_t n, float init, bool is_max) {
+    __m256 a0 = _mm256_set1_ps(init), a1 = a0, a2 = a0, a3 = a0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        const __m256 v0 = _mm256_loadu_ps(p + i), v1 = _mm256_loadu_ps(p + i + 8);
+        const __m256 v2 = _mm256_loadu_ps(p + i + 16), v3 = _mm256_loadu_ps(p + i + 24);
+        a0 = is_max ? _mm256_max_ps(v0, a0) : _mm256_min_ps(v0, a0);
+        a1 = is_max ? _mm256_max_ps(v1, a1) : _mm256_min_ps(v1, a1);
+        a2 = is_max ? _mm256_max_ps(v2, a2) : _mm256_min_ps(v2, a2);
+        a3 = is_max ? _mm256_max_ps(v3, a3) : _mm256_min_ps(v3, a3);
+    }
+    a0 = is_max ? _mm256_max_ps(a1, a0) : _mm256_min_ps(a1, a0);
+    a2 = is_max ? _mm256_max_ps(a3, a2) : _mm256_min_ps(a3, a2);
+    float lanes[8];
+    _mm256_storeu_ps(lanes, is_max ? _mm256_max_ps(a2, a0) : _mm256_min_ps(a2, a0));
+    float r = init;
+    for (float v : lanes) r = is_max ? loop_max(r, v) : loop_min(r, v);
+    for (; i < n; ++i) r = is_max ? loop_max(r, p[i]) : loop_min(r, p[i]);
+    return r;
+}
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+// vmaxnm/vminnm return the number when one operand is NaN and already
+// order -0.0 below +0.0
+float fold_f32_neon(const float* p, size_t n, float init, bool is_max) {
+    float32x4_t a0 = vdupq_n_f32(init), a1 = a0, a2 = a0, a3 = a0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        const float32x4_t v0 = vld1q_f32(p + i), v1 = vld1q_f32(p + i + 4);
+        const float32x4_t v2 = vld1q_f32(p + i + 8), v3 = vld1q_f32(p + i + 12);
+        a0 = is_max ? vmaxnmq_f32(a0, v0) : vminnmq_f32(a0, v0);
+        a1 = is_max ? vmaxnmq_f32(a1, v1) : vminnmq_f32(a1, v1);
+        a2 = is_max ? vmaxnmq_f32(a2, v2) : vminnmq_f32(a2, v2);
+        a3 = is_max ? vmaxnmq_f32(a3, v3) : vminnmq_f32(a3, v3);
+    }
+    a0 = is_max ? vmaxnmq_f32(vmaxnmq_f32(a0, a1), vmaxnmq_f32(a2, a3)) : vminnmq_f32(vminnmq_f32(a0, a1), vminnmq_f32(a2, a3));
+    float r = is_max ? vmaxnmvq_f32(a0) : vminnmvq_f32(a0);
+    for (; i < n; ++i) r = is_max ? max_of(r, p[i]) : min_of(r, p[i]);
+    return r;
+}
+#endif
+
+// Baseline packed code from the lane loops when no float fold applies
+#if defined(__SSE2__) || defined(_M_X64)
+const char* const BASELINE_NAME = "sse2";
+#else
+const char* const BASELINE_NAME = "scalar";
+#endif
+
+using FoldF32 = float (*)(const float* p, size_t n, float init, bool is_max);
+
+// One float fold and its cpu_simd_name(); fold is null for the lane loops
+struct SimdPath {
+    const char* name;
+    FoldF32 fold;
+};
+
+// Float folds this build can run on this machine, widest first; the lane
+// loops come last
+std::vector<SimdPath> simd_paths() {
+    std::vector<SimdPath> out;
+#if defined(FIND_MAX_X86_DISPATCH)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) out.push_back(SimdPath{ "avx512", fold_f32_avx512 });
+    if (__builtin_cpu_supports("avx2")) out.push_back(SimdPath{ "avx2", fold_f32_avx2 });
+#else
+#if defined(__AVX512F__)
+    out.push_back(SimdPath{ "avx512", fold_f32_avx512 });
+#endif
+#if defined(__AVX2__)
+    out.push_back(SimdPath{ "avx2", fold_f32_avx2 });
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    out.push_back(SimdPath{ "neon", fold_f32_neon });
+#endif
+#endif
+    out.push_back(SimdPath{ BASELINE_NAME, nullptr });
+    return out;
+}
+
+SimdPath& simd() {
+    static SimdPath path = simd_paths().front();
+    return path;
+}
+
+// fold() without the signed-zero order
+template <typename T>
+typename Host<T>::key_type fold_plain(const T* p, size_t n, typename Host<T>::key_type init, bool is_max) {
+    using K = typename Host<T>::key_type;
+    if constexpr (std::is_same<T, float>::value) {
+        if (simd().fold) return simd().fold(p, n, init, is_max);
+    }
+    K acc[LANES];
+    std::fill(acc, acc + LANES, init);
+    size_t i = 0;
+    if (is_max) {
+        for (; i + LANES <= n; i += LANES)
+            for (size_t l = 0; l < LANES; ++l) acc[l] = loop_max(acc[l], Host<T>::key(p[i + l]));
+        for (; i < n; ++i) acc[0] = loop_max(acc[0], Host<T>::key(p[i]));
+    } else {
+        for (; i + LANES <= n; i += LANES)
+            for (size_t l = 0; l < LANES; ++l) acc[l] = loop_min(acc[l], Host<T>::key(p[i + l]));
+        for (; i < n; ++i) acc[0] = loop_min(acc[0], Host<T>::key(p[i]));
+    }
+    K r = init;
+    for (K v : acc) r = is_max ? loop_max(r, v) : loop_min(r, v);
+    return r;
+}
+
+// Max or min of p[0, n) as a key, starting from init
+template <typename T>
+typename Host<T>::key_type fold(const T* p, size_t n, typename Host<T>::key_type init, bool is_max) {
+    using K = typename Host<T>::key_type;
+    const K r = fold_plain(p, n, init, is_max);
+    if constexpr (std::is_floating_point<K>::value) {
+        if (r == K(0)) return signed_zero(p, n, init, is_max);
+    }
+    return r;
+}
+
+template <typename T>
+std::pair<typename Host<T>::key_type, typename Host<T>::key_type> fold_minmax(const T* p, size_t n) {
+    using K = typename Host<T>::key_type;
+    const K lo_init = Host<T>::key(DTypeTraits<T>::highest()), hi_init = Host<T>::key(DTypeTraits<T>::lowest());
+    K lo[LANES], hi[LANES];
+    std::fill(lo, lo + LANES, lo_init);
+    std::fill(hi, hi + LANES, hi_init);
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        for (size_t l = 0; l < LANES; ++l) {
+            const K v = Host<T>::key(p[i + l]);
+            lo[l] = loop_min(lo[l], v);
+            hi[l] = loop_max(hi[l], v);
+        }
+    }
+    for (; i < n; ++i) {
+        const K v = Host<T>::key(p[i]);
+        lo[0] = loop_min(lo[0], v);
+        hi[0] = loop_max(hi[0], v);
+    }
+    K rlo = lo_init, rhi = hi_init;
+    for (size_t l = 0; l < LANES; ++l) {
+        rlo = loop_min(rlo, lo[l]);
+        rhi = loop_max(rhi, hi[l]);
+    }
+    if constexpr (std::is_floating_point<K>::value) {
+        if (rlo == K(0)) rlo = signed_zero(p, n, lo_init, false);
+        if (rhi == K(0)) rhi = signed_zero(p, n, hi_init, true);
+    }
+    return std::make_pair(rlo, rhi);
+}
+
+// Wrapping integer sum of one range
+template <typename T>
+T fold_int_sum(const T* p, size_t n) {
+    using U = typename std::make_unsigned<T>::type;
+    U acc[LANES] = {};
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES)
+        for (size_t l = 0; l < LANES; ++l) acc[l] += (U)p[i + l];
+    for (; i < n; ++i) acc[0] += (U)p[i];
+    U r = 0;
+    for (U v : acc) r += v;
+    return (T)r;
+}
+
+// Kahan-compensated double sum of one range: (sum, compensation)
+struct Compensated {
+    double sum = 0.0;
+    double c = 0.0;
+    void add(double v) {
+        const double y = v - c;
+        const double t = sum + y;
+        c = (t - sum) - y;
+        sum = t;
+    }
+};
+
+template <typename T>
+Compensated fold_float_sum(const T* p, size_t n) {
+    double s[LANES] = {}, c[LANES] = {};
+    size_t i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        for (size_t l = 0; l < LANES; ++l) {
+            const double y = (double)Host<T>::key(p[i + l]) - c[l];
+            const double t = s[l] + y;
+            c[l] = (t - s[l]) - y;
+            s[l] = t;
+        }
+    }
+    Compensated r;
+    for (size_t l = 0; l < LANES; ++l) {
+        r.add(s[l]);
+        r.add(-c[l]);
+    }
+    for (; i < n; ++i) r.add((double)Host<T>::key(p[i]));
+    return r;
+}
+
+template <typename T>
+void reduce_typed(Op op, const T* p, size_t n, T* out, unsigned threads) {
+    using K = typename Host<T>::key_type;
+    if (op == Op::Max || op == Op::Min) {
+        const bool is_max = op == Op::Max;
+        const K init = Host<T>::key(is_max ? DTypeTraits<T>::lowest() : DTypeTraits<T>::highest());
+        const auto parts = parallel_ranges(n, threads, MIN_THREAD_ELEMS, [&](size_t b, size_t e) { return fold(p + b, e - b, init, is_max); });
+        K r = init;
+        for (K v : parts) r = is_max ? max_of(r, v) : min_of(r, v);
+        out[0] = Host<T>::from_key(r);
+    } else if (op == Op::MinMax) {
+        const auto parts = parallel_ranges(n, threads, MIN_THREAD_ELEMS, [&](size_t b, size_t e) { return fold_minmax(p + b, e - b); });
+        K lo = parts[0].first, hi = parts[0].second;
+        for (const auto& v : parts) {
+            lo = min_of(lo, v.first);
+            hi = max_of(hi, v.second);
+        }
+        out[0] = Host<T>::from_key(lo);
+        out[1] = Host<T>::from_key(hi);
+    } else if constexpr (std::is_integral<T>::value) {
+        const auto parts = parallel_ranges(n, threads, MIN_THREAD_ELEMS, [&](size_t b, size_t e) { return fold_int_sum(p + b, e - b); });
+        out[0] = fold_int_sum(parts.data(), parts.size());
+    } else {
+        const auto parts = parallel_ranges(n, threads, MIN_THREAD_ELEMS, [&](size_t b, size_t e) { return fold_float_sum(p + b, e - b); });
+        Compensated r;
+        for (const Compensated& v : parts) {
+            r.add(v.sum);
+            r.add(-v.c);
+        }
+        out[0] = Host<T>::from_key((K)r.sum);
+    }
+}
+
+template <typename T>
+uint64_t argmax_typed(const T* p, size_t n, T* value, unsigned threads) {
+    using K = typename Host<T>::key_type;
+    const K init = Host<T>::key(DTypeTraits<T>::lowest());
+    // Vector max of the range, then the first element equal to it
+    const auto parts = parallel_ranges(n, threads, MIN_THREAD_ELEMS, [&](size_t b, size_t e) {
+        const K m = fold(p + b, e - b, init, true);
+        for (size_t i = b; i < e; ++i) {
+            if (same_key(Host<T>::key(p[i]), m)) return std::make_pair(m, (uint64_t)i);
+        }
+        return std::make_pair(m, ARGMAX_NONE);
+    });
+    uint64_t best = ARGMAX_NONE;
+    K best_v = init;
+    for (const auto& r : parts) {
+        if (r.second == ARGMAX_NONE) continue;
+        if (best == ARGMAX_NONE || above(best_v, r.first)) {
+            best = r.second;
+            best_v = r.first;
+        }
+    }
+    if (best != ARGMAX_NONE) *value = p[best];
+    return best;
+}
+
+template <typename T>
+uint64_t count_nans_typed(const T* p, size_t n, unsigned threads) {
+    if constexpr (std::is_integral<T>::value) {
+        return 0;
+    } else {
+        const auto parts = parallel_ranges(n, threads, MIN_THREAD_ELEMS, [&](size_t b, size_t e) {
+            uint64_t c = 0;
+            for (size_t i = b; i < e; ++i) {
+                const auto v = Host<T>::key(p[i]);
+                c += v != v ? 1 : 0;
+            }
+            return c;
+        });
+        uint64_t r = 0;
+        for (uint64_t c : parts) r += c;
+        return r;
+    }
+}
+
+// Quiet NaN of a floating-point type
+void store_nan(DType t, void* out) {
+    switch (t) {
+        case DType::Half: *static_cast<half_t*>(out) = float_to_half(std::numeric_limits<float>::quiet_NaN()); break;
+        case DType::Double: *static_cast<double*>(out) = std::numeric_limits<double>::quiet_NaN(); break;
+        default: *static_cast<float*>(out) = std::numeric_limits<float>::quiet_NaN(); break;
+    }
+}
+
+template <typename T>
+void segments_typed(Op op, const T* p, const std::vector<uint32_t>& offsets, T* out, unsigned threads) {
+    const bool is_max = op == Op::Max;
+    const T identity = is_max ? DTypeTraits<T>::lowest() : DTypeTraits<T>::highest();
+    const size_t k = offsets.size() - 1;
+    // Parallel across segments; each segment is folded by one worker
+    parallel_ranges(k, threads, MIN_THREAD_SEGMENTS, [&](size_t b, size_t e) {
+        for (size_t s = b; s < e; ++s) {
+            const size_t len = offsets[s + 1] - offsets[s];
+            out[s] = len == 0 ? identity : Host<T>::from_key(fold(p + offsets[s], len, Host<T>::key(identity), is_max));
+        }
+        return 0;
+    });
+}
+
+} // namespace
+
+unsigned cpu_default_threads() {
+    const unsigned hw = std::thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+}
+
+const char* cpu_simd_name() {
+    return simd().name;
+}
+
+std::vector<std::string> cpu_simd_paths() {
+    std::vector<std::string> out;
+    for (const SimdPath& p : simd_paths()) out.emplace_back(p.name);
+    return out;
+}
+
+bool cpu_set_simd(const std::string& name) {
+    for (const SimdPath& p : simd_paths()) {
+        if (name == p.name) {
+            simd() = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+void cpu_reduce(DType t, Op op, const void* data, size_t n, void* result, unsigned threads) {
+    if (n == 0) return;
+    switch (t) {
+        case DType::Float: reduce_typed(op, static_cast<const float*>(data), n, static_cast<float*>(result), threads); break;
+        case DType::Int32: reduce_typed(op, static_cast<const int32_t*>(data), n, static_cast<int32_t*>(result), threads); break;
+        case DType::UInt32: reduce_typed(op, static_cast<const uint32_t*>(data), n, static_cast<uint32_t*>(result), threads); break;
+        case DType::Int64: reduce_typed(op, static_cast<const int64_t*>(data), n, static_cast<int64_t*>(result), threads); break;
+        case DType::Half: reduce_typed(op, static_cast<const half_t*>(data), n, static_cast<half_t*>(result), threads); break;
+        case DType::Double: reduce_typed(op, static_cast<const double*>(data), n, static_cast<double*>(result), threads); break;
+    }
+}
+
+uint64_t cpu_argmax(DType t, const void* data, size_t n, void* value, unsigned threads) {
+    if (n == 0) return ARGMAX_NONE;
+    switch (t) {
+        case DType::Int32: return argmax_typed(static_cast<const int32_t*>(data), n, static_cast<int32_t*>(value), threads);
+        case DType::UInt32: return argmax_typed(static_cast<const uint32_t*>(data), n, static_cast<uint32_t*>(value), threads);
+        case DType::Int64: return argmax_typed(static_cast<const int64_t*>(data), n, static_cast<int64_t*>(value), threads);
+        case DType::Half: return argmax_typed(static_cast<const half_t*>(data), n, static_cast<half_t*>(value), threads);
+        case DType::Double: return argmax_typed(static_cast<const double*>(data), n, static_cast<double*>(value), threads);
+        default: return argmax_typed(static_cast<const float*>(data), n, static_cast<float*>(value), threads);
+    }
+}
+
+uint64_t cpu_count_nans(DType t, const void* data, size_t n, unsigned threads) {
+    switch (t) {
+        case DType::Float: return count_nans_typed(static_cast<const float*>(data), n, threads);
+        case DType::Half: return count_nans_typed(static_cast<const half_t*>(data), n, threads);
+        case DType::Double: return count_nans_typed(static_cast<const double*>(data), n, threads);
+        default: return 0;
+    }
+}
+
+uint64_t cpu_apply_nan_policy(DType t, Op op, NanPolicy policy, const void* data, size_t n, void* result, unsigned threads) {
+    if (policy == NanPolicy::Ignore || op == Op::Sum || !dtype_is_float(t)) return 0;
+    const uint64_t nans = cpu_count_nans(t, data, n, threads);
+    if (policy == NanPolicy::Propagate && nans > 0) {
+        store_nan(t, result);
+        if (op == Op::MinMax) store_nan(t, static_cast<char*>(result) + dtype_size(t));
+    }
+    return nans;
+}
+
+void cpu_merge_partials(DType t, Op op, const void* partials, size_t count, void* result, NanPolicy policy) {
+    if (op != Op::MinMax) {
+        cpu_reduce(t, op, partials, count, result, 1);
+        if (policy == NanPolicy::Propagate) cpu_apply_nan_policy(t, op, policy, partials, count, result, 1);
+        return;
+    }
+    // De-interleave the (min, max) records
+    const size_t esize = dtype_size(t);
+    const char* in = static_cast<const char*>(partials);
+    std::vector<char> mins(count * esize), maxs(count * esize);
+    for (size_t i = 0; i < count; ++i) {
+        std::memcpy(mins.data() + i * esize, in + 2 * i * esize, esize);
+        std::memcpy(maxs.data() + i * esize, in + (2 * i + 1) * esize, esize);
+    }
+    char* out = static_cast<char*>(result);
+    cpu_reduce(t, Op::Min, mins.data(), count, out, 1);
+    cpu_reduce(t, Op::Max, maxs.data(), count, out + esize, 1);
+    if (policy == NanPolicy::Propagate) {
+        cpu_apply_nan_policy(t, Op::Min, policy, mins.data(), count, out, 1);
+        cpu_apply_nan_policy(t, Op::Max, policy, maxs.data(), count, out + esize, 1);
+    }
+}
+
+void cpu_reduce_segments(DType t, Op op, const void* data, const std::vector<uint32_t>& offsets, void* result, unsigned threads) {
+    if (op != Op::Max && op != Op::Min) throw std::runtime_error("Segmented reductions support ops max and min only.");
+    if (offsets.size() < 2) return;
+    switch (t) {
+        case DType::Float: segments_typed(op, static_cast<const float*>(data), offsets, static_cast<float*>(result), threads); break;
+        case DType::Int32: segments_typed(op, static_cast<const int32_t*>(data), offsets, static_cast<int32_t*>(result), threads); break;
+        case DType::UInt32: segments_typed(op, static_cast<const uint32_t*>(data), offsets, static_cast<uint32_t*>(result), threads); break;
+        case DType::Int64: segments_typed(op, static_cast<const int64_t*>(data), offsets, static_cast<int64_t*>(result), threads); break;
+        case DType::Half: segments_typed(op, static_cast<const half_t*>(data), offsets, static_cast<half_t*>(result), threads); break;
+        case DType::Double: segments_typed(op, static_cast<const double*>(data), offsets, static_cast<double*>(result), threads); break;
+    }
+}
+
+} // namespace findmax
@@ -0,0 +1,58 @@
+// Host CPU reductions: the engine's CPU backend and the CLI reference
+// - contiguous ranges split across std::thread workers
+// - per-range folds over independent lanes so the compiler emits packed
+//   max/min/add; explicit AVX-512 / AVX2 / NEON paths for float max/min,
+//   chosen at run time on x86
+// - same semantics as the kernels: NaN is skipped by max/min (see
+//   cpu_apply_nan_policy() for the other policies), argmax ties resolve to
+//   the lowest index, integer sums wrap, float sums are Kahan-compensated
+//   (in double for float and half)
+
+#pragma once
+
+#include "dtype.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace findmax {
+
+enum class Op;
+enum class NanPolicy;
+
+// Workers used when threads == 0: one per hardware thread
+unsigned cpu_default_threads();
+// Vector path of the float max/min folds: avx512 | avx2 | neon | sse2 | scalar.
+// On x86 with GCC or Clang, the widest one the running CPU supports.
+const char* cpu_simd_name();
+// Every path cpu_set_simd() accepts in this build on this CPU, widest first
+std::vector<std::string> cpu_simd_paths();
+// Switch the float folds to one of cpu_simd_paths(), e.g. to compare them;
+// false for any other name. Not safe while a reduction runs.
+bool cpu_set_simd(const std::string& name);
+
+// result points at one element of type t (two for Op::MinMax: min, then
+// max) and is left untouched for n == 0
+void cpu_reduce(DType t, Op op, const void* data, size_t n, void* result, unsigned threads = 0);
+// Index of the first maximum, or ARGMAX_NONE when no element compares;
+// value receives the maximum unless the index is ARGMAX_NONE
+uint64_t cpu_argmax(DType t, const void* data, size_t n, void* value, unsigned threads = 0);
+// NaNs among n elements of t (0 for integer types)
+uint64_t cpu_count_nans(DType t, const void* data, size_t n, unsigned threads = 0);
+// Apply policy to result, the cpu_reduce() of op over data: under Propagate
+// a max, min or minmax over input with a NaN becomes a quiet NaN. Returns the
+// NaNs counted, which is 0 under Ignore and for sums.
+uint64_t cpu_apply_nan_policy(DType t, Op op, NanPolicy policy, const void* data, size_t n, void* result,
+                              unsigned threads = 0);
+// Merge count partial results of op stored back to back (two elements each
+// for Op::MinMax) into result, as if one reduction had covered all inputs.
+// Under NanPolicy::Propagate a NaN partial makes the result NaN.
+void cpu_merge_partials(DType t, Op op, const void* partials, size_t count, void* result, NanPolicy policy);
+// op is Max or Min; result points at offsets.size() - 1 elements and empty
+// segments receive the identity of the operator
+void cpu_reduce_segments(DType t, Op op, const void* data, const std::vector<uint32_t>& offsets, void* result,
+                         unsigned threads = 0);
+
+} // namespace findmax
@@ -0,0 +1,55 @@
+#include "datagen.hpp"
+#include "cpu_reduce.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace findmax {
+
+namespace {
+
+// Below this a worker costs more to start than it saves
+constexpr size_t MIN_THREAD_ITEMS = 1 << 16;
+
+} // namespace
+
+const char* data_pattern_name(DataPattern p) {
+    switch (p) {
+        case DataPattern::Sorted: return "sorted";
+        case DataPattern::Reverse: return "reverse";
+        case DataPattern::Equal: return "equal";
+        case DataPattern::MaxAtEnd: return "max-at-end";
+        default: return "uniform";
+    }
+}
+
+DataPattern parse_data_pattern(const std::string& name) {
+    std::string m = name;
+    for (char& c : m) c = (char)std::tolower((unsigned char)c);
+    if (m == "uniform") return DataPattern::Uniform;
+    if (m == "sorted") return DataPattern::Sorted;
+    if (m == "reverse" || m == "reverse-sorted") return DataPattern::Reverse;
+    if (m == "equal" || m == "all-equal") return DataPattern::Equal;
+    if (m == "max-at-end") return DataPattern::MaxAtEnd;
+    throw std::runtime_error("Unknown --data value: " + name);
+}
+
+void parallel_for_ranges(size_t n, unsigned threads, const std::function<void(size_t, size_t)>& fn) {
+    if (threads == 0) threads = cpu_default_threads();
+    const size_t parts = std::max<size_t>(1, std::min<size_t>(threads, n / MIN_THREAD_ITEMS));
+    // Ranges start on 64-item multiples, so workers do not share cache lines
+    const size_t step = ((n + parts - 1) / parts + 63) / 64 * 64;
+    std::vector<std::thread> workers;
+    workers.reserve(parts - 1);
+    for (size_t p = 0; p + 1 < parts; ++p) {
+        const size_t b = std::min(n, p * step), e = std::min(n, (p + 1) * step);
+        workers.emplace_back([&fn, b, e]() { fn(b, e); });
+    }
+    fn(std::min(n, (parts - 1) * step), n);
+    for (std::thread& w : workers) w.join();
+}
+
+} // namespace findmax
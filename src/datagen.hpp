@@ -0,0 +1,59 @@
+// Deterministic synthetic data for benchmarks
+// - counter-based: element i is a SplitMix64 hash of (seed, i), so every
+//   thread count and every host produces the same values for a seed
+// - filled by std::thread workers over contiguous ranges
+// - patterns that take different paths through the reductions: uniform,
+//   sorted, reverse-sorted, all-equal and uniform with the maximum last
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace findmax {
+
+enum class DataPattern { Uniform, Sorted, Reverse, Equal, MaxAtEnd };
+
+const char* data_pattern_name(DataPattern p); // uniform | sorted | reverse | equal | max-at-end
+DataPattern parse_data_pattern(const std::string& name);
+
+inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Uniform in [0, 1) with 53 random bits: draw i of the stream for seed
+inline double counter_uniform(uint64_t seed, uint64_t i) {
+    return (double)(splitmix64(splitmix64(seed) + i) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Value in [0, 1] of element i of n under p. Sorted and Reverse are
+// monotonic (draw i lands in [i / n, (i + 1) / n)), Equal is 0.5 everywhere
+// and MaxAtEnd is uniform with 1.0, the top of the range, as the last element.
+inline double pattern_value(DataPattern p, uint64_t seed, uint64_t i, uint64_t n) {
+    switch (p) {
+        case DataPattern::Sorted: return ((double)i + counter_uniform(seed, i)) / (double)n;
+        case DataPattern::Reverse: return ((double)(n - 1 - i) + counter_uniform(seed, i)) / (double)n;
+        case DataPattern::Equal: return 0.5;
+        case DataPattern::MaxAtEnd: return i + 1 == n ? 1.0 : counter_uniform(seed, i);
+        default: return counter_uniform(seed, i);
+    }
+}
+
+// Run fn(begin, end) over contiguous ranges of [0, n) on threads workers
+// (0: one per hardware thread); small inputs stay on the caller's thread
+void parallel_for_ranges(size_t n, unsigned threads, const std::function<void(size_t, size_t)>& fn);
+
+// store(i, v) for every element, v = pattern_value(p, seed, i, n)
+template <typename F>
+void generate_data(DataPattern p, uint64_t seed, size_t n, unsigned threads, F store) {
+    parallel_for_ranges(n, threads, [&](size_t b, size_t e) {
+        for (size_t i = b; i < e; ++i) store(i, pattern_value(p, seed, i, n));
+    });
+}
+
+} // namespace findmax
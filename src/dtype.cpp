@@ -0,0 +1,117 @@
+#include "dtype.hpp"
+
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+namespace findmax {
+
+float half_to_float(half_t h) {
+    const uint32_t sign = (uint32_t)(h.bits & 0x8000u) << 16;
+    uint32_t exp = (h.bits >> 10) & 0x1Fu;
+    uint32_t mant = h.bits & 0x3FFu;
+    uint32_t bits = 0;
+    if (exp == 0x1Fu) {
+        bits = sign | 0x7F800000u | (mant << 13); // inf / nan
+    } else if (exp != 0) {
+        bits = sign | ((exp + 112u) << 23) | (mant << 13);
+    } else if (mant != 0) {
+        // Subnormal half: normalise into a float
+        exp = 113u;
+        while (!(mant & 0x400u)) { mant <<= 1; --exp; }
+        bits = sign | (exp << 23) | ((mant & 0x3FFu) << 13);
+    } else {
+        bits = sign; // +-0
+    }
+    float f = 0.0f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+half_t float_to_half(float f) {
+    uint32_t x = 0;
+    std::memcpy(&x, &f, sizeof(x));
+    const uint16_t sign = (uint16_t)((x >> 16) & 0x8000u);
+    const uint32_t abs = x & 0x7FFFFFFFu;
+    half_t h;
+    if (abs >= 0x7F800000u) {
+        h.bits = sign | 0x7C00u | (abs > 0x7F800000u ? 0x200u : 0u); // inf / quiet nan
+    } else if (abs >= 0x477FF000u) {
+        h.bits = sign | 0x7C00u; // rounds above the largest half: inf
+    } else if (abs >= 0x38800000u) {
+        // Normal half: rebias exponent, round mantissa to nearest even
+        uint32_t v = abs - 0x38000000u;
+        v += 0xFFFu + ((v >> 13) & 1u);
+        h.bits = sign | (uint16_t)(v >> 13);
+    } else if (abs >= 0x33000000u) {
+        // Subnormal half
+        const uint32_t e = abs >> 23;
+        const uint32_t m = (abs & 0x7FFFFFu) | 0x800000u;
+        const uint32_t shift = 126u - e;
+        uint32_t v = m >> shift;
+        const uint32_t rem = m & ((1u << shift) - 1u);
+        const uint32_t halfway = 1u << (shift - 1u);
+        if (rem > halfway || (rem == halfway && (v & 1u))) ++v;
+        h.bits = sign | (uint16_t)v;
+    } else {
+        h.bits = sign; // underflows to +-0
+    }
+    return h;
+}
+
+const char* dtype_name(DType t) {
+    switch (t) {
+        case DType::Int32: return "int32";
+        case DType::UInt32: return "uint32";
+        case DType::Int64: return "int64";
+        case DType::Half: return "half";
+        case DType::Double: return "double";
+        default: return "float";
+    }
+}
+
+DType parse_dtype(const std::string& name) {
+    std::string s = name;
+    for (char& c : s) c = (char)std::tolower((unsigned char)c);
+    if (s == "float" || s == "f32" || s == "float32") return DType::Float;
+    if (s == "int32" || s == "i32" || s == "int") return DType::Int32;
+    if (s == "uint32" || s == "u32" || s == "uint") return DType::UInt32;
+    if (s == "int64" || s == "i64" || s == "long") return DType::Int64;
+    if (s == "half" || s == "f16" || s == "float16") return DType::Half;
+    if (s == "double" || s == "f64" || s == "float64") return DType::Double;
+    throw std::runtime_error("Unknown --dtype value: " + name);
+}
+
+size_t dtype_size(DType t) {
+    switch (t) {
+        case DType::Int64:
+        case DType::Double: return 8;
+        case DType::Half: return 2;
+        default: return 4;
+    }
+}
+
+bool dtype_is_float(DType t) {
+    return t == DType::Float || t == DType::Half || t == DType::Double;
+}
+
+std::string dtype_build_options(DType t) {
+    switch (t) {
+        case DType::Int32: return "-DT=int -DT_LOWEST=INT_MIN -DT_HIGHEST=INT_MAX -DT_MAX=max -DT_MIN=min -DT_IS_FLOAT=0 -DT_HAS_ATOMIC=1";
+        case DType::UInt32: return "-DT=uint -DT_LOWEST=0 -DT_HIGHEST=UINT_MAX -DT_MAX=max -DT_MIN=min -DT_IS_FLOAT=0 -DT_HAS_ATOMIC=1";
+        case DType::Int64: return "-DT=long -DT_LOWEST=LONG_MIN -DT_HIGHEST=LONG_MAX -DT_MAX=max -DT_MIN=min -DT_IS_FLOAT=0 -DT_HAS_ATOMIC=0";
+        case DType::Half: return "-DT=half -DT_LOWEST=-INFINITY -DT_HIGHEST=INFINITY -DT_MAX=fmax -DT_MIN=fmin -DT_IS_FLOAT=1 -DT_HAS_ATOMIC=0 -DENABLE_FP16=1";
+        case DType::Double: return "-DT=double -DT_LOWEST=-INFINITY -DT_HIGHEST=INFINITY -DT_MAX=fmax -DT_MIN=fmin -DT_IS_FLOAT=1 -DT_HAS_ATOMIC=0 -DENABLE_FP64=1";
+        default: return "-DT=float -DT_LOWEST=-INFINITY -DT_HIGHEST=INFINITY -DT_MAX=fmax -DT_MIN=fmin -DT_IS_FLOAT=1 -DT_HAS_ATOMIC=1";
+    }
+}
+
+const char* dtype_required_extension(DType t) {
+    switch (t) {
+        case DType::Half: return "cl_khr_fp16";
+        case DType::Double: return "cl_khr_fp64";
+        default: return nullptr;
+    }
+}
+
+} // namespace findmax
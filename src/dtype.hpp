@@ -0,0 +1,75 @@
+// Element types supported by the reduction kernels
+// - runtime tag (DType) plus compile-time traits for the templated host API
+// - IEEE half as a 16-bit storage type with float conversions
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+namespace findmax {
+
+enum class DType { Float, Int32, UInt32, Int64, Half, Double };
+
+// Host storage for cl_half; arithmetic goes through float.
+struct half_t {
+    uint16_t bits = 0;
+};
+
+float half_to_float(half_t h);
+half_t float_to_half(float f); // round to nearest even
+
+const char* dtype_name(DType t);   // float | int32 | uint32 | int64 | half | double
+DType parse_dtype(const std::string& name);
+size_t dtype_size(DType t);
+bool dtype_is_float(DType t);
+// Build defines (-DT=..., identities, operators, extensions) for the kernel
+std::string dtype_build_options(DType t);
+// Device extension required for t, or nullptr
+const char* dtype_required_extension(DType t);
+
+// Specialised for every supported host type; lowest()/highest() are the
+// identities of max/min. value_type is used to keep the templated engine
+// overloads away from non-element pointers such as cl_mem.
+template <typename T> struct DTypeTraits;
+
+template <> struct DTypeTraits<float> {
+    using value_type = float;
+    static constexpr DType dtype = DType::Float;
+    static float lowest() { return -std::numeric_limits<float>::infinity(); }
+    static float highest() { return std::numeric_limits<float>::infinity(); }
+};
+template <> struct DTypeTraits<int32_t> {
+    using value_type = int32_t;
+    static constexpr DType dtype = DType::Int32;
+    static int32_t lowest() { return std::numeric_limits<int32_t>::min(); }
+    static int32_t highest() { return std::numeric_limits<int32_t>::max(); }
+};
+template <> struct DTypeTraits<uint32_t> {
+    using value_type = uint32_t;
+    static constexpr DType dtype = DType::UInt32;
+    static uint32_t lowest() { return 0u; }
+    static uint32_t highest() { return std::numeric_limits<uint32_t>::max(); }
+};
+template <> struct DTypeTraits<int64_t> {
+    using value_type = int64_t;
+    static constexpr DType dtype = DType::Int64;
+    static int64_t lowest() { return std::numeric_limits<int64_t>::min(); }
+    static int64_t highest() { return std::numeric_limits<int64_t>::max(); }
+};
+template <> struct DTypeTraits<half_t> {
+    using value_type = half_t;
+    static constexpr DType dtype = DType::Half;
+    static half_t lowest() { half_t h; h.bits = 0xFC00; return h; } // -inf
+    static half_t highest() { half_t h; h.bits = 0x7C00; return h; } // +inf
+};
+template <> struct DTypeTraits<double> {
+    using value_type = double;
+    static constexpr DType dtype = DType::Double;
+    static double lowest() { return -std::numeric_limits<double>::infinity(); }
+    static double highest() { return std::numeric_limits<double>::infinity(); }
+};
+
+} // namespace findmax
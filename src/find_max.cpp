@@ -0,0 +1,1549 @@
+#include "find_max.hpp"
+#include "cpu_reduce.hpp"
+#include "ocl_utils.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace findmax {
+
+const char* variant_name(Variant v) {
+    switch (v) {
+        case Variant::WorkGroup: return "wg";
+        case Variant::Atomic: return "atomic";
+        case Variant::SubGroup: return "subgroup";
+        default: return "local";
+    }
+}
+
+const char* backend_name(Backend b) {
+    return b == Backend::Cpu ? "cpu" : "gpu";
+}
+
+const char* op_name(Op op) {
+    switch (op) {
+        case Op::Min: return "min";
+        case Op::MinMax: return "minmax";
+        case Op::Sum: return "sum";
+        default: return "max";
+    }
+}
+
+Op parse_op(const std::string& name) {
+    std::string o = name;
+    for (char& c : o) c = (char)std::tolower((unsigned char)c);
+    if (o == "max") return Op::Max;
+    if (o == "min") return Op::Min;
+    if (o == "minmax" || o == "min+max" || o == "extrema") return Op::MinMax;
+    if (o == "sum" || o == "add") return Op::Sum;
+    throw std::runtime_error("Unknown --op value: " + name);
+}
+
+const char* nan_policy_name(NanPolicy p) {
+    switch (p) {
+        case NanPolicy::Propagate: return "propagate";
+        case NanPolicy::Count: return "count";
+        default: return "ignore";
+    }
+}
+
+NanPolicy parse_nan_policy(const std::string& name) {
+    std::string o = name;
+    for (char& c : o) c = (char)std::tolower((unsigned char)c);
+    if (o == "ignore" || o == "skip") return NanPolicy::Ignore;
+    if (o == "propagate") return NanPolicy::Propagate;
+    if (o == "count") return NanPolicy::Count;
+    throw std::runtime_error("Unknown --nan-policy value: " + name);
+}
+
+static const char* op_build_options(Op op) {
+    switch (op) {
+        case Op::Min: return " -DOP_MIN=1";
+        case Op::Sum: return " -DOP_SUM=1";
+        default: return "";
+    }
+}
+
+int32_t float_to_ordered_int(float f) {
+    int32_t i = 0;
+    std::memcpy(&i, &f, sizeof(i));
+    return i >= 0 ? i : (i ^ 0x7FFFFFFF);
+}
+
+float ordered_int_to_float(int32_t i) {
+    if (i < 0) i ^= 0x7FFFFFFF;
+    float f = 0.0f;
+    std::memcpy(&f, &i, sizeof(f));
+    return f;
+}
+
+const char* host_mem_name(HostMem m) {
+    switch (m) {
+        case HostMem::ZeroCopy: return "zero-copy";
+        case HostMem::Svm: return "svm";
+        case HostMem::Pinned: return "pinned";
+        default: return "copy";
+    }
+}
+
+HostMem parse_host_mem(const std::string& name) {
+    std::string m = name;
+    for (char& c : m) c = (char)std::tolower((unsigned char)c);
+    if (m == "copy") return HostMem::Copy;
+    if (m == "zero-copy" || m == "zerocopy" || m == "usehostptr") return HostMem::ZeroCopy;
+    if (m == "svm") return HostMem::Svm;
+    if (m == "pinned" || m == "staged") return HostMem::Pinned;
+    throw std::runtime_error("Unknown --host-mem value: " + name);
+}
+
+const char* layout_name(Layout l) {
+    return l == Layout::Blocked ? "blocked" : "strided";
+}
+
+Layout parse_layout(const std::string& name) {
+    std::string m = name;
+    for (char& c : m) c = (char)std::tolower((unsigned char)c);
+    if (m == "strided") return Layout::Strided;
+    if (m == "blocked") return Layout::Blocked;
+    throw std::runtime_error("Unknown --layout value: " + name);
+}
+
+static size_t round_up(size_t v, size_t m) {
+    return (v + m - 1) / m * m;
+}
+
+// Sub-group support as detected from the device extensions
+struct SubGroupSupport {
+    bool khr = false;   // cl_khr_subgroups (OpenCL C 2.0)
+    bool intel = false; // cl_intel_subgroups (works with OpenCL C 1.2)
+    bool any() const { return khr || intel; }
+};
+
+static SubGroupSupport detect_subgroups(cl_device_id dev, bool cl20) {
+    SubGroupSupport s;
+    s.khr = cl20 && has_extension(dev, "cl_khr_subgroups");
+    s.intel = has_extension(dev, "cl_intel_subgroups");
+    return s;
+}
+
+static Variant parse_variant(const std::string& name, bool can_use_wg_reduce, const SubGroupSupport& sg) {
+    std::string var = name;
+    for (char& c : var) c = (char)std::tolower((unsigned char)c);
+    if (var == "auto") {
+        return can_use_wg_reduce ? Variant::WorkGroup : Variant::Local;
+    } else if (var == "wg" || var == "ocl20" || var == "cl2" || var == "cl20") {
+        if (!can_use_wg_reduce) {
+            throw std::runtime_error("Requested variant 'wg' requires OpenCL C 2.0 support.");
+        }
+        return Variant::WorkGroup;
+    } else if (var == "local" || var == "ocl12" || var == "cl1.2" || var == "cl12") {
+        return Variant::Local;
+    } else if (var == "atomic" || var == "single" || var == "1pass") {
+        return Variant::Atomic;
+    } else if (var == "subgroup" || var == "sg" || var == "simd") {
+        if (!sg.any()) {
+            throw std::runtime_error("Requested variant 'subgroup' requires cl_khr_subgroups or cl_intel_subgroups.");
+        }
+        return Variant::SubGroup;
+    }
+    throw std::runtime_error("Unknown --variant value: " + name);
+}
+
+static const char* variant_build_options(Variant v, const SubGroupSupport& sg) {
+    switch (v) {
+        case Variant::WorkGroup: return "-cl-std=CL2.0 -DUSE_WG_REDUCE=1";
+        case Variant::Atomic: return "-cl-std=CL1.2 -DUSE_ATOMIC_MAX=1";
+        case Variant::SubGroup:
+            // Prefer the Intel extension: it does not require OpenCL C 2.0
+            return sg.intel ? "-cl-std=CL1.2 -DUSE_SUBGROUP_REDUCE=1"
+                            : "-cl-std=CL2.0 -DUSE_SUBGROUP_REDUCE=1 -DUSE_KHR_SUBGROUPS=1";
+        default: return "-cl-std=CL1.2";
+    }
+}
+
+static void check_launch_config(const LaunchConfig& c) {
+    // The local-memory tree halves the active work-items every step
+    if (c.wg <= 0 || (c.wg & (c.wg - 1)) != 0) throw std::runtime_error("--wg must be a power of two");
+    if (c.groups_max <= 0) throw std::runtime_error("--groups-max must be positive");
+    if (c.items_per_thread <= 0) throw std::runtime_error("--items must be positive");
+    if (c.vec != 1 && c.vec != 2 && c.vec != 4 && c.vec != 8 && c.vec != 16) {
+        throw std::runtime_error("--vec must be 1, 2, 4, 8 or 16");
+    }
+}
+
+FindMaxEngine::FindMaxEngine(const EngineOptions& opt) : opt_(opt) {
+    if (opt_.wg <= 0) opt_.wg = 256;
+    if (opt_.groups_max <= 0) opt_.groups_max = 1024;
+    if (opt_.stream_buffers < 2 || opt_.stream_buffers > (int)MAX_STREAM_BUFFERS) {
+        throw std::runtime_error("--stream-buffers must be 2 or 3");
+    }
+    check_launch_config(launch_config());
+    if (!(opt_.gpu_fraction >= 0.0 && opt_.gpu_fraction <= 1.0)) {
+        throw std::runtime_error("--gpu-fraction must be between 0 and 1");
+    }
+    if (opt_.cpu_threads == 0) opt_.cpu_threads = cpu_default_threads();
+    nan_policy_ = parse_nan_policy(opt_.nan_policy);
+    layout_ = parse_layout(opt_.layout);
+    if (opt_.prefetch && layout_ != Layout::Blocked) throw std::runtime_error("--prefetch needs --layout blocked");
+    if (opt_.queues < 1 || opt_.queues > MAX_QUEUES) {
+        throw std::runtime_error("--queues must be between 1 and " + std::to_string(MAX_QUEUES));
+    }
+    lanes_.resize((size_t)opt_.queues);
+    lane_ = &lanes_[0];
+
+    std::string dev = opt_.device;
+    for (char& c : dev) c = (char)std::tolower((unsigned char)c);
+    if (dev != "auto" && dev != "gpu" && dev != "cpu") throw std::runtime_error("Unknown --device value: " + opt_.device);
+    if (opt_.gpu_index >= 0 && dev != "cpu") {
+        const std::vector<GpuDevice> gpus = list_gpu_devices();
+        if ((size_t)opt_.gpu_index >= gpus.size()) {
+            throw std::runtime_error("GPU index " + std::to_string(opt_.gpu_index) + " is out of range (" +
+                                     std::to_string(gpus.size()) + " OpenCL GPU devices found)");
+        }
+        platform_ = gpus[(size_t)opt_.gpu_index].platform;
+        device_ = gpus[(size_t)opt_.gpu_index].device;
+    } else if (dev == "cpu" || !select_gpu_device(&platform_, &device_)) {
+        if (dev == "gpu") throw std::runtime_error("No OpenCL GPU device found.");
+        init_cpu();
+        return;
+    }
+    device_name_ = get_device_string(device_, CL_DEVICE_NAME);
+    device_vendor_ = get_device_string(device_, CL_DEVICE_VENDOR);
+    const bool cl20 = is_opencl_c_ge_20(device_);
+    const SubGroupSupport sg = detect_subgroups(device_, cl20);
+    variant_ = parse_variant(opt_.variant, cl20, sg);
+    host_mem_ = parse_host_mem(opt_.host_mem);
+    cl_bool unified = CL_FALSE;
+    if (clGetDeviceInfo(device_, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(unified), &unified, nullptr) == CL_SUCCESS) {
+        unified_memory_ = unified == CL_TRUE;
+    }
+    if (host_mem_ == HostMem::Svm) {
+        cl_device_svm_capabilities caps = 0;
+        if (!cl20 || clGetDeviceInfo(device_, CL_DEVICE_SVM_CAPABILITIES, sizeof(caps), &caps, nullptr) != CL_SUCCESS ||
+            !(caps & (CL_DEVICE_SVM_COARSE_GRAIN_BUFFER | CL_DEVICE_SVM_FINE_GRAIN_BUFFER))) {
+            throw std::runtime_error("--host-mem svm requires an OpenCL 2.0 device with SVM support.");
+        }
+        svm_fine_grain_ = (caps & CL_DEVICE_SVM_FINE_GRAIN_BUFFER) != 0;
+    }
+
+    default_dtype_ = parse_dtype(opt_.dtype);
+    variant_opts_ = variant_build_options(variant_, sg);
+
+    try {
+        cl_int err = CL_SUCCESS;
+        cl_context_properties props[] = { CL_CONTEXT_PLATFORM, (cl_context_properties)platform_, 0 };
+        ctx_ = clCreateContext(props, 1, &device_, nullptr, nullptr, &err);
+        check(err, "clCreateContext");
+        for (Lane& l : lanes_) l.q = create_queue(ctx_, device_, CL_QUEUE_PROFILING_ENABLE, "clCreateCommandQueue");
+        pool_.reset(new BufferPool(ctx_, max_alloc_bytes()));
+
+        // Load kernel source (try cwd, exe dir, then src/)
+        const std::string kernel_path = opt_.kernel_path.empty() ? resolve_kernel_path() : opt_.kernel_path;
+        kernel_src_ = load_text_file(kernel_path);
+        // An atomic engine over int64, half or double can still run minmax and argmax
+        program(default_dtype_, Op::Max, !supports(default_dtype_));
+        if (opt_.reserve_elems > 0) reserve(default_dtype_, opt_.reserve_elems);
+    } catch (...) {
+        release();
+        throw;
+    }
+}
+
+FindMaxEngine::~FindMaxEngine() {
+    release();
+}
+
+void FindMaxEngine::init_cpu() {
+    backend_ = Backend::Cpu;
+    device_name_ = "host CPU (" + std::to_string(opt_.cpu_threads) + " threads, " + cpu_simd_name() + ")";
+    device_vendor_ = "host";
+    parse_host_mem(opt_.host_mem); // still reject unknown names
+    host_mem_ = HostMem::Copy;     // the data is already where the backend reads it
+    default_dtype_ = parse_dtype(opt_.dtype);
+}
+
+RunStats FindMaxEngine::run_on_cpu(const std::function<void()>& fn) const {
+    const auto t0 = std::chrono::steady_clock::now();
+    fn();
+    RunStats s;
+    s.kernel_ns = s.wall_ns = s.cpu_ns = elapsed_ns(t0);
+    s.passes = 1;
+    s.gpu_fraction = 0.0;
+    s.started = t0;
+    if (opt_.trace) {
+        PhaseTiming ph;
+        ph.name = "cpu reduce";
+        ph.ns = s.wall_ns;
+        s.phases.push_back(ph);
+    }
+    return s;
+}
+
+RunStats FindMaxEngine::reduce_on_cpu(DType t, Op op, const void* data, size_t n, void* result) const {
+    if (!supports(t, op)) throw std::runtime_error("Op 'sum' does not support dtype half; convert to float first.");
+    uint64_t nans = 0;
+    RunStats s = run_on_cpu([&]() {
+        cpu_reduce(t, op, data, n, result, opt_.cpu_threads);
+        nans = cpu_apply_nan_policy(t, op, nan_policy_, data, n, result, opt_.cpu_threads);
+    });
+    if (nan_policy_ == NanPolicy::Count) s.nan_count = nans;
+    return s;
+}
+
+void FindMaxEngine::require_gpu(const char* what) const {
+    if (backend_ == Backend::Cpu) throw std::runtime_error(std::string(what) + " needs the GPU backend (cl_mem input)");
+}
+
+void FindMaxEngine::release() {
+    // Let outstanding asynchronous reductions complete first
+    for (Lane& l : lanes_) {
+        if (l.q) clFinish(l.q);
+    }
+    for (auto& a : svm_allocs_) clSVMFree(ctx_, const_cast<void*>(a.first));
+    svm_allocs_.clear();
+    pool_.reset(); // every scratch buffer came from it
+    for (Lane& l : lanes_) {
+        if (l.q) clReleaseCommandQueue(l.q);
+        l = Lane();
+    }
+    if (stream_done_) clReleaseEvent(stream_done_);
+    stream_done_ = nullptr;
+    for (size_t b = 0; b < MAX_STREAM_BUFFERS; ++b) {
+        stream_bufs_[b] = staging_bufs_[b] = nullptr;
+        stream_bytes_[b] = staging_bytes_[b] = 0;
+    }
+    release_programs();
+    if (copy_q_) clReleaseCommandQueue(copy_q_);
+    if (ctx_) clReleaseContext(ctx_);
+    chunk_vals_ = nullptr;
+    chunk_vals_bytes_ = 0;
+    copy_q_ = nullptr;
+    ctx_ = nullptr;
+}
+
+void FindMaxEngine::release_programs() {
+    for (std::map<ProgramKey, Program>* cache : { &programs_, &plain_programs_ }) {
+        for (auto& kv : *cache) {
+            Program& p = kv.second;
+            if (p.reduce) clReleaseKernel(p.reduce);
+            if (p.argmax) clReleaseKernel(p.argmax);
+            if (p.minmax) clReleaseKernel(p.minmax);
+            if (p.segments) clReleaseKernel(p.segments);
+            for (auto& k : p.named) clReleaseKernel(k.second);
+            if (p.build.prog) clReleaseProgram(p.build.prog);
+        }
+        cache->clear();
+    }
+}
+
+LaunchConfig FindMaxEngine::launch_config() const {
+    LaunchConfig c;
+    c.wg = opt_.wg;
+    c.groups_max = opt_.groups_max;
+    c.items_per_thread = opt_.items_per_thread;
+    c.vec = opt_.vec;
+    return c;
+}
+
+void FindMaxEngine::set_launch_config(const LaunchConfig& c) {
+    check_launch_config(c);
+    // VEC (and the launch shape of specialized programs) is compiled in
+    const bool changed = c.vec != opt_.vec || (opt_.specialize && (c.wg != opt_.wg || c.items_per_thread != opt_.items_per_thread));
+    if (changed) {
+        // Outstanding reductions still hold the kernels
+        for (Lane& l : lanes_) {
+            if (l.q) clFinish(l.q);
+        }
+        release_programs();
+    }
+    opt_.wg = c.wg;
+    opt_.groups_max = c.groups_max;
+    opt_.items_per_thread = c.items_per_thread;
+    const bool rebuild = changed && backend_ == Backend::Gpu;
+    opt_.vec = c.vec;
+    if (rebuild) program(default_dtype_, Op::Max, !supports(default_dtype_)); // build_info() refers to it
+}
+
+cl_kernel FindMaxEngine::kernel(DType t, Op op, const char* name) {
+    if (backend_ == Backend::Cpu) throw std::runtime_error(std::string("Kernel ") + name + " needs the GPU backend");
+    Program& prog = program(t, op, true);
+    auto it = prog.named.find(name);
+    if (it != prog.named.end()) return it->second;
+    cl_int err = CL_SUCCESS;
+    cl_kernel k = clCreateKernel(prog.build.prog, name, &err);
+    check(err, "clCreateKernel");
+    prog.named.emplace(name, k);
+    return k;
+}
+
+void FindMaxEngine::kernel_wg_limits(DType t, Op op, size_t* max_wg, size_t* multiple) {
+    *max_wg = (size_t)opt_.wg;
+    *multiple = 1;
+    if (backend_ == Backend::Cpu) return;
+    Program& prog = program(t, op);
+    cl_kernel k = op == Op::MinMax ? prog.minmax : prog.reduce;
+    check(clGetKernelWorkGroupInfo(k, device_, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), max_wg, nullptr),
+          "clGetKernelWorkGroupInfo");
+    check(clGetKernelWorkGroupInfo(k, device_, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(size_t), multiple,
+                                   nullptr),
+          "clGetKernelWorkGroupInfo");
+    // A specialized kernel reports its compiled size; other sizes get their own program
+    if (opt_.specialize) {
+        check(clGetDeviceInfo(device_, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(size_t), max_wg, nullptr), "clGetDeviceInfo");
+    }
+}
+
+bool FindMaxEngine::supports_dtype(DType t, Op op) const {
+    // A half accumulator overflows long before any useful input size
+    if (op == Op::Sum && t == DType::Half) return false;
+    if (backend_ == Backend::Cpu) return true;
+    const char* ext = dtype_required_extension(t);
+    return !ext || has_extension(device_, ext);
+}
+
+bool FindMaxEngine::supports(DType t, Op op) const {
+    if (!supports_dtype(t, op)) return false;
+    if (backend_ == Backend::Cpu) return true;
+    // minmax runs the pair kernels, which need no atomics
+    if (variant_ == Variant::Atomic && op != Op::MinMax) {
+        // There is no 32-bit float atomic add, and a sum would need one
+        if (op == Op::Sum) return false;
+        // Global atomic_max/min only exist for 32-bit ints (float goes through the ordered-int mapping)
+        if (t != DType::Float && t != DType::Int32 && t != DType::UInt32) return false;
+    }
+    return true;
+}
+
+FindMaxEngine::Program& FindMaxEngine::program(DType t, Op op, bool plain) {
+    if (op == Op::MinMax) {
+        op = Op::Max; // reduce_minmax_stage is in every program
+        plain = true;
+    }
+    // The other variants build their pair and helper kernels portably already
+    plain = plain && variant_ == Variant::Atomic;
+    std::map<ProgramKey, Program>& cache = plain ? plain_programs_ : programs_;
+    const ProgramKey key(t, op);
+    auto it = cache.find(key);
+    if (it != cache.end()) return it->second;
+
+    if (!(plain ? supports_dtype(t, op) : supports(t, op))) {
+        const char* ext = dtype_required_extension(t);
+        if (ext && !has_extension(device_, ext)) {
+            throw std::runtime_error(std::string("dtype ") + dtype_name(t) + " requires " + ext + " support.");
+        }
+        if (op == Op::Sum && t == DType::Half) {
+            throw std::runtime_error("Op 'sum' does not support dtype half; convert to float first.");
+        }
+        if (op == Op::Sum) {
+            throw std::runtime_error(std::string("Variant '") + variant_name(variant_) + "' does not support op sum (max and min only).");
+        }
+        throw std::runtime_error(std::string("Variant '") + variant_name(variant_) + "' does not support dtype " + dtype_name(t) +
+                                 " (float, int32 and uint32 only).");
+    }
+
+    Program p;
+    p.counts_nans = counts_nans(t, op);
+    std::string build_opts = (plain ? variant_build_options(Variant::Local, SubGroupSupport()) : variant_opts_) + " -DVEC=" + std::to_string(opt_.vec) + " " + dtype_build_options(t) +
+                             op_build_options(op) + " -DNAN_POLICY=" + std::to_string((int)nan_policy_);
+    if (layout_ == Layout::Blocked) build_opts += opt_.prefetch ? " -DLAYOUT_BLOCKED=1 -DPREFETCH=1" : " -DLAYOUT_BLOCKED=1";
+    if (opt_.specialize) {
+        // One cache entry per launch shape: the options are part of the key
+        build_opts += " -DWG_SIZE=" + std::to_string(opt_.wg) + " -DITEMS_PER_THREAD=" + std::to_string(opt_.items_per_thread);
+    }
+    p.build = build_program(ctx_, device_, kernel_src_, build_opts, opt_.cache_dir);
+    cl_int err = CL_SUCCESS;
+    p.reduce = clCreateKernel(p.build.prog, "reduce_stage", &err);
+    if (err == CL_SUCCESS) p.argmax = clCreateKernel(p.build.prog, "reduce_argmax_stage", &err);
+    if (err == CL_SUCCESS) p.minmax = clCreateKernel(p.build.prog, "reduce_minmax_stage", &err);
+    if (err == CL_SUCCESS) {
+        // Not compiled for sums and 64-bit or half types
+        cl_int seg_err = CL_SUCCESS;
+        p.segments = clCreateKernel(p.build.prog, "reduce_segments", &seg_err);
+        if (seg_err != CL_SUCCESS) p.segments = nullptr;
+    }
+    if (err != CL_SUCCESS) {
+        if (p.reduce) clReleaseKernel(p.reduce);
+        if (p.argmax) clReleaseKernel(p.argmax);
+        if (p.minmax) clReleaseKernel(p.minmax);
+        clReleaseProgram(p.build.prog);
+        check(err, "clCreateKernel");
+    }
+    return cache.emplace(key, p).first->second;
+}
+
+void FindMaxEngine::ensure_buffer(cl_mem* buf, size_t* capacity, size_t bytes, cl_mem_flags flags) {
+    if (*buf && *capacity >= bytes) return;
+    const auto t0 = std::chrono::steady_clock::now();
+    // Synchronous calls have drained their queues, so only the current lane
+    // can still have commands on the old buffer
+    if (*buf) pool_->release(*buf, lane_->q);
+    *buf = nullptr;
+    *capacity = 0;
+    *buf = pool_->acquire(bytes, flags, lane_->q, capacity);
+    peak_device_bytes_ = std::max(peak_device_bytes_, device_bytes());
+    phase("alloc", t0);
+}
+
+void FindMaxEngine::reserve(DType t, size_t n) {
+    if (backend_ == Backend::Cpu || n < 2) return;
+    const size_t esize = dtype_size(t);
+    const ReductionPlan p = plan(n);
+    for (Lane& l : lanes_) {
+        LaneScope scope(*this, &l);
+        if (host_mem_ == HostMem::Copy) ensure_buffer(&l.input, &l.input_bytes, esize * n, CL_MEM_READ_ONLY);
+        if (p.partials_elems > 0) ensure_buffer(&l.partials, &l.partials_bytes, esize * p.partials_elems, CL_MEM_READ_WRITE);
+        if (p.alt_elems > 0) ensure_buffer(&l.alt, &l.alt_bytes, esize * p.alt_elems, CL_MEM_READ_WRITE);
+    }
+}
+
+void FindMaxEngine::trim_pool() {
+    if (pool_) pool_->trim();
+}
+
+void* FindMaxEngine::alloc_host(size_t bytes) {
+    bytes = round_up(bytes == 0 ? 1 : bytes, 64);
+    if (host_mem_ != HostMem::Svm) return aligned_host_alloc(round_up(bytes, HOST_ALIGNMENT), HOST_ALIGNMENT);
+
+    cl_svm_mem_flags flags = CL_MEM_READ_WRITE | (svm_fine_grain_ ? CL_MEM_SVM_FINE_GRAIN_BUFFER : 0);
+    void* p = clSVMAlloc(ctx_, flags, bytes, (cl_uint)HOST_ALIGNMENT);
+    if (!p) throw std::runtime_error("clSVMAlloc of " + std::to_string(bytes) + " bytes failed");
+    if (!svm_fine_grain_) {
+        // Coarse-grained SVM must be mapped while the host touches it
+        cl_int err = clEnqueueSVMMap(lane_->q, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, p, bytes, 0, nullptr, nullptr);
+        if (err != CL_SUCCESS) {
+            clSVMFree(ctx_, p);
+            check(err, "clEnqueueSVMMap");
+        }
+    }
+    svm_allocs_[p] = bytes;
+    return p;
+}
+
+void FindMaxEngine::free_host(void* p) {
+    if (!p) return;
+    auto it = svm_allocs_.find(p);
+    if (it == svm_allocs_.end()) {
+        aligned_host_free(p);
+        return;
+    }
+    if (!svm_fine_grain_) {
+        clEnqueueSVMUnmap(lane_->q, p, 0, nullptr, nullptr);
+        clFinish(lane_->q);
+    }
+    clSVMFree(ctx_, p);
+    svm_allocs_.erase(it);
+}
+
+void FindMaxEngine::with_host_input(const void* data, size_t bytes, const std::function<void(const Input&)>& fn) {
+    const auto t0 = std::chrono::steady_clock::now();
+    void* host = const_cast<void*>(data);
+
+    auto svm = svm_allocs_.find(data);
+    if (host_mem_ == HostMem::Svm && svm != svm_allocs_.end() && bytes <= svm->second) {
+        if (!svm_fine_grain_) {
+            cl_event evt = nullptr;
+            check(clEnqueueSVMUnmap(lane_->q, host, wait_count(), wait_list(), &evt), "clEnqueueSVMUnmap");
+            push_event(chain_->uploads, evt, "svm unmap");
+        }
+        chain_->stats.upload_ns = elapsed_ns(t0);
+        phase("host input", t0);
+        Input in;
+        in.svm = data;
+        fn(in);
+        // Hand the allocation back to the host once the passes are done
+        if (!svm_fine_grain_) {
+            cl_event evt = nullptr;
+            check(clEnqueueSVMMap(lane_->q, CL_FALSE, CL_MAP_READ | CL_MAP_WRITE, host, svm->second, wait_count(), wait_list(), &evt), "clEnqueueSVMMap");
+            push_event(chain_->others, evt, "svm map");
+        }
+    } else if (host_mem_ == HostMem::ZeroCopy) {
+        // Wrap the caller's pages for this call only, so later host writes are
+        // never stale. Releasing it right away is fine: the runtime keeps it
+        // alive until the enqueued passes are done with it.
+        cl_int err = CL_SUCCESS;
+        cl_mem wrapped = clCreateBuffer(ctx_, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, bytes, host, &err);
+        check(err, "clCreateBuffer(USE_HOST_PTR)");
+        chain_->stats.upload_ns = elapsed_ns(t0);
+        phase("host input", t0);
+        Input in;
+        in.mem = wrapped;
+        try {
+            fn(in);
+        } catch (...) {
+            clReleaseMemObject(wrapped);
+            throw;
+        }
+        clReleaseMemObject(wrapped);
+    } else {
+        ensure_buffer(&lane_->input, &lane_->input_bytes, bytes, CL_MEM_READ_ONLY);
+        cl_event evt = nullptr;
+        check(clEnqueueWriteBuffer(lane_->q, lane_->input, CL_FALSE, 0, bytes, data, wait_count(), wait_list(), &evt), "clEnqueueWriteBuffer(input)");
+        push_event(chain_->uploads, evt, "upload");
+        chain_->stats.upload_ns = elapsed_ns(t0);
+        phase("host input", t0);
+        Input in;
+        in.mem = lane_->input;
+        fn(in);
+    }
+}
+
+void FindMaxEngine::begin_chain() {
+    chain_.reset(new Pending());
+    chain_->t0 = std::chrono::steady_clock::now();
+    chain_->stats.started = chain_->t0;
+}
+
+void FindMaxEngine::push_event(std::vector<cl_event>& list, cl_event e, const char* name) {
+    list.push_back(e);
+    chain_->tail = e;
+    if (!opt_.trace) return;
+    CommandTiming c;
+    c.name = name;
+    c.host_ns = elapsed_ns(chain_->t0);
+    cl_command_queue q = nullptr;
+    clGetEventInfo(e, CL_EVENT_COMMAND_QUEUE, sizeof(q), &q, nullptr);
+    c.copy_queue = q != nullptr && q == copy_q_;
+    chain_->stats.commands.push_back(c);
+    chain_->traced.push_back(e);
+}
+
+void FindMaxEngine::push_phase(Pending& p, const char* name, std::chrono::steady_clock::time_point begin) {
+    PhaseTiming ph;
+    ph.name = name;
+    ph.begin_ns = begin > p.t0 ? (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(begin - p.t0).count() : 0;
+    ph.ns = elapsed_ns(begin);
+    p.stats.phases.push_back(ph);
+}
+
+void FindMaxEngine::phase(const char* name, std::chrono::steady_clock::time_point begin) {
+    if (opt_.trace && chain_) push_phase(*chain_, name, begin);
+}
+
+void FindMaxEngine::enqueue_read(cl_mem buf, size_t bytes, void* dst, const char* what) {
+    cl_event evt = nullptr;
+    check(clEnqueueReadBuffer(lane_->q, buf, CL_FALSE, 0, bytes, dst, wait_count(), wait_list(), &evt), what);
+    push_event(chain_->others, evt, "read result");
+}
+
+void FindMaxEngine::collect(Pending& p) {
+    for (size_t i = 0; i < p.traced.size(); ++i) {
+        CommandTiming& c = p.stats.commands[i];
+        cl_ulong v[4] = { 0, 0, 0, 0 };
+        const cl_profiling_info what[4] = { CL_PROFILING_COMMAND_QUEUED, CL_PROFILING_COMMAND_SUBMIT,
+                                            CL_PROFILING_COMMAND_START, CL_PROFILING_COMMAND_END };
+        for (int k = 0; k < 4; ++k) clGetEventProfilingInfo(p.traced[i], what[k], sizeof(v[k]), &v[k], nullptr);
+        c.queued = v[0];
+        c.submit = v[1];
+        c.start = v[2];
+        c.end = v[3];
+    }
+    p.traced.clear();
+    p.stats.nan_count += (uint64_t)p.nan_words[1] << 32 | p.nan_words[0];
+    p.nan_words[0] = p.nan_words[1] = 0;
+    for (cl_event e : p.kernels) p.stats.kernel_ns += event_ns(e);
+    for (cl_event e : p.uploads) p.stats.upload_ns += event_ns(e);
+    p.stats.passes = (int)p.kernels.size();
+    for (auto* list : { &p.kernels, &p.uploads, &p.others }) {
+        for (cl_event e : *list) clReleaseEvent(e);
+        list->clear();
+    }
+    p.tail = nullptr;
+}
+
+void FindMaxEngine::finish_chain() {
+    std::unique_ptr<Pending> p = std::move(chain_);
+    if (opt_.trace) push_phase(*p, "enqueue", p->t0);
+    const auto w0 = std::chrono::steady_clock::now();
+    const cl_int err = p->tail ? clWaitForEvents(1, &p->tail) : CL_SUCCESS;
+    if (opt_.trace) push_phase(*p, "wait", w0);
+    collect(*p);
+    check(err, "clWaitForEvents");
+    const auto f0 = std::chrono::steady_clock::now();
+    if (p->finalize) p->finalize(*p);
+    if (opt_.trace) push_phase(*p, "finalize", f0);
+    p->stats.wall_ns = elapsed_ns(p->t0);
+    stats_ = std::move(p->stats);
+}
+
+void FindMaxEngine::abandon_chain() {
+    if (!chain_) return;
+    clFinish(lane_->q);
+    if (copy_q_) clFinish(copy_q_);
+    collect(*chain_);
+    chain_.reset();
+}
+
+void CL_CALLBACK FindMaxEngine::on_chain_complete(cl_event, cl_int status, void* user) {
+    std::unique_ptr<Pending> p(static_cast<Pending*>(user));
+    collect(*p);
+    std::exception_ptr err;
+    if (status < 0) {
+        err = std::make_exception_ptr(std::runtime_error("Asynchronous reduction failed with OpenCL error " + std::to_string(status)));
+    } else if (p->finalize) {
+        p->finalize(*p);
+    }
+    p->stats.wall_ns = elapsed_ns(p->t0);
+    p->done(p->stats, err);
+}
+
+void FindMaxEngine::submit_chain(AsyncCallback done) {
+    std::unique_ptr<Pending> p = std::move(chain_);
+    p->done = std::move(done);
+    if (!p->tail) {
+        // Nothing was enqueued (n <= 1)
+        p->stats.wall_ns = elapsed_ns(p->t0);
+        if (p->finalize) p->finalize(*p);
+        p->done(p->stats, nullptr);
+        return;
+    }
+    cl_event tail = p->tail;
+    Pending* raw = p.get();
+    const cl_int err = clSetEventCallback(tail, CL_COMPLETE, &FindMaxEngine::on_chain_complete, raw);
+    if (err != CL_SUCCESS) {
+        chain_ = std::move(p);
+        abandon_chain();
+        check(err, "clSetEventCallback");
+    }
+    p.release(); // owned by the callback now
+    // Make sure the commands are submitted without a later blocking call
+    check(clFlush(lane_->q), "clFlush");
+}
+
+Op FindMaxEngine::single_value(Op op) {
+    if (op == Op::MinMax) throw std::runtime_error("reduce_async() returns one value; use reduce_host_async() for minmax");
+    return op;
+}
+
+// Enqueue the reduction of host data into chain_ (begin_chain() already called)
+void FindMaxEngine::reduce_host_chain(DType t, Op op, const void* data, size_t n, void* result) {
+    if (n == 0) return;
+    const auto p0 = std::chrono::steady_clock::now();
+    program(t, op); // build (and report dtype errors) before touching the input
+    phase("program", p0);
+    if (n == 1) {
+        // Nothing to reduce; also avoids reading unmapped SVM
+        const size_t esize = dtype_size(t);
+        std::memcpy(result, data, esize);
+        if (op == Op::MinMax) std::memcpy(static_cast<char*>(result) + esize, data, esize);
+        if (counts_nans(t, op)) chain_->stats.nan_count += cpu_count_nans(t, data, 1, 1);
+        return;
+    }
+    if (host_mem_ == HostMem::Pinned) {
+        reduce_stream_chain(t, op, static_cast<const char*>(data), n, result);
+        return;
+    }
+    with_host_input(data, dtype_size(t) * n, [&](const Input& in) { reduce(t, op, in, n, result); });
+}
+
+void FindMaxEngine::reduce_host(DType t, Op op, const void* data, size_t n, void* result) {
+    if (backend_ == Backend::Cpu) {
+        stats_ = reduce_on_cpu(t, op, data, n, result);
+        return;
+    }
+    begin_chain();
+    try {
+        reduce_host_chain(t, op, data, n, result);
+        finish_chain();
+    } catch (...) {
+        abandon_chain();
+        throw;
+    }
+}
+
+void FindMaxEngine::reduce_buffer(DType t, Op op, cl_mem buf, size_t n, void* result) {
+    require_gpu("reduce_buffer");
+    begin_chain();
+    try {
+        if (n > 0) {
+            Input in;
+            in.mem = buf;
+            reduce(t, op, in, n, result);
+        }
+        finish_chain();
+    } catch (...) {
+        abandon_chain();
+        throw;
+    }
+}
+
+FindMaxEngine::Lane* FindMaxEngine::async_lane(bool maps_svm) {
+    if (maps_svm && host_mem_ == HostMem::Svm && !svm_fine_grain_) return &lanes_[0];
+    Lane* l = &lanes_[next_lane_];
+    next_lane_ = (next_lane_ + 1) % lanes_.size();
+    return l;
+}
+
+void FindMaxEngine::reduce_host_async(DType t, Op op, const void* data, size_t n, void* result, AsyncCallback done) {
+    if (backend_ == Backend::Cpu) {
+        const RunStats s = reduce_on_cpu(t, op, data, n, result);
+        if (done) done(s, nullptr);
+        return;
+    }
+    LaneScope scope(*this, async_lane(true));
+    begin_chain();
+    try {
+        reduce_host_chain(t, op, data, n, result);
+        submit_chain(std::move(done));
+    } catch (...) {
+        abandon_chain();
+        throw;
+    }
+}
+
+void FindMaxEngine::reduce_buffer_async(DType t, Op op, cl_mem buf, size_t n, void* result, AsyncCallback done) {
+    require_gpu("reduce_buffer_async");
+    LaneScope scope(*this, async_lane(false));
+    begin_chain();
+    try {
+        if (n > 0) {
+            Input in;
+            in.mem = buf;
+            reduce(t, op, in, n, result);
+        }
+        submit_chain(std::move(done));
+    } catch (...) {
+        abandon_chain();
+        throw;
+    }
+}
+
+// The index kernels only implement NanPolicy::Ignore
+static void check_argmax_policy(DType t, NanPolicy p) {
+    if (p != NanPolicy::Ignore && dtype_is_float(t)) {
+        throw std::runtime_error(std::string("argmax does not support --nan-policy ") + nan_policy_name(p));
+    }
+}
+
+uint64_t FindMaxEngine::argmax_host(DType t, const void* data, size_t n, void* value) {
+    check_argmax_policy(t, nan_policy_);
+    uint64_t index = ARGMAX_NONE;
+    if (backend_ == Backend::Cpu) {
+        stats_ = run_on_cpu([&]() { index = cpu_argmax(t, data, n, value, opt_.cpu_threads); });
+        return index;
+    }
+    begin_chain();
+    try {
+        if (n > 0) {
+            program(t, Op::Max, true);
+            with_host_input(data, dtype_size(t) * n, [&](const Input& in) { reduce_argmax(t, in, n, value, &index); });
+        }
+        finish_chain();
+    } catch (...) {
+        abandon_chain();
+        throw;
+    }
+    return index;
+}
+
+uint64_t FindMaxEngine::argmax_buffer(DType t, cl_mem buf, size_t n, void* value) {
+    require_gpu("argmax_buffer");
+    check_argmax_policy(t, nan_policy_);
+    uint64_t index = ARGMAX_NONE;
+    begin_chain();
+    try {
+        if (n > 0) {
+            Input in;
+            in.mem = buf;
+            reduce_argmax(t, in, n, value, &index);
+        }
+        finish_chain();
+    } catch (...) {
+        abandon_chain();
+        throw;
+    }
+    return index;
+}
+
+// Element count covered by a segment offsets array; throws if it is not ascending
+static size_t check_offsets(const std::vector<uint32_t>& offsets, DType t, NanPolicy p) {
+    if (p == NanPolicy::Count && dtype_is_float(t)) {
+        throw std::runtime_error("Segmented reductions do not support --nan-policy count");
+    }
+    for (size_t s = 1; s < offsets.size(); ++s) {
+        if (offsets[s] < offsets[s - 1]) throw std::runtime_error("Segment offsets must be ascending");
+    }
+    return offsets.size() < 2 ? 0 : (size_t)offsets.back();
+}
+
+void FindMaxEngine::reduce_segments_host(DType t, Op op, const void* data, const std::vector<uint32_t>& offsets, void* result) {
+    if (backend_ == Backend::Cpu) {
+        check_offsets(offsets, t, nan_policy_);
+        stats_ = run_on_cpu([&]() {
+            cpu_reduce_segments(t, op, data, offsets, result, opt_.cpu_threads);
+            if (nan_policy_ != NanPolicy::Propagate) return;
+            const size_t esize = dtype_size(t);
+            for (size_t s = 0; s + 1 < offsets.size(); ++s) {
+                cpu_apply_nan_policy(t, op, nan_policy_, static_cast<const char*>(data) + esize * offsets[s],
+                                     offsets[s + 1] - offsets[s], static_cast<char*>(result) + esize * s, 1);
+            }
+        });
+        return;
+    }
+    begin_chain();
+    try {
+        const size_t n = check_offsets(offsets, t, nan_policy_);
+        program(t, op);
+        if (n > 0) {
+            with_host_input(data, dtype_size(t) * n, [&](const Input& in) { reduce_segments(t, op, in, offsets, result); });
+        }
+        finish_chain();
+    } catch (...) {
+        abandon_chain();
+        throw;
+    }
+}
+
+void FindMaxEngine::reduce_segments_buffer(DType t, Op op, cl_mem buf, const std::vector<uint32_t>& offsets, void* result) {
+    require_gpu("reduce_segments_buffer");
+    begin_chain();
+    try {
+        if (check_offsets(offsets, t, nan_policy_) > 0) {
+            Input in;
+            in.mem = buf;
+            reduce_segments(t, op, in, offsets, result);
+        }
+        finish_chain();
+    } catch (...) {
+        abandon_chain();
+        throw;
+    }
+}
+
+size_t FindMaxEngine::groups_for(size_t count, int vec) const {
+    const size_t per_group = (size_t)opt_.wg * (size_t)opt_.items_per_thread * (size_t)vec;
+    size_t groups = (count + per_group - 1) / per_group;
+    if (groups == 0) groups = 1;
+    if ((int)groups > opt_.groups_max) groups = (size_t)opt_.groups_max;
+    return groups;
+}
+
+ReductionPlan FindMaxEngine::plan(size_t n) const {
+    if (variant_ == Variant::Atomic) {
+        // One pass into a single int slot
+        ReductionPlan p;
+        if (n > 0) p.pass_groups.push_back(groups_for(n, opt_.vec));
+        p.partials_elems = 1;
+        return p;
+    }
+    return multipass_plan(n);
+}
+
+ReductionPlan FindMaxEngine::multipass_plan(size_t n) const {
+    ReductionPlan p;
+    for (size_t count = n; count > 1;) {
+        count = groups_for(count, opt_.vec);
+        p.pass_groups.push_back(count);
+    }
+    if (p.pass_groups.size() > 0) p.partials_elems = p.pass_groups[0];
+    if (p.pass_groups.size() > 1) p.alt_elems = p.pass_groups[1];
+    return p;
+}
+
+cl_int FindMaxEngine::set_input_arg(cl_kernel k, cl_uint index, const Input& in) {
+    return in.svm ? clSetKernelArgSVMPointer(k, index, in.svm) : clSetKernelArg(k, index, sizeof(cl_mem), &in.mem);
+}
+
+void FindMaxEngine::run_kernel(cl_kernel k, const char* name, size_t groups, size_t count) {
+    const size_t global = groups * (size_t)opt_.wg;
+    const size_t lsize = (size_t)opt_.wg;
+    // No host wait between passes: each pass waits on the previous command's event
+    cl_event evt = nullptr;
+    check(clEnqueueNDRangeKernel(lane_->q, k, 1, nullptr, &global, &lsize, wait_count(), wait_list(), &evt), "clEnqueueNDRangeKernel");
+    push_event(chain_->kernels, evt, name);
+    if (!opt_.trace) return;
+    CommandTiming& c = chain_->stats.commands.back();
+    c.pass = (int)chain_->kernels.size() - 1;
+    c.elems = (uint64_t)count;
+    c.global = global;
+    c.local = lsize;
+}
+
+size_t FindMaxEngine::launch_pass(Program& prog, DType t, size_t count, Input in, cl_mem out_buf, size_t out_base) {
+    const int wg = opt_.wg;
+    cl_kernel krn = prog.reduce;
+    // determine number of groups for this pass
+    const size_t groups = groups_for(count, opt_.vec);
+
+    const cl_ulong n_arg = (cl_ulong)count;
+    const cl_ulong base_arg = (cl_ulong)out_base;
+    cl_int e = set_input_arg(krn, 0, in);
+    e |= clSetKernelArg(krn, 1, sizeof(cl_mem), &out_buf);
+    e |= clSetKernelArg(krn, 2, sizeof(cl_ulong), &n_arg);
+    e |= clSetKernelArg(krn, 3, sizeof(cl_ulong), &base_arg);
+    if (variant_ == Variant::WorkGroup) {
+        check(e, "clSetKernelArg(wg)");
+        set_nan_count_arg(prog, krn, 4);
+    } else {
+        // local memory scratch: one element per work-item
+        e |= clSetKernelArg(krn, 4, dtype_size(t) * (size_t)wg, nullptr);
+        check(e, variant_ == Variant::Atomic ? "clSetKernelArg(atomic)" :
+                 variant_ == Variant::SubGroup ? "clSetKernelArg(subgroup)" : "clSetKernelArg(local)");
+        set_nan_count_arg(prog, krn, 5);
+    }
+
+    run_kernel(krn, "reduce_stage", groups, count);
+    return groups;
+}
+
+size_t FindMaxEngine::launch_argmax_pass(Program& prog, DType t, size_t count, Input in_val, cl_mem in_idx, cl_mem out_val, cl_mem out_idx) {
+    const int wg = opt_.wg;
+    cl_kernel krn = prog.argmax;
+    // No vector loads in the pair kernel, so size groups for scalar loads
+    const size_t groups = groups_for(count, 1);
+
+    const cl_ulong n_arg = (cl_ulong)count;
+    const cl_uint has_idx = in_idx ? 1u : 0u;
+    cl_int e = set_input_arg(krn, 0, in_val);
+    e |= clSetKernelArg(krn, 1, sizeof(cl_mem), &in_idx); // NULL on pass 0
+    e |= clSetKernelArg(krn, 2, sizeof(cl_mem), &out_val);
+    e |= clSetKernelArg(krn, 3, sizeof(cl_mem), &out_idx);
+    e |= clSetKernelArg(krn, 4, sizeof(cl_ulong), &n_arg);
+    e |= clSetKernelArg(krn, 5, sizeof(cl_uint), &has_idx);
+    e |= clSetKernelArg(krn, 6, dtype_size(t) * (size_t)wg, nullptr);
+    e |= clSetKernelArg(krn, 7, sizeof(cl_ulong) * (size_t)wg, nullptr);
+    check(e, "clSetKernelArg(argmax)");
+
+    run_kernel(krn, "reduce_argmax_stage", groups, count);
+    return groups;
+}
+
+size_t FindMaxEngine::launch_minmax_pass(Program& prog, DType t, size_t count, Input in, bool has_pairs, cl_mem out) {
+    const int wg = opt_.wg;
+    cl_kernel krn = prog.minmax;
+    const size_t groups = groups_for(count, 1);
+
+    const cl_ulong n_arg = (cl_ulong)count;
+    const cl_uint pairs_arg = has_pairs ? 1u : 0u;
+    cl_int e = set_input_arg(krn, 0, in);
+    e |= clSetKernelArg(krn, 1, sizeof(cl_mem), &out);
+    e |= clSetKernelArg(krn, 2, sizeof(cl_ulong), &n_arg);
+    e |= clSetKernelArg(krn, 3, sizeof(cl_uint), &pairs_arg);
+    e |= clSetKernelArg(krn, 4, dtype_size(t) * (size_t)wg, nullptr);
+    e |= clSetKernelArg(krn, 5, dtype_size(t) * (size_t)wg, nullptr);
+    check(e, "clSetKernelArg(minmax)");
+    set_nan_count_arg(prog, krn, 6);
+
+    run_kernel(krn, "reduce_minmax_stage", groups, count);
+    return groups;
+}
+
+void FindMaxEngine::set_nan_count_arg(const Program& prog, cl_kernel k, cl_uint index) {
+    // Later passes read partials, which hold no NaN, so every pass can count
+    if (prog.counts_nans) check(clSetKernelArg(k, index, sizeof(cl_mem), &lane_->nan_count), "clSetKernelArg(nan count)");
+}
+
+bool FindMaxEngine::counts_nans(DType t, Op op) const {
+    return nan_policy_ == NanPolicy::Count && dtype_is_float(t) && op != Op::Sum;
+}
+
+void FindMaxEngine::enqueue_nan_count_init() {
+    ensure_buffer(&lane_->nan_count, &lane_->nan_count_bytes, 2 * sizeof(cl_uint), CL_MEM_READ_WRITE);
+    const cl_uint zero = 0;
+    cl_event evt = nullptr;
+    check(clEnqueueFillBuffer(lane_->q, lane_->nan_count, &zero, sizeof(zero), 0, 2 * sizeof(cl_uint), wait_count(), wait_list(), &evt),
+          "clEnqueueFillBuffer(nan count)");
+    push_event(chain_->others, evt, "nan count init");
+}
+
+void FindMaxEngine::enqueue_nan_count_result() {
+    cl_event evt = nullptr;
+    check(clEnqueueReadBuffer(lane_->q, lane_->nan_count, CL_FALSE, 0, 2 * sizeof(cl_uint), chain_->nan_words, wait_count(), wait_list(), &evt),
+          "clEnqueueReadBuffer(nan count)");
+    push_event(chain_->others, evt, "read nan count");
+}
+
+// Initial value of the single-pass atomic slot: the identity of op in the
+// slot's encoding (ordered int for float, the value itself for 32-bit ints).
+static uint32_t atomic_slot_init(DType t, Op op) {
+    if (op == Op::Min) {
+        if (t == DType::Float) return (uint32_t)float_to_ordered_int(std::numeric_limits<float>::infinity());
+        if (t == DType::Int32) return (uint32_t)std::numeric_limits<int32_t>::max();
+        return std::numeric_limits<uint32_t>::max();
+    }
+    if (t == DType::Float) return (uint32_t)float_to_ordered_int(-std::numeric_limits<float>::infinity());
+    if (t == DType::Int32) return (uint32_t)std::numeric_limits<int32_t>::min();
+    return 0u;
+}
+
+static void check_count(size_t n) {
+    if ((uint64_t)n > (uint64_t)std::numeric_limits<cl_uint>::max()) {
+        throw std::runtime_error("Input too large: batched segments are indexed with 32-bit offsets");
+    }
+}
+
+void FindMaxEngine::enqueue_atomic_init(DType t, Op op) {
+    ensure_buffer(&lane_->partials, &lane_->partials_bytes, sizeof(cl_uint), CL_MEM_READ_WRITE);
+    const uint32_t init = atomic_slot_init(t, op);
+    cl_event evt = nullptr;
+    check(clEnqueueFillBuffer(lane_->q, lane_->partials, &init, sizeof(init), 0, sizeof(init), wait_count(), wait_list(), &evt), "clEnqueueFillBuffer(atomic init)");
+    push_event(chain_->others, evt, "atomic init");
+}
+
+void FindMaxEngine::enqueue_atomic_result(DType t, void* result) {
+    enqueue_read(lane_->partials, sizeof(cl_uint), &chain_->slot, "clEnqueueReadBuffer(result)");
+    // Decode the slot once the read has completed
+    chain_->finalize = [t, result](const Pending& p) {
+        if (t == DType::Float) {
+            const float f = ordered_int_to_float((int32_t)p.slot);
+            std::memcpy(result, &f, sizeof(f));
+        } else {
+            std::memcpy(result, &p.slot, sizeof(p.slot));
+        }
+    };
+}
+
+cl_mem FindMaxEngine::enqueue_passes(Program& prog, DType t, Input in, size_t n) {
+    const size_t esize = dtype_size(t);
+    const ReductionPlan p = multipass_plan(n);
+    if (p.partials_elems > 0) ensure_buffer(&lane_->partials, &lane_->partials_bytes, esize * p.partials_elems, CL_MEM_READ_WRITE);
+    if (p.alt_elems > 0) ensure_buffer(&lane_->alt, &lane_->alt_bytes, esize * p.alt_elems, CL_MEM_READ_WRITE);
+
+    // Pass 0 reads the input, later passes ping-pong partials -> alt -> partials.
+    // The input buffer is only ever read.
+    size_t in_count = n;
+    Input cur_in = in;
+    cl_mem cur_out = lane_->partials;
+    for (size_t pass = 0; pass < p.pass_groups.size(); ++pass) {
+        launch_pass(prog, t, in_count, cur_in, cur_out);
+        in_count = p.pass_groups[pass];
+        cur_in = Input();
+        cur_in.mem = cur_out;
+        cur_out = (cur_out == lane_->partials) ? lane_->alt : lane_->partials;
+    }
+    // The last output buffer (or the input for n == 1)
+    return cur_in.mem;
+}
+
+cl_mem FindMaxEngine::enqueue_minmax_passes(Program& prog, DType t, Input in, size_t n, bool has_pairs) {
+    // Each pass writes groups minima followed by groups maxima, at most groups_max of each
+    const size_t bytes = 2 * dtype_size(t) * (size_t)opt_.groups_max;
+    ensure_buffer(&lane_->partials, &lane_->partials_bytes, bytes, CL_MEM_READ_WRITE);
+    ensure_buffer(&lane_->alt, &lane_->alt_bytes, bytes, CL_MEM_READ_WRITE);
+
+    size_t count = launch_minmax_pass(prog, t, n, in, has_pairs, lane_->partials);
+    cl_mem cur = lane_->partials, next = lane_->alt;
+    while (count > 1) {
+        Input pin;
+        pin.mem = cur;
+        count = launch_minmax_pass(prog, t, count, pin, true, next);
+        std::swap(cur, next);
+    }
+    // With one group left, the min and max sit next to each other
+    return cur;
+}
+
+void FindMaxEngine::reduce(DType t, Op op, Input in, size_t n, void* result) {
+    Program& prog = program(t, op);
+    if (prog.counts_nans) enqueue_nan_count_init();
+    if (op == Op::MinMax) {
+        enqueue_read(enqueue_minmax_passes(prog, t, in, n, false), 2 * dtype_size(t), result, "clEnqueueReadBuffer(minmax)");
+    } else if (variant_ == Variant::Atomic) {
+        // Single pass: all groups fold into partials[0] (a 32-bit slot)
+        enqueue_atomic_init(t, op);
+        launch_pass(prog, t, n, in, lane_->partials);
+        enqueue_atomic_result(t, result);
+    } else {
+        enqueue_read(enqueue_passes(prog, t, in, n), dtype_size(t), result, "clEnqueueReadBuffer(result)");
+    }
+    if (prog.counts_nans) enqueue_nan_count_result();
+}
+
+size_t FindMaxEngine::max_alloc_bytes() const {
+    cl_ulong max_alloc = 0;
+    if (clGetDeviceInfo(device_, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc), &max_alloc, nullptr) != CL_SUCCESS) return 0;
+    return (size_t)max_alloc;
+}
+
+size_t FindMaxEngine::stream_chunk_elems(DType t) const {
+    const size_t esize = dtype_size(t);
+    // Pinned tiles are smaller so the first pass starts sooner
+    size_t chunk = opt_.chunk_elems > 0 ? opt_.chunk_elems : host_mem_ == HostMem::Pinned ? ((size_t)1 << 22) : ((size_t)1 << 24);
+    const size_t max_alloc = max_alloc_bytes();
+    if (max_alloc > 0) chunk = std::min(chunk, max_alloc / esize);
+    return std::max<size_t>(chunk, 1);
+}
+
+// The GPU share of reduce_hybrid() ends on a page boundary, so zero-copy
+// wrapping of it stays page granular
+static size_t hybrid_gpu_elems(size_t n, double fraction, size_t esize) {
+    const size_t align = std::max<size_t>(1, HOST_ALIGNMENT / esize);
+    const size_t n_gpu = (size_t)((double)n * fraction) / align * align;
+    return std::min(n_gpu, n);
+}
+
+std::string FindMaxEngine::hybrid_file(DType t, Op op) const {
+    if (opt_.cache_dir.empty()) return std::string();
+    uint64_t h = fnv1a64(device_name_);
+    h = fnv1a64(std::string(1, '\0') + get_device_string(device_, CL_DRIVER_VERSION), h);
+    h = fnv1a64(std::string(1, '\0') + dtype_name(t) + "/" + op_name(op) + "/" + variant_name(variant_) + "/" +
+                host_mem_name(host_mem_) + "/" + std::to_string(opt_.cpu_threads), h);
+    char name[40] = {0};
+    std::snprintf(name, sizeof(name), "hybrid-%016llx.txt", (unsigned long long)h);
+    return opt_.cache_dir + "/" + name;
+}
+
+double FindMaxEngine::gpu_fraction(DType t, Op op) const {
+    if (backend_ == Backend::Cpu) return 0.0;
+    if (opt_.gpu_fraction > 0.0) return opt_.gpu_fraction;
+    const ProgramKey key(t, op);
+    auto it = gpu_fraction_.find(key);
+    if (it != gpu_fraction_.end()) return it->second.fraction;
+    HybridSplit s; // uncalibrated: even split
+    const std::string path = hybrid_file(t, op);
+    std::ifstream ifs(path);
+    double stored = 0.0;
+    if (!path.empty() && ifs >> stored && stored > 0.0 && stored <= 1.0) {
+        s.fraction = stored;
+        s.calibrated = true;
+    }
+    gpu_fraction_[key] = s;
+    return s.fraction;
+}
+
+void FindMaxEngine::update_gpu_fraction(DType t, Op op, size_t n_gpu, uint64_t gpu_ns, size_t n_cpu, uint64_t cpu_ns) {
+    if (opt_.gpu_fraction > 0.0 || n_gpu == 0 || n_cpu == 0 || gpu_ns == 0 || cpu_ns == 0) return;
+    // Both sides finish together when the split matches their throughput ratio
+    const double gpu_rate = (double)n_gpu / (double)gpu_ns;
+    const double cpu_rate = (double)n_cpu / (double)cpu_ns;
+    double f = gpu_rate / (gpu_rate + cpu_rate);
+    HybridSplit& s = gpu_fraction_[ProgramKey(t, op)];
+    if (s.calibrated) f = 0.5 * (s.fraction + f); // damp run-to-run noise
+    // Keep both sides busy enough to stay measurable
+    s.fraction = std::min(0.98, std::max(0.02, f));
+    s.calibrated = true;
+
+    const std::string path = hybrid_file(t, op);
+    if (path.empty()) return;
+    std::error_code ec;
+    std::filesystem::create_directories(opt_.cache_dir, ec);
+    std::ostringstream os;
+    os << s.fraction << "\n";
+    const std::string text = os.str();
+    write_file_atomically(path, text.data(), text.size());
+}
+
+void FindMaxEngine::reduce_hybrid(DType t, Op op, const void* data, size_t n, void* result) {
+    if (backend_ == Backend::Cpu) {
+        stats_ = reduce_on_cpu(t, op, data, n, result);
+        return;
+    }
+    if (host_mem_ == HostMem::Svm && !svm_fine_grain_) {
+        throw std::runtime_error("Hybrid reduction needs --host-mem copy, zero-copy or fine-grained SVM");
+    }
+    if (n == 0) return;
+    program(t, op); // build (and report dtype errors) before either side starts
+    const auto t0 = std::chrono::steady_clock::now();
+    const size_t esize = dtype_size(t);
+    const size_t n_gpu = hybrid_gpu_elems(n, gpu_fraction(t, op), esize);
+    const size_t n_cpu = n - n_gpu;
+    const size_t nres = op == Op::MinMax ? 2 : 1;
+    std::vector<char> partials(2 * nres * esize); // GPU result, then CPU result
+    char* gpu_res = partials.data();
+    char* cpu_res = partials.data() + nres * esize;
+
+    // The CPU share starts on a worker before the GPU share is enqueued:
+    // enqueuing can block (pinned staging waits for its tiles to be free),
+    // and the calibration assumes the two sides overlap
+    uint64_t cpu_ns = 0, cpu_nans = 0;
+    const char* cpu_data = static_cast<const char*>(data) + n_gpu * esize;
+    const auto c0 = std::chrono::steady_clock::now();
+    std::future<void> cpu_share = std::async(std::launch::async, [&]() {
+        cpu_reduce(t, op, cpu_data, n_cpu, cpu_res, opt_.cpu_threads);
+        cpu_nans = cpu_apply_nan_policy(t, op, nan_policy_, cpu_data, n_cpu, cpu_res, opt_.cpu_threads);
+        cpu_ns = elapsed_ns(c0);
+    });
+    begin_chain();
+    try {
+        reduce_host_chain(t, op, data, n_gpu, gpu_res);
+        if (chain_->tail) check(clFlush(lane_->q), "clFlush");
+        cpu_share.get();
+        if (opt_.trace) {
+            push_phase(*chain_, "cpu share", c0);
+            chain_->stats.phases.back().ns = cpu_ns; // the worker's time, not the wait for it
+        }
+        finish_chain();
+    } catch (...) {
+        if (cpu_share.valid()) cpu_share.wait();
+        abandon_chain();
+        throw;
+    }
+
+    if (n_cpu == 0) std::memcpy(result, gpu_res, nres * esize);
+    else if (n_gpu == 0) std::memcpy(result, cpu_res, nres * esize);
+    else cpu_merge_partials(t, op, partials.data(), 2, result, nan_policy_);
+    if (nan_policy_ == NanPolicy::Count) stats_.nan_count += cpu_nans;
+    // Device busy time of the GPU share: its passes plus its upload
+    update_gpu_fraction(t, op, n_gpu, stats_.kernel_ns + stats_.upload_ns, n_cpu, cpu_ns);
+    stats_.cpu_ns = cpu_ns;
+    stats_.gpu_fraction = (double)n_gpu / (double)n;
+    stats_.wall_ns = elapsed_ns(t0);
+}
+
+bool FindMaxEngine::reduce_mapped(DType t, Op op, const void* data, size_t n, void* result) {
+    if (backend_ == Backend::Cpu) {
+        stats_ = reduce_on_cpu(t, op, data, n, result);
+        return true;
+    }
+    const size_t bytes = dtype_size(t) * n;
+    const size_t max_alloc = max_alloc_bytes();
+    if (n == 0 || (max_alloc > 0 && bytes > max_alloc)) {
+        reduce_stream(t, op, data, n, result);
+        return false;
+    }
+    begin_chain();
+    const auto t0 = std::chrono::steady_clock::now();
+    cl_int err = CL_SUCCESS;
+    cl_mem wrapped = clCreateBuffer(ctx_, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, bytes, const_cast<void*>(data), &err);
+    if (err != CL_SUCCESS) {
+        // Some drivers only wrap suitably aligned or locked pages
+        abandon_chain();
+        reduce_stream(t, op, data, n, result);
+        return false;
+    }
+    chain_->stats.upload_ns = elapsed_ns(t0);
+    try {
+        Input in;
+        in.mem = wrapped;
+        reduce(t, op, in, n, result);
+        finish_chain();
+    } catch (...) {
+        abandon_chain();
+        clReleaseMemObject(wrapped);
+        throw;
+    }
+    clReleaseMemObject(wrapped);
+    return true;
+}
+
+void FindMaxEngine::reduce_stream(DType t, Op op, const void* data, size_t n, void* result) {
+    if (backend_ == Backend::Cpu) {
+        // Nothing to stream: the host reads the data in place
+        stats_ = reduce_on_cpu(t, op, data, n, result);
+        return;
+    }
+    begin_chain();
+    try {
+        if (n > 0) reduce_stream_chain(t, op, static_cast<const char*>(data), n, result);
+        finish_chain();
+    } catch (...) {
+        abandon_chain();
+        throw;
+    }
+}
+
+void FindMaxEngine::reduce_stream_chain(DType t, Op op, const char* data, size_t n, void* result) {
+    Program& prog = program(t, op);
+    const size_t esize = dtype_size(t);
+    const size_t chunk = stream_chunk_elems(t);
+    const size_t chunks = (n + chunk - 1) / chunk;
+    const size_t nbuf = std::min<size_t>(chunks, (size_t)opt_.stream_buffers);
+    // Pinned: every tile is copied into mapped CL_MEM_ALLOC_HOST_PTR staging,
+    // which the kernel reads in place on unified memory and which is the
+    // source of a DMA upload into the tile buffer otherwise
+    const bool staged = host_mem_ == HostMem::Pinned;
+    const bool tile_bufs = !staged || !unified_memory_;
+
+    // Uploads go through their own queue so they can run while the main queue reduces
+    if (!copy_q_) copy_q_ = create_queue(ctx_, device_, CL_QUEUE_PROFILING_ENABLE, "clCreateCommandQueue(copy)");
+    // An asynchronous call may still read the buffers of the previous one
+    if (stream_done_) {
+        const cl_int err = clWaitForEvents(1, &stream_done_);
+        clReleaseEvent(stream_done_);
+        stream_done_ = nullptr;
+        check(err, "clWaitForEvents(stream)");
+    }
+    const size_t tile_bytes = esize * std::min(chunk, n);
+    for (size_t b = 0; b < nbuf; ++b) {
+        if (staged) ensure_buffer(&staging_bufs_[b], &staging_bytes_[b], tile_bytes, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR);
+        if (tile_bufs) ensure_buffer(&stream_bufs_[b], &stream_bytes_[b], tile_bytes, CL_MEM_READ_ONLY);
+    }
+
+    // max, min and sum: the first pass over each chunk writes its group
+    // results into chunk_vals_ after those of the chunks before it, and one
+    // reduction of chunk_vals_ ends the call. The atomic variant folds every
+    // chunk into the same slot; minmax reduces each chunk to its two values
+    // in chunk_vals_, all minima, then all maxima.
+    const bool atomic = variant_ == Variant::Atomic && op != Op::MinMax;
+    size_t vals = 2 * chunks;
+    if (op != Op::MinMax) {
+        vals = 0;
+        for (size_t c = 0; c < chunks; ++c) vals += groups_for(std::min(chunk, n - c * chunk), opt_.vec);
+    }
+    if (prog.counts_nans) enqueue_nan_count_init();
+    if (atomic) {
+        enqueue_atomic_init(t, op);
+    } else {
+        ensure_buffer(&chunk_vals_, &chunk_vals_bytes_, esize * vals, CL_MEM_READ_WRITE);
+    }
+
+    // consumer[b]: last command reading buffer b; what refills it waits on it
+    std::vector<cl_event> consumer(nbuf, nullptr);
+    size_t base = 0; // chunk_vals_ entries written so far
+    for (size_t c = 0; c < chunks; ++c) {
+        const size_t b = c % nbuf;
+        const size_t first = c * chunk;
+        const size_t count = std::min(chunk, n - first);
+        const cl_uint waits = consumer[b] ? 1u : 0u;
+        const cl_event* wait = consumer[b] ? &consumer[b] : nullptr;
+
+        Input in;
+        cl_event up = nullptr;
+        if (staged) {
+            // The blocking map returns once tile b is free again
+            cl_int err = CL_SUCCESS;
+            void* dst = clEnqueueMapBuffer(copy_q_, staging_bufs_[b], CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, 0, esize * count, waits,
+                                           wait, &up, &err);
+            check(err, "clEnqueueMapBuffer(staging)");
+            push_event(chain_->others, up, "map staging");
+            const auto h0 = std::chrono::steady_clock::now();
+            std::memcpy(dst, data + esize * first, esize * count);
+            chain_->stats.upload_ns += elapsed_ns(h0);
+            if (tile_bufs) {
+                check(clEnqueueWriteBuffer(copy_q_, stream_bufs_[b], CL_FALSE, 0, esize * count, dst, 0, nullptr, &up),
+                      "clEnqueueWriteBuffer(tile)");
+                push_event(chain_->uploads, up, "upload tile");
+            }
+            check(clEnqueueUnmapMemObject(copy_q_, staging_bufs_[b], dst, 0, nullptr, &up), "clEnqueueUnmapMemObject(staging)");
+            push_event(chain_->uploads, up, "unmap staging");
+            in.mem = tile_bufs ? stream_bufs_[b] : staging_bufs_[b];
+        } else {
+            check(clEnqueueWriteBuffer(copy_q_, stream_bufs_[b], CL_FALSE, 0, esize * count, data + esize * first, waits, wait, &up),
+                  "clEnqueueWriteBuffer(chunk)");
+            push_event(chain_->uploads, up, "upload chunk");
+            in.mem = stream_bufs_[b];
+        }
+        // the copy queue is in order, so waiting on its last command is the only extra dependency
+        check(clFlush(copy_q_), "clFlush(copy)");
+
+        if (atomic) {
+            launch_pass(prog, t, count, in, lane_->partials);
+        } else if (op == Op::MinMax) {
+            const cl_mem res = enqueue_minmax_passes(prog, t, in, count, false);
+            enqueue_copy(res, 0, chunk_vals_, esize * c, esize);
+            enqueue_copy(res, esize, chunk_vals_, esize * (chunks + c), esize);
+        } else {
+            base += launch_pass(prog, t, count, in, chunk_vals_, base);
+        }
+        consumer[b] = chain_->tail;
+        check(clFlush(lane_->q), "clFlush");
+    }
+
+    Input partials;
+    partials.mem = chunk_vals_;
+    if (atomic) {
+        enqueue_atomic_result(t, result);
+    } else if (op == Op::MinMax) {
+        enqueue_read(enqueue_minmax_passes(prog, t, partials, chunks, true), 2 * esize, result, "clEnqueueReadBuffer(minmax)");
+    } else {
+        enqueue_read(enqueue_passes(prog, t, partials, base), esize, result, "clEnqueueReadBuffer(result)");
+    }
+    if (prog.counts_nans) enqueue_nan_count_result();
+    stream_done_ = chain_->tail;
+    clRetainEvent(stream_done_);
+}
+
+void FindMaxEngine::enqueue_copy(cl_mem src, size_t src_offset, cl_mem dst, size_t dst_offset, size_t bytes) {
+    cl_event evt = nullptr;
+    check(clEnqueueCopyBuffer(lane_->q, src, dst, src_offset, dst_offset, bytes, wait_count(), wait_list(), &evt), "clEnqueueCopyBuffer");
+    push_event(chain_->others, evt, "copy");
+}
+
+void FindMaxEngine::reduce_segments(DType t, Op op, Input in, const std::vector<uint32_t>& offsets, void* result) {
+    Program& prog = program(t, op);
+    if (!prog.segments || (op != Op::Max && op != Op::Min)) {
+        throw std::runtime_error("Batched reduction needs op max or min over float, int32 or uint32 (per-segment global atomics).");
+    }
+    const size_t k = offsets.size() - 1;
+
+    // meta = offsets, first group of every segment, segment of every group.
+    // Groups per segment are in proportion to its length; empty segments get none.
+    const size_t per_group = (size_t)opt_.wg * (size_t)opt_.items_per_thread;
+    std::vector<cl_uint>& meta = chain_->meta;
+    meta.assign(offsets.begin(), offsets.end());
+    size_t groups = 0;
+    for (size_t s = 0; s <= k; ++s) {
+        meta.push_back((cl_uint)groups);
+        if (s < k) groups += (offsets[s + 1] - offsets[s] + per_group - 1) / per_group;
+    }
+    check_count(groups);
+    if (groups == 0) return;
+    for (size_t s = 0; s < k; ++s) {
+        const cl_uint first = meta[k + 1 + s];
+        const cl_uint next = meta[k + 2 + s];
+        meta.insert(meta.end(), next - first, (cl_uint)s);
+    }
+
+    const size_t meta_bytes = sizeof(cl_uint) * meta.size();
+    const size_t out_bytes = sizeof(cl_uint) * k;
+    ensure_buffer(&lane_->segment_meta, &lane_->segment_meta_bytes, meta_bytes, CL_MEM_READ_ONLY);
+    ensure_buffer(&lane_->segment_out, &lane_->segment_out_bytes, out_bytes, CL_MEM_READ_WRITE);
+
+    cl_event evt = nullptr;
+    check(clEnqueueWriteBuffer(lane_->q, lane_->segment_meta, CL_FALSE, 0, meta_bytes, meta.data(), wait_count(), wait_list(), &evt), "clEnqueueWriteBuffer(segments)");
+    push_event(chain_->uploads, evt, "upload segments");
+    const uint32_t init = atomic_slot_init(t, op);
+    check(clEnqueueFillBuffer(lane_->q, lane_->segment_out, &init, sizeof(init), 0, out_bytes, wait_count(), wait_list(), &evt), "clEnqueueFillBuffer(segments)");
+    push_event(chain_->others, evt, "segments init");
+
+    cl_kernel krn = prog.segments;
+    const cl_uint k_arg = (cl_uint)k;
+    cl_int e = set_input_arg(krn, 0, in);
+    e |= clSetKernelArg(krn, 1, sizeof(cl_mem), &lane_->segment_meta);
+    e |= clSetKernelArg(krn, 2, sizeof(cl_uint), &k_arg);
+    e |= clSetKernelArg(krn, 3, sizeof(cl_mem), &lane_->segment_out);
+    e |= clSetKernelArg(krn, 4, dtype_size(t) * (size_t)opt_.wg, nullptr);
+    check(e, "clSetKernelArg(segments)");
+    run_kernel(krn, "reduce_segments", groups, offsets.back());
+
+    chain_->slots.resize(k);
+    enqueue_read(lane_->segment_out, out_bytes, chain_->slots.data(), "clEnqueueReadBuffer(segments)");
+    chain_->finalize = [t, result](const Pending& p) {
+        for (size_t s = 0; s < p.slots.size(); ++s) {
+            if (t == DType::Float) {
+                const float f = ordered_int_to_float((int32_t)p.slots[s]);
+                std::memcpy(static_cast<char*>(result) + s * sizeof(f), &f, sizeof(f));
+            } else {
+                std::memcpy(static_cast<char*>(result) + s * sizeof(cl_uint), &p.slots[s], sizeof(cl_uint));
+            }
+        }
+    };
+}
+
+void FindMaxEngine::reduce_argmax(DType t, Input in, size_t n, void* value, uint64_t* index) {
+    Program& prog = program(t, Op::Max, true);
+    const size_t esize = dtype_size(t);
+
+    // At most groups_max pairs come out of pass 0, so the pair scratch stays small
+    const size_t pairs = (size_t)opt_.groups_max;
+    ensure_buffer(&lane_->partials, &lane_->partials_bytes, esize * pairs, CL_MEM_READ_WRITE);
+    ensure_buffer(&lane_->partials_idx, &lane_->partials_idx_bytes, sizeof(cl_ulong) * pairs, CL_MEM_READ_WRITE);
+    ensure_buffer(&lane_->alt, &lane_->alt_bytes, esize * pairs, CL_MEM_READ_WRITE);
+    ensure_buffer(&lane_->alt_idx, &lane_->alt_idx_bytes, sizeof(cl_ulong) * pairs, CL_MEM_READ_WRITE);
+
+    // Always run pass 0, even for n == 1, so the index comes from the kernel
+    size_t count = launch_argmax_pass(prog, t, n, in, nullptr, lane_->partials, lane_->partials_idx);
+    cl_mem val = lane_->partials, idx = lane_->partials_idx;
+    cl_mem next_val = lane_->alt, next_idx = lane_->alt_idx;
+    while (count > 1) {
+        Input cur;
+        cur.mem = val;
+        count = launch_argmax_pass(prog, t, count, cur, idx, next_val, next_idx);
+        std::swap(val, next_val);
+        std::swap(idx, next_idx);
+    }
+
+    enqueue_read(val, esize, value, "clEnqueueReadBuffer(argmax value)");
+    // The kernel's "no element" index (ULONG_MAX) is ARGMAX_NONE
+    enqueue_read(idx, sizeof(cl_ulong), index, "clEnqueueReadBuffer(argmax index)");
+}
+
+} // namespace findmax
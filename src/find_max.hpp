@@ -0,0 +1,688 @@
+// Reusable GPU reduction engine (max, min, fused min + max, sum)
+// - selects the device, creates context/queue and builds the program once
+// - keeps device buffers between calls so repeated queries skip setup
+// - CPU backend (threaded host code) when asked for or when there is no GPU
+
+#pragma once
+
+#include "buffer_pool.hpp"
+#include "dtype.hpp"
+#include "program_cache.hpp"
+
+#include <CL/cl.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace findmax {
+
+enum class Variant { Local, WorkGroup, Atomic, SubGroup };
+
+const char* variant_name(Variant v);
+
+// Where reductions run. Cpu uses the threaded host code of cpu_reduce.hpp:
+// no OpenCL objects are created, host_mem() is Copy and the cl_mem
+// overloads throw.
+enum class Backend { Gpu, Cpu };
+
+const char* backend_name(Backend b); // gpu | cpu
+
+// Reduction operator. MinMax reads the input once and returns both extremes;
+// Sum is Kahan-compensated per work-item and pairwise across work-items for
+// floating-point types, and wraps like C unsigned arithmetic for integers.
+enum class Op { Max, Min, MinMax, Sum };
+
+const char* op_name(Op op); // max | min | minmax | sum
+Op parse_op(const std::string& name);
+
+// What max, min and minmax do with NaN in floating-point input (integer
+// types have none; sums always propagate, as IEEE addition does):
+// - Ignore: NaN never wins, like fmax/fmin
+// - Propagate: any NaN makes the result a quiet NaN
+// - Count: as Ignore, and RunStats::nan_count reports the NaNs read
+enum class NanPolicy { Ignore, Propagate, Count };
+
+const char* nan_policy_name(NanPolicy p); // ignore | propagate | count
+NanPolicy parse_nan_policy(const std::string& name);
+
+// Map a float to an int whose signed ordering matches the float ordering.
+// Mirrors float_to_ordered_int() in kernels.cl; the mapping is its own inverse.
+int32_t float_to_ordered_int(float f);
+float ordered_int_to_float(int32_t i);
+
+// How host input reaches the device in max(const T*, size_t):
+// - Copy: upload into an engine-owned device buffer
+// - ZeroCopy: wrap the host pages with CL_MEM_USE_HOST_PTR (no copy on
+//   integrated GPUs when the pointer is page aligned, see alloc_host())
+// - Svm: pass SVM memory from alloc_host() straight to the kernel (OpenCL 2.0)
+// - Pinned: copy tile by tile into mapped CL_MEM_ALLOC_HOST_PTR staging
+//   buffers, the first pass over each tile starting as soon as it is
+//   unmapped (see reduce_stream()); other calls than reductions copy
+enum class HostMem { Copy, ZeroCopy, Svm, Pinned };
+
+const char* host_mem_name(HostMem m);
+HostMem parse_host_mem(const std::string& name);
+
+// Which elements each work-item of reduce_stage reads:
+// - Strided: grid stride; every group sweeps the whole buffer
+// - Blocked: one contiguous tile per group, walked coalesced by its work-items
+enum class Layout { Strided, Blocked };
+
+const char* layout_name(Layout l);
+Layout parse_layout(const std::string& name);
+
+constexpr size_t HOST_ALIGNMENT = 4096; // page; Intel zero-copy also wants sizes in 64-byte multiples
+
+constexpr int ITEMS_PER_THREAD = 8; // tuning knob; 8–16 works well typically
+
+struct EngineOptions {
+    std::string device = "auto";  // auto (GPU, else CPU) | gpu | cpu
+    int gpu_index = -1;           // list_gpu_devices() entry; -1: first Intel GPU, else first GPU
+    unsigned cpu_threads = 0;     // CPU backend workers; 0: one per hardware thread
+    double gpu_fraction = 0.0;    // reduce_hybrid() GPU share in (0, 1]; 0: calibrated
+    int wg = 256;                 // work-group size; 128 or 256 are good starting points on Intel iGPU
+    int groups_max = 1024;        // cap number of groups per pass
+    std::string variant = "auto"; // auto | wg (OpenCL 2.0) | local (OpenCL 1.2) | atomic (single pass) | subgroup
+    std::string cache_dir = default_cache_dir(); // program binary cache; empty disables
+    std::string kernel_path;      // empty: resolve_kernel_path()
+    std::string host_mem = "copy"; // copy | zero-copy | svm
+    int vec = 1;                  // vector load width in the kernel: 1, 2, 4, 8 or 16 (-DVEC=)
+    std::string dtype = "float";  // element type built at construction; others build on first use
+    size_t chunk_elems = 0;       // reduce_stream() chunk; 0: 16M elements, capped by CL_DEVICE_MAX_MEM_ALLOC_SIZE
+    int stream_buffers = 2;       // rotating device input buffers of reduce_stream(): 2 or 3
+    int items_per_thread = ITEMS_PER_THREAD; // elements per work-item (times vec) before a group is added
+    bool trace = false;           // record RunStats::commands and RunStats::phases
+    std::string nan_policy = "ignore"; // ignore | propagate | count (-DNAN_POLICY=)
+    bool specialize = false;      // bake wg and items_per_thread into the programs (-DWG_SIZE=, -DITEMS_PER_THREAD=)
+    std::string layout = "strided"; // strided | blocked (-DLAYOUT_BLOCKED=1)
+    bool prefetch = false;        // blocked layout: prefetch() the next round of loads (-DPREFETCH=1)
+    int queues = 1;               // command queues, each with its own scratch; asynchronous calls rotate over them
+    size_t reserve_elems = 0;     // reserve() scratch for this many dtype elements at construction
+};
+
+// Launch shape of the reductions: the tunable subset of EngineOptions
+struct LaunchConfig {
+    int wg = 256;         // power of two
+    int groups_max = 1024;
+    int items_per_thread = ITEMS_PER_THREAD;
+    int vec = 1;          // 1, 2, 4, 8 or 16
+};
+
+constexpr size_t MAX_STREAM_BUFFERS = 3;
+constexpr int MAX_QUEUES = 16;
+
+// Work-group counts of every pass for an n-element reduction. Pass 0 reads
+// the input and writes pass_groups[0] partials; pass k > 0 reads the
+// partials of pass k-1. Scratch only needs the two largest outputs.
+struct ReductionPlan {
+    std::vector<size_t> pass_groups;
+    size_t partials_elems = 0; // pass 0 output (and every even pass after it)
+    size_t alt_elems = 0;      // pass 1 output (and every odd pass after it)
+};
+
+// Result of an index-returning reduction. Ties resolve to the lowest index;
+// index is ARGMAX_NONE when no element compares (empty or all-NaN input).
+constexpr uint64_t ARGMAX_NONE = ~0ull;
+
+template <typename T = float>
+struct ArgMax {
+    T value = T();
+    uint64_t index = ARGMAX_NONE;
+};
+
+template <typename T = float>
+struct MinMax {
+    T min = DTypeTraits<T>::highest();
+    T max = DTypeTraits<T>::lowest();
+};
+
+// One profiled command of a reduction (EngineOptions::trace). queued..end
+// are the four CL_PROFILING_COMMAND_* counters in device nanoseconds;
+// host_ns is when the host enqueued it, relative to RunStats::started.
+struct CommandTiming {
+    const char* name = "";  // kernel function or command ("upload", "read result", ...)
+    int pass = -1;          // kernel launch index within the run; -1 for other commands
+    uint64_t elems = 0;     // elements a kernel pass reads
+    size_t global = 0;      // NDRange global and local size of a kernel pass
+    size_t local = 0;
+    bool copy_queue = false; // enqueued on the upload queue of reduce_stream()
+    uint64_t host_ns = 0;
+    uint64_t queued = 0, submit = 0, start = 0, end = 0;
+};
+
+// Host-side phase of a reduction (EngineOptions::trace), relative to
+// RunStats::started
+struct PhaseTiming {
+    const char* name = "";
+    uint64_t begin_ns = 0;
+    uint64_t ns = 0;
+};
+
+// Statistics of the most recent reduction
+struct RunStats {
+    uint64_t kernel_ns = 0; // sum of all passes
+    uint64_t upload_ns = 0; // host time to make the input visible to the device, plus the profiled upload commands
+    uint64_t wall_ns = 0;   // host wall clock: first enqueue to result available
+    int passes = 0;
+    uint64_t cpu_ns = 0;    // host threads' share of reduce_hybrid()
+    double gpu_fraction = 1.0; // share of the input the device reduced
+    uint64_t nan_count = 0; // NaNs in the input under NanPolicy::Count (max, min and minmax only)
+    std::chrono::steady_clock::time_point started; // host time of the first enqueue
+    std::vector<CommandTiming> commands; // with EngineOptions::trace, in enqueue order
+    std::vector<PhaseTiming> phases;     // with EngineOptions::trace
+};
+
+class FindMaxEngine {
+public:
+    // Throws std::runtime_error when device is "gpu" and no GPU is found, the
+    // variant or dtype is not supported by the device, or the program fails
+    // to build.
+    explicit FindMaxEngine(const EngineOptions& opt = EngineOptions());
+    ~FindMaxEngine();
+    FindMaxEngine(const FindMaxEngine&) = delete;
+    FindMaxEngine& operator=(const FindMaxEngine&) = delete;
+
+    // Reduce n elements from host memory according to host_mem(). T is one of
+    // float, int32_t, uint32_t, int64_t, half_t or double; the program for T
+    // and the operator is built on first use. An empty input returns the
+    // identity of the operator (lowest() for max, highest() for min, 0 for sum).
+    // In Svm mode, data must come from alloc_host(); other pointers fall
+    // back to a copy.
+    template <typename T>
+    typename DTypeTraits<T>::value_type max(const T* data, size_t n) {
+        T out = DTypeTraits<T>::lowest();
+        reduce_host(DTypeTraits<T>::dtype, Op::Max, data, n, &out);
+        return out;
+    }
+    template <typename T>
+    typename DTypeTraits<T>::value_type min(const T* data, size_t n) {
+        T out = DTypeTraits<T>::highest();
+        reduce_host(DTypeTraits<T>::dtype, Op::Min, data, n, &out);
+        return out;
+    }
+    template <typename T>
+    typename DTypeTraits<T>::value_type sum(const T* data, size_t n) {
+        T out = T();
+        reduce_host(DTypeTraits<T>::dtype, Op::Sum, data, n, &out);
+        return out;
+    }
+    // Both extremes from a single read of the data. Always runs the
+    // multi-pass local-memory path, whatever variant() is, so every dtype
+    // works under Variant::Atomic too.
+    template <typename T>
+    MinMax<typename DTypeTraits<T>::value_type> minmax(const T* data, size_t n) {
+        T out[2] = { DTypeTraits<T>::highest(), DTypeTraits<T>::lowest() };
+        reduce_host(DTypeTraits<T>::dtype, Op::MinMax, data, n, out);
+        MinMax<T> r;
+        r.min = out[0];
+        r.max = out[1];
+        return r;
+    }
+
+    // Reduce the first n elements of an existing buffer created on context().
+    // The buffer is only read.
+    template <typename T = float>
+    T max(cl_mem buf, size_t n) {
+        T out = DTypeTraits<T>::lowest();
+        reduce_buffer(DTypeTraits<T>::dtype, Op::Max, buf, n, &out);
+        return out;
+    }
+    template <typename T = float>
+    T min(cl_mem buf, size_t n) {
+        T out = DTypeTraits<T>::highest();
+        reduce_buffer(DTypeTraits<T>::dtype, Op::Min, buf, n, &out);
+        return out;
+    }
+    template <typename T = float>
+    T sum(cl_mem buf, size_t n) {
+        T out = T();
+        reduce_buffer(DTypeTraits<T>::dtype, Op::Sum, buf, n, &out);
+        return out;
+    }
+    template <typename T = float>
+    MinMax<T> minmax(cl_mem buf, size_t n) {
+        T out[2] = { DTypeTraits<T>::highest(), DTypeTraits<T>::lowest() };
+        reduce_buffer(DTypeTraits<T>::dtype, Op::MinMax, buf, n, out);
+        MinMax<T> r;
+        r.min = out[0];
+        r.max = out[1];
+        return r;
+    }
+
+    // Maximum together with its position; same input rules as max(). Always
+    // runs the multi-pass local-memory path, whatever variant() is (every
+    // dtype under Variant::Atomic too). Floating point input needs
+    // NanPolicy::Ignore.
+    template <typename T>
+    ArgMax<typename DTypeTraits<T>::value_type> argmax(const T* data, size_t n) {
+        ArgMax<T> r;
+        r.value = DTypeTraits<T>::lowest();
+        r.index = argmax_host(DTypeTraits<T>::dtype, data, n, &r.value);
+        return r;
+    }
+    template <typename T = float>
+    ArgMax<T> argmax(cl_mem buf, size_t n) {
+        ArgMax<T> r;
+        r.value = DTypeTraits<T>::lowest();
+        r.index = argmax_buffer(DTypeTraits<T>::dtype, buf, n, &r.value);
+        return r;
+    }
+
+    // Streaming reduction of inputs larger than device memory (or than one
+    // allocation): data is uploaded in EngineOptions::chunk_elems chunks into
+    // stream_buffers rotating device buffers on a second queue, so the upload
+    // of chunk i + 1 overlaps the reduction of chunk i. The first pass over
+    // each chunk writes its partials into one shared buffer (minmax reduces
+    // each chunk to its two values) and a final reduction combines them.
+    // Always copies: through pinned staging when host_mem() is Pinned (4M
+    // element tiles by default), with clEnqueueWriteBuffer from data otherwise.
+    template <typename T>
+    typename DTypeTraits<T>::value_type stream(Op op, const T* data, size_t n) {
+        T out = identity<T>(op);
+        reduce_stream(DTypeTraits<T>::dtype, single_value(op), data, n, &out);
+        return out;
+    }
+    template <typename T>
+    typename DTypeTraits<T>::value_type max_stream(const T* data, size_t n) { return stream(Op::Max, data, n); }
+    // Type-erased form; result points at one element (two for Op::MinMax)
+    void reduce_stream(DType t, Op op, const void* data, size_t n, void* result);
+
+    // Reduce read-only host pages in place, e.g. a MappedFile: the pages are
+    // wrapped with CL_MEM_USE_HOST_PTR whatever host_mem() is, and streamed
+    // through reduce_stream() when the input exceeds one allocation or the
+    // driver refuses the wrap. Returns true when the pages were wrapped.
+    bool reduce_mapped(DType t, Op op, const void* data, size_t n, void* result);
+
+    // Heterogeneous reduction: the GPU reduces the first gpu_fraction() of the
+    // input while cpu_threads() host threads reduce the rest, then the two
+    // partial results are combined on the host. The CPU share starts on a
+    // worker before the GPU share is enqueued, so the sides overlap even when
+    // enqueuing blocks (HostMem::Pinned). Unless
+    // EngineOptions::gpu_fraction fixes it, the split is recalibrated after
+    // every call from the measured throughput of both sides and stored in
+    // cache_dir per device, dtype and operator, so one warm-up call tunes the
+    // runs after it (including later processes). Not available with
+    // coarse-grained SVM, where the host may not read the data being reduced.
+    template <typename T>
+    typename DTypeTraits<T>::value_type hybrid(Op op, const T* data, size_t n) {
+        T out = identity<T>(op);
+        reduce_hybrid(DTypeTraits<T>::dtype, single_value(op), data, n, &out);
+        return out;
+    }
+    void reduce_hybrid(DType t, Op op, const void* data, size_t n, void* result);
+    // Split reduce_hybrid() would use next
+    double gpu_fraction(DType t, Op op) const;
+
+    // Batched reduction of many independent arrays packed into one: segment s
+    // is data[offsets[s], offsets[s + 1]), so offsets holds one entry more than
+    // there are segments. All segments are reduced by a single launch whose
+    // work-groups are split between segments in proportion to their length;
+    // each group folds into a per-segment global atomic, so T must be float,
+    // int32_t or uint32_t. Empty segments return the identity of the operator.
+    // NanPolicy::Count is not available.
+    template <typename T>
+    std::vector<typename DTypeTraits<T>::value_type> max_segments(const T* data, const std::vector<uint32_t>& offsets) {
+        std::vector<T> out(offsets.empty() ? 0 : offsets.size() - 1, DTypeTraits<T>::lowest());
+        reduce_segments_host(DTypeTraits<T>::dtype, Op::Max, data, offsets, out.data());
+        return out;
+    }
+    template <typename T>
+    std::vector<typename DTypeTraits<T>::value_type> min_segments(const T* data, const std::vector<uint32_t>& offsets) {
+        std::vector<T> out(offsets.empty() ? 0 : offsets.size() - 1, DTypeTraits<T>::highest());
+        reduce_segments_host(DTypeTraits<T>::dtype, Op::Min, data, offsets, out.data());
+        return out;
+    }
+    template <typename T = float>
+    std::vector<T> max_segments(cl_mem buf, const std::vector<uint32_t>& offsets) {
+        std::vector<T> out(offsets.empty() ? 0 : offsets.size() - 1, DTypeTraits<T>::lowest());
+        reduce_segments_buffer(DTypeTraits<T>::dtype, Op::Max, buf, offsets, out.data());
+        return out;
+    }
+
+    // Type-erased forms of the above; result points at one element of type t
+    // (two for Op::MinMax: min, then max) and is left untouched for n == 0
+    void reduce_host(DType t, Op op, const void* data, size_t n, void* result);
+    void reduce_buffer(DType t, Op op, cl_mem buf, size_t n, void* result);
+    uint64_t argmax_host(DType t, const void* data, size_t n, void* value);
+    uint64_t argmax_buffer(DType t, cl_mem buf, size_t n, void* value);
+    // op is Max or Min; result points at offsets.size() - 1 elements
+    void reduce_segments_host(DType t, Op op, const void* data, const std::vector<uint32_t>& offsets, void* result);
+    void reduce_segments_buffer(DType t, Op op, cl_mem buf, const std::vector<uint32_t>& offsets, void* result);
+
+    // Non-blocking forms: every pass, the upload and the result read-back are
+    // enqueued back to back (each waiting on the previous command's event) and
+    // the call returns without waiting. done runs on an OpenCL runtime thread
+    // once the result is in place, with the stats of that run and a null
+    // exception_ptr on success. data and result must stay valid until then;
+    // last_run() is not updated. Setup errors (bad dtype, build failure) still
+    // throw from the call itself. The CPU backend reduces inside the call and
+    // runs done before returning. With EngineOptions::queues > 1 successive
+    // calls go round-robin to the queues, so up to queues() reductions run
+    // concurrently; the synchronous calls always use the first queue.
+    using AsyncCallback = std::function<void(const RunStats&, std::exception_ptr)>;
+    void reduce_host_async(DType t, Op op, const void* data, size_t n, void* result, AsyncCallback done);
+    void reduce_buffer_async(DType t, Op op, cl_mem buf, size_t n, void* result, AsyncCallback done);
+
+    // Future-returning forms for the single-value operators (max, min, sum)
+    template <typename T>
+    std::future<typename DTypeTraits<T>::value_type> reduce_async(Op op, const T* data, size_t n) {
+        auto state = std::make_shared<AsyncValue<T>>(identity<T>(op));
+        std::future<T> f = state->promise.get_future();
+        reduce_host_async(DTypeTraits<T>::dtype, single_value(op), data, n, &state->value, AsyncValue<T>::resolver(state));
+        return f;
+    }
+    template <typename T = float>
+    std::future<T> reduce_async(Op op, cl_mem buf, size_t n) {
+        auto state = std::make_shared<AsyncValue<T>>(identity<T>(op));
+        std::future<T> f = state->promise.get_future();
+        reduce_buffer_async(DTypeTraits<T>::dtype, single_value(op), buf, n, &state->value, AsyncValue<T>::resolver(state));
+        return f;
+    }
+    template <typename T>
+    std::future<typename DTypeTraits<T>::value_type> max_async(const T* data, size_t n) { return reduce_async(Op::Max, data, n); }
+    template <typename T = float>
+    std::future<T> max_async(cl_mem buf, size_t n) { return reduce_async<T>(Op::Max, buf, n); }
+
+    // Whether the device can reduce elements of type t with op and variant()
+    bool supports(DType t, Op op = Op::Max) const;
+
+    ReductionPlan plan(size_t n) const;
+
+    // Host allocation suited to host_mem(): SVM memory in Svm mode (mapped
+    // for host access between calls when only coarse-grained SVM exists),
+    // page-aligned memory with a 64-byte-multiple size otherwise.
+    void* alloc_host(size_t bytes);
+    void free_host(void* p);
+    HostMem host_mem() const { return host_mem_; }
+
+    const RunStats& last_run() const { return stats_; }
+    // Bytes currently held by the engine's own device buffers, and the
+    // largest value seen. Buffers passed in by the caller are not counted.
+    size_t device_bytes() const {
+        size_t bytes = chunk_vals_bytes_;
+        for (size_t b = 0; b < MAX_STREAM_BUFFERS; ++b) bytes += stream_bytes_[b] + staging_bytes_[b];
+        for (const Lane& l : lanes_) bytes += l.bytes();
+        return bytes;
+    }
+    size_t peak_device_bytes() const { return peak_device_bytes_; }
+    // Scratch buffers come from a size-class pool: growing one returns the
+    // old buffer for reuse, and sizes that vary by less than a class keep
+    // theirs. reserve() allocates, on every queue, the scratch of a t
+    // reduction of n host elements (the input copy included in Copy mode),
+    // so the first calls up to that size allocate nothing. trim_pool()
+    // frees the pooled buffers no scratch slot holds. No-ops on the CPU backend.
+    void reserve(DType t, size_t n);
+    void trim_pool();
+    BufferPool::Stats pool_stats() const { return pool_ ? pool_->stats() : BufferPool::Stats(); }
+    // Build of the EngineOptions::dtype max program (nothing is built on the CPU
+    // backend); the plain program when the variant cannot reduce that dtype
+    const ProgramBuild& build_info() const {
+        if (backend_ == Backend::Cpu) return cpu_build_;
+        const ProgramKey key(default_dtype_, Op::Max);
+        return programs_.count(key) ? programs_.at(key).build : plain_programs_.at(key).build;
+    }
+    Backend backend() const { return backend_; }
+    unsigned cpu_threads() const { return opt_.cpu_threads; }
+    DType dtype() const { return default_dtype_; }
+    Variant variant() const { return variant_; }
+    int wg() const { return opt_.wg; }
+    int vec() const { return opt_.vec; }
+    int groups_max() const { return opt_.groups_max; }
+    int items_per_thread() const { return opt_.items_per_thread; }
+    bool specialized() const { return opt_.specialize; }
+    Layout layout() const { return layout_; }
+    bool prefetch() const { return opt_.prefetch; }
+    NanPolicy nan_policy() const { return nan_policy_; }
+    const std::string& cache_dir() const { return opt_.cache_dir; }
+    int queues() const { return (int)lanes_.size(); }
+
+    // Launch shape used by the next reductions. Changing vec drops the built
+    // programs; they are rebuilt on next use (normally from the binary cache).
+    // Throws for values the kernels cannot run with.
+    LaunchConfig launch_config() const;
+    void set_launch_config(const LaunchConfig& c);
+    // Kernel function name of the program for t and op (built on first use),
+    // for modules that launch kernels.cl functions of their own (RangeMaxIndex).
+    // Owned by the engine and shared by every caller: set all arguments
+    // before each launch. Throws on the CPU backend.
+    cl_kernel kernel(DType t, Op op, const char* name);
+    // CL_KERNEL_WORK_GROUP_SIZE and CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE
+    // of the kernel that runs op over t (the program is built if needed)
+    void kernel_wg_limits(DType t, Op op, size_t* max_wg, size_t* multiple);
+    const std::string& device_name() const { return device_name_; }
+    const std::string& device_vendor() const { return device_vendor_; }
+
+    cl_context context() const { return ctx_; }
+    // The queue of the synchronous calls; asynchronous ones may run on others
+    cl_command_queue queue() const { return lanes_[0].q; }
+    cl_device_id device() const { return device_; }
+
+private:
+    // Result slot and promise shared with the completion callback of reduce_async()
+    template <typename T>
+    struct AsyncValue {
+        explicit AsyncValue(T init) : value(init) {}
+        T value;
+        std::promise<T> promise;
+        static AsyncCallback resolver(const std::shared_ptr<AsyncValue>& state) {
+            return [state](const RunStats&, std::exception_ptr err) {
+                if (err) state->promise.set_exception(err);
+                else state->promise.set_value(state->value);
+            };
+        }
+    };
+    template <typename T>
+    static T identity(Op op) {
+        return op == Op::Min ? DTypeTraits<T>::highest() : op == Op::Sum ? T() : DTypeTraits<T>::lowest();
+    }
+    static Op single_value(Op op); // throws for Op::MinMax
+
+    // Commands of one reduction call, chained through event wait lists.
+    // tail is the last enqueued command (owned by one of the vectors); the
+    // host only waits on it. finalize decodes read-back staging (slot) into
+    // the caller's result once everything has completed.
+    struct Pending {
+        std::chrono::steady_clock::time_point t0;
+        cl_event tail = nullptr;
+        std::vector<cl_event> kernels;
+        std::vector<cl_event> uploads;
+        std::vector<cl_event> others;
+        std::vector<cl_event> traced; // events of stats.commands, same order (not owned)
+        RunStats stats;
+        cl_uint slot = 0;
+        std::vector<cl_uint> meta;  // reduce_segments() layout, uploaded without blocking
+        std::vector<cl_uint> slots; // per-segment atomic slots read back
+        cl_uint nan_words[2] = {};  // NaN counter read back (low, high)
+        std::function<void(const Pending&)> finalize;
+        AsyncCallback done;
+    };
+
+    // One command queue and the scratch buffers of the reductions enqueued on
+    // it. A lane runs its commands in order, so consecutive reductions share
+    // the scratch safely, while reductions on different lanes can overlap on
+    // the device. Buffers are grown on demand, never shrunk. The input buffer
+    // is read-only on the device; passes ping-pong between the two partials
+    // buffers.
+    struct Lane {
+        cl_command_queue q = nullptr;
+        cl_mem input = nullptr;
+        cl_mem partials = nullptr;
+        cl_mem alt = nullptr;
+        size_t input_bytes = 0;
+        size_t partials_bytes = 0;
+        size_t alt_bytes = 0;
+        // Index partials (cl_ulong) for argmax, parallel to partials/alt
+        cl_mem partials_idx = nullptr;
+        cl_mem alt_idx = nullptr;
+        size_t partials_idx_bytes = 0;
+        size_t alt_idx_bytes = 0;
+        // Segment layout and per-segment atomic results of reduce_segments()
+        cl_mem segment_meta = nullptr;
+        cl_mem segment_out = nullptr;
+        size_t segment_meta_bytes = 0;
+        size_t segment_out_bytes = 0;
+        // 64-bit NaN counter of NanPolicy::Count as two cl_uint words
+        cl_mem nan_count = nullptr;
+        size_t nan_count_bytes = 0;
+
+        size_t bytes() const {
+            return input_bytes + partials_bytes + alt_bytes + partials_idx_bytes + alt_idx_bytes + segment_meta_bytes +
+                   segment_out_bytes + nan_count_bytes;
+        }
+    };
+    // Makes another lane current for the enqueues of one asynchronous call
+    struct LaneScope {
+        LaneScope(FindMaxEngine& e, Lane* l) : engine(e), prev(e.lane_) { e.lane_ = l; }
+        ~LaneScope() { engine.lane_ = prev; }
+        FindMaxEngine& engine;
+        Lane* prev;
+    };
+    // Next lane of the rotation; lane 0 when maps_svm and host_mem() maps
+    // coarse-grained SVM around each call, which must stay ordered
+    Lane* async_lane(bool maps_svm);
+
+    // Pass input: a buffer, or an SVM pointer for the first pass in Svm mode
+    struct Input {
+        cl_mem mem = nullptr;
+        const void* svm = nullptr;
+    };
+
+    // Program and kernels built for one element type and reduce_stage
+    // operator; argmax and minmax come from the Op::Max program
+    struct Program {
+        ProgramBuild build;
+        cl_kernel reduce = nullptr;
+        cl_kernel argmax = nullptr;
+        cl_kernel minmax = nullptr;
+        cl_kernel segments = nullptr; // only in max/min programs of 32-bit types
+        bool counts_nans = false;     // reduce and minmax kernels take the NaN counter last
+        std::map<std::string, cl_kernel> named; // kernel() lookups
+    };
+    using ProgramKey = std::pair<DType, Op>;
+
+    // plain (implied by Op::MinMax) is for the kernels that never use the
+    // variant's atomics: minmax, argmax and the kernel() lookups. Under
+    // Variant::Atomic they come from a local-variant program, so they keep
+    // every dtype.
+    Program& program(DType t, Op op = Op::Max, bool plain = false);
+    // The dtype and operator rules every program shares, whatever the variant
+    bool supports_dtype(DType t, Op op) const;
+
+    // Make host data visible to the device per host_mem() and call fn with it
+    void with_host_input(const void* data, size_t bytes, const std::function<void(const Input&)>& fn);
+
+    void reduce(DType t, Op op, Input in, size_t n, void* result);
+    // Enqueue the passes of a full reduction; returns the buffer holding the
+    // result at offset 0 (min then max for minmax)
+    cl_mem enqueue_passes(Program& prog, DType t, Input in, size_t n);
+    cl_mem enqueue_minmax_passes(Program& prog, DType t, Input in, size_t n, bool has_pairs);
+    void enqueue_atomic_init(DType t, Op op);
+    void enqueue_atomic_result(DType t, void* result);
+    // NanPolicy::Count: whether op over t counts, zeroing the counter for this
+    // call, and reading it back into the chain once the passes are enqueued
+    bool counts_nans(DType t, Op op) const;
+    void enqueue_nan_count_init();
+    void enqueue_nan_count_result();
+    void enqueue_copy(cl_mem src, size_t src_offset, cl_mem dst, size_t dst_offset, size_t bytes);
+    size_t max_alloc_bytes() const; // CL_DEVICE_MAX_MEM_ALLOC_SIZE, 0 if unknown
+    size_t stream_chunk_elems(DType t) const;
+    void reduce_stream_chain(DType t, Op op, const char* data, size_t n, void* result);
+    void reduce_argmax(DType t, Input in, size_t n, void* value, uint64_t* index);
+    void reduce_segments(DType t, Op op, Input in, const std::vector<uint32_t>& offsets, void* result);
+    ReductionPlan multipass_plan(size_t n) const;
+    // Work-groups for a pass over count elements read vec at a time (capped at groups_max)
+    size_t groups_for(size_t count, int vec) const;
+    // Writes the group results at out_base elements into out_buf
+    size_t launch_pass(Program& prog, DType t, size_t count, Input in, cl_mem out_buf, size_t out_base = 0);
+    size_t launch_minmax_pass(Program& prog, DType t, size_t count, Input in, bool has_pairs, cl_mem out);
+    // NaN counter argument of reduce and minmax kernels that take one
+    void set_nan_count_arg(const Program& prog, cl_kernel k, cl_uint index);
+    size_t launch_argmax_pass(Program& prog, DType t, size_t count, Input in_val, cl_mem in_idx, cl_mem out_val, cl_mem out_idx);
+    void run_kernel(cl_kernel k, const char* name, size_t groups, size_t count);
+    // Event chain of the call in progress (chain_)
+    void begin_chain();
+    cl_uint wait_count() const { return chain_->tail ? 1u : 0u; }
+    const cl_event* wait_list() const { return chain_->tail ? &chain_->tail : nullptr; }
+    // name labels e in RunStats::commands when tracing
+    void push_event(std::vector<cl_event>& list, cl_event e, const char* name);
+    // With EngineOptions::trace: append a host phase that began at begin and ends now
+    void phase(const char* name, std::chrono::steady_clock::time_point begin);
+    static void push_phase(Pending& p, const char* name, std::chrono::steady_clock::time_point begin);
+    void enqueue_read(cl_mem buf, size_t bytes, void* dst, const char* what);
+    void finish_chain();            // wait, then fill stats_ and run finalize
+    void submit_chain(AsyncCallback done); // hand the chain to a completion callback
+    void abandon_chain();           // after an error: drain the queue and drop the chain
+    static void collect(Pending& p); // profiling into p.stats; releases the events
+    static void CL_CALLBACK on_chain_complete(cl_event e, cl_int status, void* user);
+    void reduce_host_chain(DType t, Op op, const void* data, size_t n, void* result);
+    // CPU backend: set up without OpenCL, time one host reduction
+    void init_cpu();
+    RunStats run_on_cpu(const std::function<void()>& fn) const;
+    RunStats reduce_on_cpu(DType t, Op op, const void* data, size_t n, void* result) const;
+    void require_gpu(const char* what) const;
+    std::string hybrid_file(DType t, Op op) const;
+    void update_gpu_fraction(DType t, Op op, size_t n_gpu, uint64_t gpu_ns, size_t n_cpu, uint64_t cpu_ns);
+    static cl_int set_input_arg(cl_kernel k, cl_uint index, const Input& in);
+    void ensure_buffer(cl_mem* buf, size_t* capacity, size_t bytes, cl_mem_flags flags);
+    void release();
+    void release_programs();
+
+    EngineOptions opt_;
+    Backend backend_ = Backend::Gpu;
+    ProgramBuild cpu_build_;
+    Variant variant_ = Variant::Local;
+    std::string device_name_;
+    std::string device_vendor_;
+    cl_platform_id platform_ = nullptr;
+    cl_device_id device_ = nullptr;
+    cl_context ctx_ = nullptr;
+    std::vector<Lane> lanes_; // EngineOptions::queues; sized once, so lane_ stays valid
+    Lane* lane_ = nullptr;    // lane of the call being enqueued: lanes_[0] outside an asynchronous call
+    size_t next_lane_ = 0;
+    std::unique_ptr<BufferPool> pool_; // every buffer ensure_buffer() hands out
+    std::string kernel_src_;
+    std::string variant_opts_; // variant build options shared by all dtypes; -DVEC= is added per build
+    DType default_dtype_ = DType::Float;
+    NanPolicy nan_policy_ = NanPolicy::Ignore;
+    std::map<ProgramKey, Program> programs_;
+    std::map<ProgramKey, Program> plain_programs_; // program(t, op, true) under Variant::Atomic
+    HostMem host_mem_ = HostMem::Copy;
+    Layout layout_ = Layout::Strided;
+    bool svm_fine_grain_ = false;
+    bool unified_memory_ = false; // CL_DEVICE_HOST_UNIFIED_MEMORY: kernels read pinned staging in place
+    std::unordered_map<const void*, size_t> svm_allocs_; // live alloc_host() SVM blocks
+
+    // reduce_stream(): upload queue, rotating chunk buffers, per-chunk results
+    cl_command_queue copy_q_ = nullptr;
+    cl_mem stream_bufs_[MAX_STREAM_BUFFERS] = {};
+    size_t stream_bytes_[MAX_STREAM_BUFFERS] = {};
+    cl_mem chunk_vals_ = nullptr;
+    size_t chunk_vals_bytes_ = 0;
+    // HostMem::Pinned staging tiles, and the last command of the previous
+    // streamed call (the next one reuses its buffers once it is done)
+    cl_mem staging_bufs_[MAX_STREAM_BUFFERS] = {};
+    size_t staging_bytes_[MAX_STREAM_BUFFERS] = {};
+    cl_event stream_done_ = nullptr;
+    size_t peak_device_bytes_ = 0;
+
+    // reduce_hybrid() split per dtype and operator; calibrated once measured
+    struct HybridSplit {
+        double fraction = 0.5;
+        bool calibrated = false;
+    };
+    mutable std::map<ProgramKey, HybridSplit> gpu_fraction_; // loaded from cache_dir on first use
+
+    RunStats stats_;
+    std::unique_ptr<Pending> chain_;
+};
+
+} // namespace findmax
@@ -1,63 +1,775 @@
-// Max reduction kernel with two variants:
-// - Fast path (OpenCL 2.0+): uses work_group_reduce_max
+// Reduction kernel (reduce_stage) with four variants:
+// - Fast path (OpenCL 2.0+): uses work_group_reduce_<op>
 // - Portable path (OpenCL 1.2): tree reduction in local memory
-// Host compiles with -DUSE_WG_REDUCE=1 when OpenCL C >= 2.0
+// - Single-pass path (OpenCL 1.2): local tree + global atomic_max/atomic_min
+// - Sub-group path (cl_khr_subgroups / cl_intel_subgroups):
+//   sub_group_reduce_<op>, then one value per sub-group via local memory
+// Host compiles with -DUSE_WG_REDUCE=1 when OpenCL C >= 2.0,
+// with -DUSE_ATOMIC_MAX=1 for the single-pass variant, or with
+// -DUSE_SUBGROUP_REDUCE=1 (plus -DUSE_KHR_SUBGROUPS=1 for the Khronos
+// extension) for the sub-group variant.
+// -DVEC=2|4|8|16 selects vloadN loads in the strided loop (default 1).
+// Element counts and argmax indices are ulong, so inputs past 4G elements work.
+// Group g of a multi-pass reduce_stage writes out[out_base + g], so the first
+// passes over several tiles can fill one partials buffer (the single-pass
+// variant ignores out_base).
+// reduce_argmax_stage (index-returning mode) and reduce_minmax_stage (fused
+// min + max) are built with every variant, and reduce_segments (one result
+// per segment of a packed array) with every max/min program of a 32-bit T.
+//
+// Operator of reduce_stage: max by default, -DOP_MIN=1 for min, -DOP_SUM=1
+// for sum. Floating-point sums use Kahan compensation in the grid-stride
+// loop; the trees after it add pairwise. Integer sums wrap.
+//
+// Element type (one program per type), all set by the host:
+// -DT=<type>        element and partial type (float, int, uint, long, half, double)
+// -DT_LOWEST=<v>    identity of max for T
+// -DT_HIGHEST=<v>   identity of min for T
+// -DT_MAX=<fn>      max operator for T (fmax for floating point, max for integers)
+// -DT_MIN=<fn>      min operator for T (fmin / min)
+// -DT_IS_FLOAT=0|1  floating-point T (selects the ordered-int atomic mapping)
+// -DT_HAS_ATOMIC=0|1 T is float, int or uint, so global 32-bit atomics apply
+// -DENABLE_FP16=1 / -DENABLE_FP64=1 turn on cl_khr_fp16 / cl_khr_fp64 for half / double.
+//
+// NaN handling of floating-point max and min (sums always propagate):
+// -DNAN_POLICY=0    ignore: NaN never wins, like fmax/fmin (default)
+// -DNAN_POLICY=1    propagate: any NaN in the input makes the result NaN
+// -DNAN_POLICY=2    count: as ignore, and every kernel that reads elements
+//                   adds its NaNs to a 64-bit counter (extra last argument,
+//                   two uints: low word, then carries into the high word)
+// The operators stay branch-free: isnan() feeds selects, not jumps.
+//
+// Specialized programs (EngineOptions::specialize) bake the launch shape in:
+// -DWG_SIZE=<wg>    reduce_stage, reduce_argmax_stage, reduce_minmax_stage and
+//                   reduce_segments require groups of exactly wg work-items
+//                   (reqd_work_group_size), so their local trees unroll
+// -DITEMS_PER_THREAD=<items> the grid-stride loop of reduce_stage issues
+//                   rounds of that many independent loads, unrolled
+//
+// Layout of the reduce_stage loads (EngineOptions::layout):
+// - strided (default): work-item gid reads gid, gid + global size, ..., so
+//   all groups sweep the whole buffer together
+// - -DLAYOUT_BLOCKED=1: group g owns one contiguous tile and its work-items
+//   walk it GROUP_SIZE elements (or vectors) apart, so each group streams
+//   its own DRAM pages; -DPREFETCH=1 adds a prefetch() of the next round
 
-#ifdef USE_WG_REDUCE
+#ifdef ENABLE_FP16
+#pragma OPENCL EXTENSION cl_khr_fp16 : enable
+#endif
+#ifdef ENABLE_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+#ifndef T
+#define T float
+#define T_LOWEST (-INFINITY)
+#define T_HIGHEST INFINITY
+#define T_MAX fmax
+#define T_MIN fmin
+#define T_IS_FLOAT 1
+#define T_HAS_ATOMIC 1
+#endif
+
+#ifndef NAN_POLICY
+#define NAN_POLICY 0
+#endif
+
+#if T_IS_FLOAT
+// fmax/fmin leave the sign of a zero result open; Z_MAX and Z_MIN order
+// -0.0 below +0.0, like the atomic slots and the host folds. On equal
+// operands the sign bit picks, component-wise for vectors.
+#define Z_MAX(a, b) ((a) == (b) ? (signbit(a) ? (b) : (a)) : T_MAX(a, b))
+#define Z_MIN(a, b) ((a) == (b) ? (signbit(a) ? (a) : (b)) : T_MIN(a, b))
+// The same order for compares: a above b, and a equal to b with its sign
+#define ORDERED_GT(a, b) ((a) > (b) || ((a) == (b) && signbit(b) && !signbit(a)))
+#define ORDERED_EQ(a, b) ((a) == (b) && signbit(a) == signbit(b))
+#else
+#define Z_MAX T_MAX
+#define Z_MIN T_MIN
+#define ORDERED_GT(a, b) ((a) > (b))
+#define ORDERED_EQ(a, b) ((a) == (b))
+#endif
+
+#if T_IS_FLOAT && NAN_POLICY == 1
+// NaN-propagating max/min for scalars and (component-wise) vectors
+#define NAN_OR(a, b, x) (isnan(a) ? (a) : isnan(b) ? (b) : (x))
+#define P_MAX(a, b) NAN_OR(a, b, Z_MAX(a, b))
+#define P_MIN(a, b) NAN_OR(a, b, Z_MIN(a, b))
+#define NAN_PROPAGATE 1
+#else
+#define P_MAX Z_MAX
+#define P_MIN Z_MIN
+#endif
+
+#if T_IS_FLOAT && NAN_POLICY == 2 && !defined(OP_SUM)
+#define NAN_COUNTING 1
+#define NAN_COUNT_PARAM , __global uint* nan_count
+// Fold one work-item's count into the 64-bit counter; no atomics without NaNs
+#define NAN_COUNT_ADD(c) do { \
+        if (nan_count && (c)) { \
+            const uint old_ = atomic_add(&nan_count[0], (c)); \
+            if (old_ + (c) < old_) atomic_inc(&nan_count[1]); \
+        } \
+    } while (0)
+#else
+#define NAN_COUNT_PARAM
+#define NAN_COUNT_ADD(c) do { (void)(c); } while (0)
+#endif
+
+#if defined(OP_MIN)
+#define OP P_MIN
+#define OP_IDENTITY T_HIGHEST
+#define SUB_GROUP_REDUCE sub_group_reduce_min
+#define WORK_GROUP_REDUCE work_group_reduce_min
+#define ATOMIC_OP atomic_min
+#elif defined(OP_SUM)
+#define OP(a, b) ((a) + (b))
+#define OP_IDENTITY 0
+#define SUB_GROUP_REDUCE sub_group_reduce_add
+#define WORK_GROUP_REDUCE work_group_reduce_add
+#else
+#define OP P_MAX
+#define OP_IDENTITY T_LOWEST
+#define SUB_GROUP_REDUCE sub_group_reduce_max
+#define WORK_GROUP_REDUCE work_group_reduce_max
+#define ATOMIC_OP atomic_max
+#endif
+
+#if T_IS_FLOAT && !defined(OP_SUM)
+// The built-in group reductions need not order -0.0 below +0.0 either: a
+// zero result takes WIN_ZERO when any work-item holds that zero
+#define FIX_ZERO_SIGN 1
+#if defined(OP_MIN)
+#define IS_WIN_ZERO(x) ((x) == 0 && signbit(x))
+#define WIN_ZERO (-(T)0)
+#else
+#define IS_WIN_ZERO(x) ((x) == 0 && !signbit(x))
+#define WIN_ZERO ((T)0)
+#endif
+#define ZERO_SIGNED(res, any) ((any) && (res) == 0 ? WIN_ZERO : (res))
+#endif
+
+#ifndef VEC
+#define VEC 1
+#endif
+
+#if defined(WG_SIZE)
+#define STAGE_ATTR __attribute__((reqd_work_group_size(WG_SIZE, 1, 1)))
+#define GROUP_SIZE ((uint)WG_SIZE)
+#define UNROLL _Pragma("unroll")
+#else
+#define STAGE_ATTR
+#define GROUP_SIZE ((uint)get_local_size(0))
+#define UNROLL
+#endif
+#ifndef ITEMS_PER_THREAD
+#define ITEMS_PER_THREAD 1
+#endif
+
+// for (size_t i = start; i < end; i += step) { body }, in rounds of
+// ITEMS_PER_THREAD iterations whose loads do not depend on each other
+#define STRIDED_FOR(i, start, end, step, ...) \
+    do { \
+        size_t r_ = (start); \
+        for (; r_ + (size_t)(ITEMS_PER_THREAD - 1) * (step) < (end); r_ += (size_t)ITEMS_PER_THREAD * (step)) { \
+            UNROLL for (uint u_ = 0; u_ < ITEMS_PER_THREAD; ++u_) { \
+                const size_t i = r_ + u_ * (step); \
+                __VA_ARGS__; \
+            } \
+        } \
+        for (; r_ < (end); r_ += (step)) { \
+            const size_t i = r_; \
+            __VA_ARGS__; \
+        } \
+    } while (0)
+
+#define CAT_(a, b) a##b
+#define CAT(a, b) CAT_(a, b)
+
+#if VEC > 1
+// Horizontal reduction of one vector register
+inline T hred2(CAT(T, 2) v) { return OP(v.s0, v.s1); }
+inline T hred4(CAT(T, 4) v) { return hred2(OP(v.lo, v.hi)); }
+inline T hred8(CAT(T, 8) v) { return hred4(OP(v.lo, v.hi)); }
+inline T hred16(CAT(T, 16) v) { return hred8(OP(v.lo, v.hi)); }
+
+#define TV CAT(T, VEC)
+#define VLOAD CAT(vload, VEC)
+#define HRED CAT(hred, VEC)
+
+#if defined(NAN_COUNTING)
+inline uint hsum2(uint2 v) { return v.s0 + v.s1; }
+inline uint hsum4(uint4 v) { return hsum2(v.lo + v.hi); }
+inline uint hsum8(uint8 v) { return hsum4(v.lo + v.hi); }
+inline uint hsum16(uint16 v) { return hsum8(v.lo + v.hi); }
+#define UV CAT(uint, VEC)
+#define HSUM CAT(hsum, VEC)
+// isnan() of a vector is -1 per NaN component; keep the low bit
+#define NAN_BITS(v) (CAT(convert_uint, VEC)(isnan(v)) & (UV)1u)
+#endif
+#endif
+
+#if defined(NAN_COUNTING)
+#define TALLY_NAN(count, v) ((count) += (uint)isnan(v))
+#define TALLY_NANS(count, v) ((count) += NAN_BITS(v))
+#else
+#define TALLY_NAN(count, v) ((void)0)
+#define TALLY_NANS(count, v) ((void)0)
+#endif
+
+#if defined(OP_SUM) && T_IS_FLOAT
+// s += x, keeping the lost low-order bits in c (true sum is s - c)
+#define KAHAN_ADD(TY, s, c, x) do { const TY y_ = (x) - (c); const TY t_ = (s) + y_; (c) = (t_ - (s)) - y_; (s) = t_; } while (0)
+#endif
+
+// Items [*start, *end) of count, *step apart, that this work-item reduces
+inline void work_range(size_t count, size_t* start, size_t* end, size_t* step)
+{
+#if defined(LAYOUT_BLOCKED)
+    // Tiles are whole multiples of the group size, so every round is coalesced
+    const size_t lsize = GROUP_SIZE;
+    const size_t groups = get_num_groups(0);
+    const size_t tile = ((count + groups - 1) / groups + lsize - 1) / lsize * lsize;
+    const size_t begin = min(get_group_id(0) * tile, count);
+    *start = begin + get_local_id(0);
+    *end = min(begin + tile, count);
+    *step = lsize;
+#else
+    *start = get_global_id(0);
+    *end = count;
+    *step = get_global_size(0);
+#endif
+}
+
+#if defined(LAYOUT_BLOCKED) && defined(PREFETCH)
+// Hint the VEC elements this work-item reads one round later
+#define PREFETCH_NEXT(i) do { \
+        const size_t p_ = (i) + (size_t)ITEMS_PER_THREAD * step; \
+        if (p_ < end) prefetch(in + p_ * VEC, VEC); \
+    } while (0)
+#else
+#define PREFETCH_NEXT(i) ((void)0)
+#endif
+
+// Reduction over in[0, n) for one work-item, laid out per work_range().
+// With VEC > 1 the body reads whole vectors and the last n % VEC elements
+// go through a scalar grid-stride tail (gid, gsize). *nans receives the
+// NaNs seen when NAN_COUNTING, else 0.
+inline T thread_reduce(__global const T* in, size_t n, size_t gid, size_t gsize, uint* nans)
+{
+    *nans = 0u;
+    size_t start, end, step;
+    work_range(VEC > 1 ? n / VEC : n, &start, &end, &step);
+#if defined(OP_SUM) && T_IS_FLOAT
+    T acc = (T)0;
+    T comp = (T)0;
+#if VEC > 1
+    const size_t nv = n / VEC;
+    TV vacc = (TV)((T)0);
+    TV vcomp = (TV)((T)0);
+    STRIDED_FOR(i, start, end, step, PREFETCH_NEXT(i); KAHAN_ADD(TV, vacc, vcomp, VLOAD(i, in)));
+    acc = HRED(vacc);
+    comp = HRED(vcomp);
+    for (size_t i = nv * VEC + gid; i < n; i += gsize) {
+        KAHAN_ADD(T, acc, comp, in[i]);
+    }
+#else
+    STRIDED_FOR(i, start, end, step, PREFETCH_NEXT(i); KAHAN_ADD(T, acc, comp, in[i]));
+#endif
+    return acc - comp;
+#else
+    T acc = (T)OP_IDENTITY;
+#if VEC > 1
+    const size_t nv = n / VEC;
+    TV vacc = (TV)((T)OP_IDENTITY);
+#if defined(NAN_COUNTING)
+    UV vnans = (UV)0u;
+#endif
+    STRIDED_FOR(i, start, end, step, PREFETCH_NEXT(i); const TV v = VLOAD(i, in); vacc = OP(vacc, v); TALLY_NANS(vnans, v));
+    acc = HRED(vacc);
+#if defined(NAN_COUNTING)
+    *nans = HSUM(vnans);
+#endif
+    for (size_t i = nv * VEC + gid; i < n; i += gsize) {
+        const T v = in[i];
+        acc = OP(acc, v);
+        TALLY_NAN(*nans, v);
+    }
+#else
+    STRIDED_FOR(i, start, end, step, PREFETCH_NEXT(i); const T v = in[i]; acc = OP(acc, v); TALLY_NAN(*nans, v));
+#endif
+    return acc;
+#endif
+}
+
+// Tree reduction in local memory; returns the group result in scratch[0]
+inline void local_tree_reduce(__local T* scratch, size_t lid)
+{
+    barrier(CLK_LOCAL_MEM_FENCE);
+    for (uint stride = get_local_size(0) >> 1; stride > 0; stride >>= 1) {
+        if (lid < stride) {
+            scratch[lid] = OP(scratch[lid], scratch[lid + stride]);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+// The same tree over the GROUP_SIZE entries of a stage kernel's group;
+// fully unrolled in specialized programs
+inline void group_tree_reduce(__local T* scratch, size_t lid)
+{
+    barrier(CLK_LOCAL_MEM_FENCE);
+    UNROLL
+    for (uint stride = GROUP_SIZE >> 1; stride > 0; stride >>= 1) {
+        if (lid < stride) {
+            scratch[lid] = OP(scratch[lid], scratch[lid + stride]);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+#if T_HAS_ATOMIC && !defined(OP_SUM)
+#define HAS_ATOMIC_SLOT 1
+#if T_IS_FLOAT
+// Map a float to an int whose signed ordering matches the float ordering,
+// so the integer atomic_max/atomic_min picks the largest/smallest float.
+// The mapping is its own inverse; the host applies it again to decode the result.
+inline int float_to_ordered_int(float f)
+{
+    const int i = as_int(f);
+    return i >= 0 ? i : (i ^ 0x7FFFFFFF);
+}
+typedef int atomic_slot_t;
+#if defined(NAN_PROPAGATE)
+// A positive quiet NaN orders above +inf and a negative one below -inf, so
+// the atomic keeps any NaN once it arrives
+#if defined(OP_MIN)
+#define CANONICAL_NAN as_float(0xFFC00000u)
+#else
+#define CANONICAL_NAN as_float(0x7FC00000u)
+#endif
+#define TO_ATOMIC_SLOT(x) float_to_ordered_int(isnan(x) ? CANONICAL_NAN : (x))
+#else
+#define TO_ATOMIC_SLOT(x) float_to_ordered_int(x)
+#endif
+#else
+// 32-bit integers take atomic_max/atomic_min directly
+typedef T atomic_slot_t;
+#define TO_ATOMIC_SLOT(x) (x)
+#endif
+#endif
+
+#if defined(USE_ATOMIC_MAX)
+#if !defined(HAS_ATOMIC_SLOT)
+#error "the single-pass variant supports max and min of float, int and uint only"
+#endif
+
+// Single-pass kernel: every work-group folds its local result into *out,
+// which the host initialises to TO_ATOMIC_SLOT(OP_IDENTITY).
+__kernel STAGE_ATTR void reduce_stage(
+    __global const T* in,
+    __global atomic_slot_t* out,
+    const ulong n,
+    const ulong out_base,
+    __local T* scratch
+    NAN_COUNT_PARAM)
+{
+    const size_t lid = get_local_id(0);
+
+    uint nans;
+    scratch[lid] = thread_reduce(in, (size_t)n, get_global_id(0), get_global_size(0), &nans);
+    NAN_COUNT_ADD(nans);
+    group_tree_reduce(scratch, lid);
+
+    if (lid == 0) {
+        ATOMIC_OP(out, TO_ATOMIC_SLOT(scratch[0]));
+    }
+}
+
+#elif defined(USE_SUBGROUP_REDUCE)
+#if defined(USE_KHR_SUBGROUPS)
+#pragma OPENCL EXTENSION cl_khr_subgroups : enable
+#else
+#pragma OPENCL EXTENSION cl_intel_subgroups : enable
+#endif
+// SIMD-level reduction: each sub-group reduces in registers, then the first
+// sub-group folds the per-sub-group results, so only one barrier is needed.
+__kernel STAGE_ATTR void reduce_stage(
+    __global const T* in,
+    __global T* out,
+    const ulong n,
+    const ulong out_base,
+    __local T* scratch
+    NAN_COUNT_PARAM)
+{
+    const uint sg_id = get_sub_group_id();
+    const uint sg_lid = get_sub_group_local_id();
+
+    uint nans;
+    T acc = thread_reduce(in, (size_t)n, get_global_id(0), get_global_size(0), &nans);
+    NAN_COUNT_ADD(nans);
+    T sg_res = SUB_GROUP_REDUCE(acc);
+#if defined(FIX_ZERO_SIGN)
+    sg_res = ZERO_SIGNED(sg_res, sub_group_any(IS_WIN_ZERO(acc)));
+#endif
+#if defined(NAN_PROPAGATE)
+    // The built-in reduction need not keep NaN
+    sg_res = sub_group_any(isnan(acc)) ? (T)NAN : sg_res;
+#endif
+    if (sg_lid == 0) {
+        scratch[sg_id] = sg_res;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (sg_id == 0) {
+        const uint num_sg = get_num_sub_groups();
+        T v = (T)OP_IDENTITY;
+        for (uint i = sg_lid; i < num_sg; i += get_sub_group_size()) {
+            v = OP(v, scratch[i]);
+        }
+#if defined(FIX_ZERO_SIGN)
+        const int any_zero = sub_group_any(IS_WIN_ZERO(v));
+#endif
+#if defined(NAN_PROPAGATE)
+        const int any_nan = sub_group_any(isnan(v));
+        v = SUB_GROUP_REDUCE(v);
+        v = any_nan ? (T)NAN : v;
+#else
+        v = SUB_GROUP_REDUCE(v);
+#endif
+#if defined(FIX_ZERO_SIGN)
+        v = ZERO_SIGNED(v, any_zero);
+#endif
+        if (sg_lid == 0) {
+            out[out_base + get_group_id(0)] = v;
+        }
+    }
+}
+
+#elif defined(USE_WG_REDUCE)
 // Requires OpenCL C 2.0 or newer
-__kernel void reduce_max_stage(
-    __global const float* in,
-    __global float* out,
-    const uint n)
+__kernel STAGE_ATTR void reduce_stage(
+    __global const T* in,
+    __global T* out,
+    const ulong n,
+    const ulong out_base
+    NAN_COUNT_PARAM)
+{
+    uint nans;
+    T acc = thread_reduce(in, (size_t)n, get_global_id(0), get_global_size(0), &nans);
+    NAN_COUNT_ADD(nans);
+
+    // Work-group reduction to a single value
+    T wg_res = WORK_GROUP_REDUCE(acc);
+#if defined(FIX_ZERO_SIGN)
+    wg_res = ZERO_SIGNED(wg_res, work_group_any(IS_WIN_ZERO(acc)));
+#endif
+#if defined(NAN_PROPAGATE)
+    // The built-in reduction need not keep NaN
+    wg_res = work_group_any(isnan(acc)) ? (T)NAN : wg_res;
+#endif
+    if (get_local_id(0) == 0) {
+        out[out_base + get_group_id(0)] = wg_res;
+    }
+}
+
+#else
+// Portable OpenCL 1.2-compatible kernel
+__kernel STAGE_ATTR void reduce_stage(
+    __global const T* in,
+    __global T* out,
+    const ulong n,
+    const ulong out_base,
+    __local T* scratch
+    NAN_COUNT_PARAM)
 {
+    const size_t lid = get_local_id(0);
+
+    uint nans;
+    scratch[lid] = thread_reduce(in, (size_t)n, get_global_id(0), get_global_size(0), &nans);
+    NAN_COUNT_ADD(nans);
+    group_tree_reduce(scratch, lid);
+
+    if (lid == 0) {
+        out[out_base + get_group_id(0)] = scratch[0];
+    }
+}
+#endif
+
+// Fold (ov, oi) into (*v, *i): the larger value wins (+0.0 over -0.0), ties
+// go to the lowest index. NaN never compares, so NaNs are skipped like fmax does.
+inline void argmax_merge(T* v, ulong* i, T ov, ulong oi)
+{
+    const int take = ORDERED_GT(ov, *v) || (ORDERED_EQ(ov, *v) && oi < *i);
+    *v = take ? ov : *v;
+    *i = take ? oi : *i;
+}
+
+// One pass of the (value, index) reduction. Pass 0 reads the data with
+// has_idx == 0 and uses element positions as indices; later passes read the
+// partial pairs written by the previous pass. A group with no comparable
+// element reports index ULONG_MAX.
+__kernel STAGE_ATTR void reduce_argmax_stage(
+    __global const T* in_val,
+    __global const ulong* in_idx,
+    __global T* out_val,
+    __global ulong* out_idx,
+    const ulong n,
+    const uint has_idx,
+    __local T* s_val,
+    __local ulong* s_idx)
+{
+    const size_t lid = get_local_id(0);
     const size_t gid = get_global_id(0);
     const size_t gsize = get_global_size(0);
 
-    float acc = -INFINITY;
+    T best = (T)T_LOWEST;
+    ulong best_i = ULONG_MAX;
     for (size_t i = gid; i < (size_t)n; i += gsize) {
-        float v = in[i];
-        acc = fmax(acc, v);
+        const ulong idx = has_idx ? in_idx[i] : (ulong)i;
+        argmax_merge(&best, &best_i, in_val[i], idx);
     }
 
-    // Work-group reduction to a single max
-    float wg_max = work_group_reduce_max(acc);
-    if (get_local_id(0) == 0) {
-        out[get_group_id(0)] = wg_max;
+    s_val[lid] = best;
+    s_idx[lid] = best_i;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    UNROLL
+    for (uint stride = GROUP_SIZE >> 1; stride > 0; stride >>= 1) {
+        if (lid < stride) {
+            T v = s_val[lid];
+            ulong vi = s_idx[lid];
+            argmax_merge(&v, &vi, s_val[lid + stride], s_idx[lid + stride]);
+            s_val[lid] = v;
+            s_idx[lid] = vi;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (lid == 0) {
+        out_val[get_group_id(0)] = s_val[0];
+        out_idx[get_group_id(0)] = s_idx[0];
     }
 }
 
-#else
-// Portable OpenCL 1.2-compatible kernel
-__kernel void reduce_max_stage(
-    __global const float* in,
-    __global float* out,
-    const uint n,
-    __local float* scratch)
+// One pass of the fused min + max reduction: every element is read once and
+// each group writes two partials, out[g] = min and out[num_groups + g] = max.
+// Pass 0 reads the data with has_pairs == 0; later passes read the previous
+// pass's output, whose first n values are minima and next n are maxima.
+__kernel STAGE_ATTR void reduce_minmax_stage(
+    __global const T* in,
+    __global T* out,
+    const ulong n,
+    const uint has_pairs,
+    __local T* s_min,
+    __local T* s_max
+    NAN_COUNT_PARAM)
 {
     const size_t lid = get_local_id(0);
     const size_t gid = get_global_id(0);
     const size_t gsize = get_global_size(0);
 
-    float acc = -INFINITY;
+    T lo = (T)T_HIGHEST;
+    T hi = (T)T_LOWEST;
+    uint nans = 0u;
     for (size_t i = gid; i < (size_t)n; i += gsize) {
-        float v = in[i];
-        acc = fmax(acc, v);
+        const T v = in[i];
+        lo = P_MIN(lo, v);
+        hi = P_MAX(hi, has_pairs ? in[(size_t)n + i] : v);
+#if defined(NAN_COUNTING)
+        nans += (uint)isnan(v);
+#endif
     }
+    NAN_COUNT_ADD(nans);
 
-    scratch[lid] = acc;
+    s_min[lid] = lo;
+    s_max[lid] = hi;
     barrier(CLK_LOCAL_MEM_FENCE);
 
-    // Tree reduction in local memory
-    for (uint stride = get_local_size(0) >> 1; stride > 0; stride >>= 1) {
+    UNROLL
+    for (uint stride = GROUP_SIZE >> 1; stride > 0; stride >>= 1) {
         if (lid < stride) {
-            scratch[lid] = fmax(scratch[lid], scratch[lid + stride]);
+            s_min[lid] = P_MIN(s_min[lid], s_min[lid + stride]);
+            s_max[lid] = P_MAX(s_max[lid], s_max[lid + stride]);
         }
         barrier(CLK_LOCAL_MEM_FENCE);
     }
 
     if (lid == 0) {
-        out[get_group_id(0)] = scratch[0];
+        out[get_group_id(0)] = s_min[0];
+        out[get_num_groups(0) + get_group_id(0)] = s_max[0];
+    }
+}
+
+#if defined(HAS_ATOMIC_SLOT)
+// Segmented reduction in one launch. meta holds three uint arrays:
+// offsets[k + 1] (segment s is in[offsets[s], offsets[s + 1])),
+// first_group[k + 1] (segment s is reduced by groups first_group[s] up to
+// first_group[s + 1]) and group_seg[num_groups] (segment of each group).
+// Every group folds its result into out[s] with a global atomic; the host
+// initialises the slots to TO_ATOMIC_SLOT(OP_IDENTITY).
+__kernel STAGE_ATTR void reduce_segments(
+    __global const T* in,
+    __global const uint* meta,
+    const uint k,
+    __global atomic_slot_t* out,
+    __local T* scratch)
+{
+    __global const uint* offsets = meta;
+    __global const uint* first_group = meta + k + 1;
+    __global const uint* group_seg = meta + 2 * (k + 1);
+
+    const size_t lid = get_local_id(0);
+    const size_t lsize = get_local_size(0);
+    const uint g = get_group_id(0);
+    const uint seg = group_seg[g];
+    const size_t rank = g - first_group[seg];
+    const size_t stride = (size_t)(first_group[seg + 1] - first_group[seg]) * lsize;
+    const size_t end = offsets[seg + 1];
+
+    T acc = (T)OP_IDENTITY;
+    for (size_t i = offsets[seg] + rank * lsize + lid; i < end; i += stride) {
+        acc = OP(acc, in[i]);
+    }
+    scratch[lid] = acc;
+    group_tree_reduce(scratch, lid);
+
+    if (lid == 0) {
+        ATOMIC_OP(&out[seg], TO_ATOMIC_SLOT(scratch[0]));
     }
 }
 #endif
 
+// Block index of RangeMaxIndex. Level 0 is the data; entry j of level k + 1
+// is the OP of level-k entries [j * block, (j + 1) * block). The levels above
+// 0 live back to back in one buffer.
+//
+// Rebuild entries [first, first + num_groups) of one level: one work-group
+// per entry reads its block of the level below.
+__kernel void index_build_level(
+    __global const T* in,
+    const ulong in_off,
+    const ulong in_n,
+    __global T* out,
+    const ulong out_off,
+    const ulong first,
+    const uint block,
+    __local T* scratch)
+{
+    const size_t lid = get_local_id(0);
+    const size_t entry = (size_t)first + get_group_id(0);
+    const size_t begin = entry * block;
+    const size_t end = min(begin + (size_t)block, (size_t)in_n);
+
+    T acc = (T)OP_IDENTITY;
+    for (size_t i = begin + lid; i < end; i += get_local_size(0)) {
+        acc = OP(acc, in[(size_t)in_off + i]);
+    }
+    scratch[lid] = acc;
+    local_tree_reduce(scratch, lid);
+
+    if (lid == 0) {
+        out[(size_t)out_off + entry] = scratch[0];
+    }
+}
+
+// OP of level-0 slots [lo, hi) into acc, per work-item. Each level
+// contributes the partial blocks at both ends of the range, and the whole
+// blocks between them are read one level up, so a walk touches fewer than
+// 2 * block entries per level. level_off[k] is where level k + 1 starts.
+inline T index_walk(
+    __global const T* data,
+    __global const T* levels,
+    __global const ulong* level_off,
+    const uint num_levels,
+    const uint block,
+    size_t lo,
+    size_t hi,
+    T acc)
+{
+    const size_t lid = get_local_id(0);
+    const size_t lsize = get_local_size(0);
+    __global const T* level = data;
+    for (uint k = 0; lo < hi; ++k) {
+        const size_t lo_up = (lo + block - 1) / block;
+        const size_t hi_up = hi / block;
+        if (k == num_levels || lo_up >= hi_up) {
+            // No whole block inside (or no level above): finish here
+            for (size_t i = lo + lid; i < hi; i += lsize) acc = OP(acc, level[i]);
+            break;
+        }
+        for (size_t i = lo + lid; i < lo_up * block; i += lsize) acc = OP(acc, level[i]);
+        for (size_t i = hi_up * block + lid; i < hi; i += lsize) acc = OP(acc, level[i]);
+        lo = lo_up;
+        hi = hi_up;
+        level = levels + level_off[k];
+    }
+    return acc;
+}
+
+// One range query per work-group: positions [ranges[2q], ranges[2q + 1]),
+// clamped to the held positions [first, total). Position p lives in slot
+// p % capacity, so a range that wraps the ring takes two walks. An empty
+// range yields the identity.
+__kernel void index_query(
+    __global const T* data,
+    __global const T* levels,
+    __global const ulong* level_off,
+    const uint num_levels,
+    const uint block,
+    const ulong capacity,
+    const ulong first,
+    const ulong total,
+    __global const ulong* ranges,
+    __global T* out,
+    __local T* scratch)
+{
+    const size_t lid = get_local_id(0);
+    const size_t q = get_group_id(0);
+    const ulong lo = max(ranges[2 * q], first);
+    const ulong hi = min(ranges[2 * q + 1], total);
+
+    T acc = (T)OP_IDENTITY;
+    if (lo < hi) {
+        const size_t start = (size_t)(lo % capacity);
+        const size_t end = start + (size_t)(hi - lo);
+        acc = index_walk(data, levels, level_off, num_levels, block, start, min(end, (size_t)capacity), acc);
+        if (end > (size_t)capacity) {
+            acc = index_walk(data, levels, level_off, num_levels, block, 0, end - (size_t)capacity, acc);
+        }
+    }
+    scratch[lid] = acc;
+    local_tree_reduce(scratch, lid);
+
+    if (lid == 0) {
+        out[q] = scratch[0];
+    }
+}
+
+// Bandwidth ceiling of the device (roofline.cpp), independent of T. Every
+// work-item walks the n uint4 words with a grid stride. bandwidth_read folds
+// them with xor and stores one word per work-item so the loads stay live;
+// bandwidth_copy writes each word to out.
+__kernel void bandwidth_read(
+    __global const uint4* in,
+    const ulong n,
+    __global uint* out)
+{
+    const size_t gid = get_global_id(0);
+    uint acc = 0;
+    for (size_t i = gid; i < (size_t)n; i += get_global_size(0)) {
+        const uint4 v = in[i];
+        acc ^= v.x ^ v.y ^ v.z ^ v.w;
+    }
+    out[gid] = acc;
+}
+
+__kernel void bandwidth_copy(
+    __global const uint4* in,
+    const ulong n,
+    __global uint4* out)
+{
+    for (size_t i = get_global_id(0); i < (size_t)n; i += get_global_size(0)) {
+        out[i] = in[i];
+    }
+}
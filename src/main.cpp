@@ -1,121 +1,95 @@
 // Simple GPU-accelerated max reduction using OpenCL
 // - Prefers OpenCL 2.0 work-group reduction on Intel GPUs
 // - Falls back to portable local-memory tree reduction on 1.2
+// - Optional single-pass variant using a global atomic max
+// - Optional sub-group (SIMD) variant on cl_khr/cl_intel_subgroups devices
+// Thin CLI over the find_max library (FindMaxEngine).
+
+#include "autotune.hpp"
+#include "bench.hpp"
+#include "cpu_reduce.hpp"
+#include "datagen.hpp"
+#include "find_max.hpp"
+#include "mapped_file.hpp"
+#include "multi_device.hpp"
+#include "ocl_utils.hpp"
+#include "range_index.hpp"
+#include "roofline.hpp"
+#include "trace.hpp"
 
-#include <CL/cl.h>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <exception>
-#include <fstream>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <limits>
-#include <cmath>
+#include <memory>
+#include <stdexcept>
 #include <string>
-#include <tuple>
+#include <type_traits>
 #include <vector>
-#ifdef _WIN32
-#ifndef NOMINMAX
-#define NOMINMAX
-#endif
-#include <windows.h>
-#endif
-
-static void check(cl_int err, const char* msg) {
-    if (err != CL_SUCCESS) {
-        std::fprintf(stderr, "%s failed with error %d\n", msg, err);
-        std::exit(1);
-    }
-}
-
-static std::string load_text_file(const std::string& path) {
-    std::ifstream ifs(path, std::ios::in | std::ios::binary);
-    if (!ifs) {
-        throw std::runtime_error("Failed to open file: " + path);
-    }
-    std::string content;
-    ifs.seekg(0, std::ios::end);
-    content.resize(static_cast<size_t>(ifs.tellg()));
-    ifs.seekg(0, std::ios::beg);
-    ifs.read(&content[0], content.size());
-    return content;
-}
-
-static bool file_exists(const std::string& path) {
-    std::ifstream f(path, std::ios::in | std::ios::binary);
-    return (bool)f;
-}
-
-static std::string get_exe_dir() {
-#ifdef _WIN32
-    char buf[MAX_PATH] = {0};
-    DWORD len = GetModuleFileNameA(nullptr, buf, (DWORD)sizeof(buf));
-    if (len == 0 || len >= sizeof(buf)) return std::string();
-    std::string full(buf, buf + len);
-    size_t pos = full.find_last_of("/\\");
-    if (pos == std::string::npos) return std::string();
-    return full.substr(0, pos);
-#else
-    return std::string();
-#endif
-}
-
-static std::string resolve_kernel_path() {
-    // Try current working directory first
-    const char* fname = "kernels.cl";
-    std::vector<std::string> candidates;
-    candidates.emplace_back(fname);
-
-    std::string exedir = get_exe_dir();
-    if (!exedir.empty()) {
-        candidates.emplace_back(exedir + std::string("/") + fname);
-    }
-    // Fallback to typical source layout when running from repo root
-    candidates.emplace_back("src/kernels.cl");
 
-    for (const auto& p : candidates) {
-        if (file_exists(p)) return p;
-    }
-    throw std::runtime_error("Failed to open file: " + std::string(fname));
-}
-
-static bool is_intel(const char* s) {
-    if (!s) return false;
-    std::string str(s);
-    for (auto& c : str) c = (char)std::tolower((unsigned char)c);
-    return str.find("intel") != std::string::npos;
-}
-
-static bool is_opencl_c_ge_20(cl_device_id dev) {
-    // Prefer OpenCL C version query if available; fallback to device version.
-    char buf[256] = {0};
-    cl_int err = clGetDeviceInfo(dev, CL_DEVICE_OPENCL_C_VERSION, sizeof(buf), buf, nullptr);
-    if (err != CL_SUCCESS) {
-        // Fallback
-        err = clGetDeviceInfo(dev, CL_DEVICE_VERSION, sizeof(buf), buf, nullptr);
-        if (err != CL_SUCCESS) return false;
-    }
-    // Format: "OpenCL C 2.0 ..." or "OpenCL 3.0 ..."
-    int major = 0, minor = 0;
-    if (std::sscanf(buf, "OpenCL C %d.%d", &major, &minor) == 2) {
-        return (major > 2) || (major == 2 && minor >= 0);
-    }
-    if (std::sscanf(buf, "OpenCL %d.%d", &major, &minor) == 2) {
-        return (major > 2) || (major == 2 && minor >= 0);
-    }
-    return false;
-}
+using namespace findmax;
 
 struct Options {
     size_t size = 1 << 26; // default dataset size
+    bool size_given = false; // --size caps the element count of --input
     int wg = 256;          // work-group size
     int groups_max = 1024; // cap number of groups per pass
+    int items = ITEMS_PER_THREAD; // elements per work-item before another group is added
+    bool launch_given = false; // --wg/--groups-max/--items/--vec override the tuning profile
+    bool autotune = false; // sweep the launch shape for this input and store it in the profile
+    bool profile = true;   // apply the stored tuning profile (--no-profile disables)
+    bool specialize = false; // compile wg and items into the kernels (one program per launch shape)
+    std::string layout = "strided"; // strided | blocked: reduce_stage load layout
+    bool prefetch = false; // blocked layout: prefetch the next round of loads
+    bool bench = false;    // warm-up plus repeated timed runs, reported as statistics
+    int warmup = 3;        // --bench untimed runs
+    int reps = 10;         // --bench timed runs
+    bool json = false;     // emit one JSON object per run (statistics, configuration)
+    double peak_gbs = 0.0; // theoretical device bandwidth for the %-of-peak column; 0: unknown
+    bool timings = false;  // per-phase and per-command breakdown of the last run
+    std::string trace;     // Chrome trace JSON of every timed run; empty: none
     unsigned seed = 42;    // RNG seed
     bool verbose = true;
-    bool csv = false;      // emit CSV summary: size,kernel_ms,passes,wg,items
-    std::string variant = "auto"; // auto | wg (OpenCL 2.0) | local (OpenCL 1.2)
+    bool csv = false;      // emit CSV summary: size,variant,kernel_ms,passes,wg,items,build_ms,cache,host_mem,wall_ms,vec,dtype,op,segments
+    std::string variant = "auto"; // auto | wg (OpenCL 2.0) | local (OpenCL 1.2) | atomic (single pass) | subgroup
+    std::string cache_dir = default_cache_dir(); // program binary cache; empty disables
+    std::string host_mem = "copy"; // copy | zero-copy | svm | pinned
+    int vec = 1;           // kernel vector load width
+    bool argmax = false;   // also return the index of the maximum
+    size_t batch = 0;      // > 0: batched mode with this many segments
+    size_t segment_size = 100000; // elements per segment in batched mode
+    bool stream = false;   // chunked upload + reduce through reduce_stream()
+    size_t chunk = 0;      // --stream chunk in elements; 0: engine default
+    int stream_buffers = 2; // rotating device buffers for --stream
+    std::string device = "auto"; // auto (GPU, else CPU) | gpu | cpu
+    unsigned threads = 0;  // CPU backend and reference workers; 0: one per hardware thread
+    bool hybrid = false;   // split the input between the GPU and the CPU threads
+    std::string devices;   // --devices all|0,2: fan out over several GPUs; empty: one device
+    bool list_devices = false;
+    double gpu_fraction = 0.0; // --hybrid GPU share; 0: calibrated and stored in --cache-dir
+    std::string input;     // raw little-endian array of --dtype elements; empty: synthetic data
+    size_t input_offset = 0; // bytes to skip at the start of --input
+    std::string dtype = "float"; // float | int32 | uint32 | int64 | half | double
+    std::string op = "max"; // max | min | minmax | sum
+    std::string nan_policy = "ignore"; // ignore | propagate | count
+    std::string data = "uniform"; // synthetic data pattern: uniform | sorted | reverse | equal | max-at-end
+    size_t nans = 0;       // quiet NaNs planted in the synthetic floating-point data
+    size_t window = 0;     // > 0: sliding-window mode over a RangeMaxIndex of this many elements
+    size_t append = 4096;  // elements per append in window mode
+    size_t block = 0;      // range index block; 0: DEFAULT_INDEX_BLOCK
+    size_t queries = 0;    // > 0: batched range queries over a static RangeMaxIndex of the data
+    int queues = 1;        // engine command queues the asynchronous reductions rotate over
+    size_t concurrent = 0; // > 0: throughput of this many independent asynchronous reductions in flight
+    size_t reserve = 0;    // elements of scratch to allocate at startup
+    bool roofline = false; // device limits, measured bandwidth ceiling and each variant's share of it per size
 };
 
 static Options parse_args(int argc, char** argv) {
@@ -125,227 +99,1156 @@ static Options parse_args(int argc, char** argv) {
         auto require_value = [&](int& i) {
             if (i + 1 >= argc) throw std::runtime_error("Missing value after " + a);
         };
-        if (a == "--size" || a == "-n") { require_value(i); opt.size = std::strtoull(argv[++i], nullptr, 10); }
-        else if (a == "--wg") { require_value(i); opt.wg = std::atoi(argv[++i]); }
-        else if (a == "--groups-max") { require_value(i); opt.groups_max = std::atoi(argv[++i]); }
+        if (a == "--size" || a == "-n") { require_value(i); opt.size = std::strtoull(argv[++i], nullptr, 10); opt.size_given = true; }
+        else if (a == "--wg") { require_value(i); opt.wg = std::atoi(argv[++i]); opt.launch_given = true; }
+        else if (a == "--groups-max") { require_value(i); opt.groups_max = std::atoi(argv[++i]); opt.launch_given = true; }
+        else if (a == "--items") { require_value(i); opt.items = std::atoi(argv[++i]); opt.launch_given = true; }
+        else if (a == "--autotune") { opt.autotune = true; }
+        else if (a == "--no-profile") { opt.profile = false; }
+        else if (a == "--specialize") { opt.specialize = true; }
+        else if (a == "--layout") { require_value(i); opt.layout = argv[++i]; }
+        else if (a == "--prefetch") { opt.prefetch = true; }
+        else if (a == "--bench") { opt.bench = true; }
+        else if (a == "--warmup") { require_value(i); opt.warmup = std::atoi(argv[++i]); opt.bench = true; }
+        else if (a == "--reps") { require_value(i); opt.reps = std::atoi(argv[++i]); opt.bench = true; }
+        else if (a == "--json") { opt.json = true; }
+        else if (a == "--peak-gbs") { require_value(i); opt.peak_gbs = std::atof(argv[++i]); }
+        else if (a == "--timings") { opt.timings = true; }
+        else if (a == "--trace") { require_value(i); opt.trace = argv[++i]; }
         else if (a == "--seed") { require_value(i); opt.seed = (unsigned)std::strtoul(argv[++i], nullptr, 10); }
         else if (a == "--quiet" || a == "-q") { opt.verbose = false; }
         else if (a == "--csv") { opt.csv = true; }
         else if (a == "--variant" || a == "-k") { require_value(i); opt.variant = argv[++i]; }
+        else if (a == "--cache-dir") { require_value(i); opt.cache_dir = argv[++i]; }
+        else if (a == "--no-cache") { opt.cache_dir.clear(); }
+        else if (a == "--host-mem") { require_value(i); opt.host_mem = argv[++i]; }
+        else if (a == "--vec") { require_value(i); opt.vec = std::atoi(argv[++i]); opt.launch_given = true; }
+        else if (a == "--argmax") { opt.argmax = true; }
+        else if (a == "--dtype" || a == "-t") { require_value(i); opt.dtype = argv[++i]; }
+        else if (a == "--op") { require_value(i); opt.op = argv[++i]; }
+        else if (a == "--data") { require_value(i); opt.data = argv[++i]; }
+        else if (a == "--nan-policy") { require_value(i); opt.nan_policy = argv[++i]; }
+        else if (a == "--window") { require_value(i); opt.window = std::strtoull(argv[++i], nullptr, 10); }
+        else if (a == "--append") { require_value(i); opt.append = std::strtoull(argv[++i], nullptr, 10); }
+        else if (a == "--queries") { require_value(i); opt.queries = std::strtoull(argv[++i], nullptr, 10); }
+        else if (a == "--queues") { require_value(i); opt.queues = std::atoi(argv[++i]); }
+        else if (a == "--concurrent") { require_value(i); opt.concurrent = std::strtoull(argv[++i], nullptr, 10); }
+        else if (a == "--roofline") { opt.roofline = true; }
+        else if (a == "--reserve") { require_value(i); opt.reserve = std::strtoull(argv[++i], nullptr, 10); }
+        else if (a == "--block") { require_value(i); opt.block = std::strtoull(argv[++i], nullptr, 10); }
+        else if (a == "--nans") { require_value(i); opt.nans = std::strtoull(argv[++i], nullptr, 10); }
+        else if (a == "--batch") { require_value(i); opt.batch = std::strtoull(argv[++i], nullptr, 10); }
+        else if (a == "--segment-size") { require_value(i); opt.segment_size = std::strtoull(argv[++i], nullptr, 10); }
+        else if (a == "--stream") { opt.stream = true; }
+        else if (a == "--chunk") { require_value(i); opt.chunk = std::strtoull(argv[++i], nullptr, 10); }
+        else if (a == "--stream-buffers") { require_value(i); opt.stream_buffers = std::atoi(argv[++i]); }
+        else if (a == "--device" || a == "-d") { require_value(i); opt.device = argv[++i]; }
+        else if (a == "--hybrid") { opt.hybrid = true; }
+        else if (a == "--devices") { require_value(i); opt.devices = argv[++i]; }
+        else if (a == "--list-devices") { opt.list_devices = true; }
+        else if (a == "--gpu-fraction") { require_value(i); opt.gpu_fraction = std::atof(argv[++i]); opt.hybrid = true; }
+        else if (a == "--threads") { require_value(i); opt.threads = (unsigned)std::strtoul(argv[++i], nullptr, 10); }
+        else if (a == "--input" || a == "-i") { require_value(i); opt.input = argv[++i]; }
+        else if (a == "--input-offset") { require_value(i); opt.input_offset = std::strtoull(argv[++i], nullptr, 10); }
         else if (a == "--help" || a == "-h") {
-            std::cout << "Usage: ocl_find_max [--size N] [--wg W] [--groups-max G] [--seed S] [--quiet] [--csv] [--variant auto|wg|local]\n";
+            std::cout << "Usage: ocl_find_max [--size N] [--wg W] [--groups-max G] [--seed S] [--quiet] [--csv] [--variant auto|wg|local|atomic|subgroup] [--cache-dir DIR] [--no-cache] [--host-mem copy|zero-copy|svm|pinned] [--vec 1|2|4|8|16] [--items N] [--argmax]\n"
+                         "                    [--dtype float|int32|uint32|int64|half|double] [--op max|min|minmax|sum]\n"
+                         "                    [--nan-policy ignore|propagate|count] [--nans K] [--window W [--append A] [--block B]] [--queries Q [--block B]]\n"
+                         "                    [--batch K --segment-size S] [--stream [--chunk N] [--stream-buffers 2|3]] [--concurrent K [--queues N]] [--reserve N]\n"
+                         "                    [--roofline]\n"
+                         "                    [--data uniform|sorted|reverse|equal|max-at-end] [--input FILE [--input-offset BYTES]] [--device auto|gpu|cpu] [--threads N]\n"
+                         "                    [--hybrid [--gpu-fraction F]] [--devices all|I,J,...] [--list-devices]\n"
+                         "                    [--autotune] [--no-profile] [--specialize] [--layout strided|blocked [--prefetch]] [--bench [--warmup N] [--reps M]] [--json] [--peak-gbs GBS]\n"
+                         "                    [--timings] [--trace FILE.json]\n";
             std::exit(0);
         }
     }
     if (opt.wg <= 0) opt.wg = 256;
     if (opt.groups_max <= 0) opt.groups_max = 1024;
+    if (opt.argmax && parse_op(opt.op) != Op::Max) throw std::runtime_error("--argmax only works with --op max");
+    if (opt.batch > 0 && opt.argmax) throw std::runtime_error("--argmax is not available in --batch mode");
+    if (opt.stream && opt.argmax) throw std::runtime_error("--argmax is not available in --stream mode");
+    if (opt.stream && opt.batch > 0) throw std::runtime_error("--stream and --batch cannot be combined");
+    if (opt.hybrid && (opt.argmax || opt.stream || opt.batch > 0)) {
+        throw std::runtime_error("--hybrid cannot be combined with --argmax, --stream or --batch");
+    }
+    if (!opt.devices.empty() && (opt.argmax || opt.stream || opt.hybrid || opt.batch > 0 || opt.device == "cpu")) {
+        throw std::runtime_error("--devices cannot be combined with --argmax, --stream, --hybrid, --batch or --device cpu");
+    }
+    if (!opt.input.empty() && opt.batch > 0) throw std::runtime_error("--input is not available in --batch mode");
+    if (opt.warmup < 0 || opt.reps < 1) throw std::runtime_error("--warmup must be >= 0 and --reps >= 1");
+    if (opt.csv && opt.json) throw std::runtime_error("--csv and --json cannot be combined");
+    parse_nan_policy(opt.nan_policy);
+    if (parse_data_pattern(opt.data) != DataPattern::Uniform && !opt.input.empty()) throw std::runtime_error("--data cannot be combined with --input");
+    if (opt.window > 0) {
+        const Op wop = parse_op(opt.op);
+        if (wop != Op::Max && wop != Op::Min) throw std::runtime_error("--window needs --op max or min");
+        if (opt.append == 0) throw std::runtime_error("--append must be positive");
+        if (opt.argmax || opt.batch > 0 || opt.stream || opt.hybrid || !opt.devices.empty() || !opt.input.empty() || opt.autotune) {
+            throw std::runtime_error("--window cannot be combined with --argmax, --batch, --stream, --hybrid, --devices, --input or --autotune");
+        }
+    }
+    if (opt.queries > 0) {
+        const Op qop = parse_op(opt.op);
+        if (qop != Op::Max && qop != Op::Min) throw std::runtime_error("--queries needs --op max or min");
+        if (opt.window > 0 || opt.argmax || opt.batch > 0 || opt.stream || opt.hybrid || !opt.devices.empty() || !opt.input.empty() ||
+            opt.autotune) {
+            throw std::runtime_error(
+                "--queries cannot be combined with --window, --argmax, --batch, --stream, --hybrid, --devices, --input or --autotune");
+        }
+        if (opt.size == 0) throw std::runtime_error("--queries needs a positive --size");
+    }
+    if (opt.concurrent > 0) {
+        if (parse_op(opt.op) == Op::MinMax) throw std::runtime_error("--concurrent needs --op max, min or sum");
+        if (opt.window > 0 || opt.queries > 0 || opt.argmax || opt.batch > 0 || opt.stream || opt.hybrid || !opt.devices.empty() ||
+            !opt.input.empty() || opt.autotune) {
+            throw std::runtime_error("--concurrent cannot be combined with --window, --queries, --argmax, --batch, --stream, --hybrid, "
+                                     "--devices, --input or --autotune");
+        }
+        if (opt.size == 0) throw std::runtime_error("--concurrent needs a positive --size");
+    }
+    if (opt.roofline) {
+        if (parse_op(opt.op) == Op::MinMax) throw std::runtime_error("--roofline needs --op max, min or sum");
+        if (opt.window > 0 || opt.queries > 0 || opt.concurrent > 0 || opt.argmax || opt.batch > 0 || opt.stream || opt.hybrid ||
+            !opt.devices.empty() || !opt.input.empty() || opt.autotune) {
+            throw std::runtime_error("--roofline cannot be combined with --window, --queries, --concurrent, --argmax, --batch, --stream, "
+                                     "--hybrid, --devices, --input or --autotune");
+        }
+        if (opt.host_mem == "svm") throw std::runtime_error("--roofline cannot be combined with --host-mem svm");
+        if (opt.size == 0) throw std::runtime_error("--roofline needs a positive --size");
+    }
+    if (opt.nans > 0 && !dtype_is_float(parse_dtype(opt.dtype))) throw std::runtime_error("--nans needs a floating-point --dtype");
+    if (opt.nans > 0 && (opt.batch > 0 || !opt.input.empty())) throw std::runtime_error("--nans is not available with --batch or --input");
+    if (opt.autotune && (opt.argmax || opt.batch > 0 || !opt.devices.empty())) {
+        throw std::runtime_error("--autotune cannot be combined with --argmax, --batch or --devices");
+    }
     return opt;
 }
 
-int main(int argc, char** argv) {
-    try {
-        Options opt = parse_args(argc, argv);
+// How the CLI fills, compares and prints each element type. key() maps a
+// value to a host type with the same ordering (half compares as float).
+template <typename T> struct Sample;
+
+template <> struct Sample<float> {
+    static float make(double r) { return (float)(r * 1000.0 - 500.0); }
+    static float planted() { return 123456.0f; }
+    static float nan() { return std::numeric_limits<float>::quiet_NaN(); }
+    static float key(float v) { return v; }
+};
+template <> struct Sample<double> {
+    static double make(double r) { return r * 1000.0 - 500.0; }
+    static double planted() { return 123456.0; }
+    static double nan() { return std::numeric_limits<double>::quiet_NaN(); }
+    static double key(double v) { return v; }
+};
+template <> struct Sample<int32_t> {
+    static int32_t make(double r) { return (int32_t)(r * 2.0e9 - 1.0e9); }
+    static int32_t planted() { return 2000000000; }
+    static int32_t key(int32_t v) { return v; }
+};
+template <> struct Sample<uint32_t> {
+    static uint32_t make(double r) { return (uint32_t)(r * 4.0e9); }
+    static uint32_t planted() { return 4290000000u; }
+    static uint32_t key(uint32_t v) { return v; }
+};
+template <> struct Sample<int64_t> {
+    static int64_t make(double r) { return (int64_t)((r - 0.5) * 1.0e15); }
+    static int64_t planted() { return (int64_t)1 << 52; }
+    static int64_t key(int64_t v) { return v; }
+};
+template <> struct Sample<half_t> {
+    static half_t make(double r) { return float_to_half((float)(r * 1000.0 - 500.0)); }
+    static half_t planted() { return float_to_half(60000.0f); }
+    static half_t nan() { return float_to_half(std::numeric_limits<float>::quiet_NaN()); }
+    static float key(half_t v) { return half_to_float(v); }
+};
+
+template <typename K> static std::string format_value(K v) { return std::to_string(v); }
+template <> std::string format_value<float>(float v) { char b[64]; std::snprintf(b, sizeof(b), "%.6f", v); return b; }
+template <> std::string format_value<double>(double v) { char b[64]; std::snprintf(b, sizeof(b), "%.6f", v); return b; }
+
+// Exact agreement of two results: the same bit pattern, or both NaN
+// (payloads may differ). max and min order -0.0 below +0.0 on both sides,
+// so a zero result must carry the same sign.
+template <typename K> static bool same_value(K a, K b) {
+    if (a != a && b != b) return true;
+    using U = std::conditional_t<sizeof(K) == 8, uint64_t, uint32_t>;
+    static_assert(sizeof(U) == sizeof(K), "same_value compares 4- and 8-byte keys");
+    U ua, ub;
+    std::memcpy(&ua, &a, sizeof(K));
+    std::memcpy(&ub, &b, sizeof(K));
+    return ua == ub;
+}
+
+// Where make_data() plants the clear maximum: the middle of uniform data,
+// the last element of max-at-end, and nowhere (n) in the ordered patterns
+static size_t planted_index(const Options& opt, size_t n) {
+    switch (parse_data_pattern(opt.data)) {
+        case DataPattern::Uniform: return n / 2;
+        case DataPattern::MaxAtEnd: return n > 0 ? n - 1 : 0;
+        default: return n;
+    }
+}
+
+// Host data in memory suited to the host-memory mode (page aligned or SVM),
+// generated from --seed in the --data pattern on --threads workers; with
+// plant, S::planted() goes to planted_index()
+template <typename T>
+static std::unique_ptr<T, std::function<void(T*)>> make_data(FindMaxEngine& engine, size_t n, const Options& opt, bool plant = true) {
+    std::unique_ptr<T, std::function<void(T*)>> host(static_cast<T*>(engine.alloc_host(sizeof(T) * n)),
+                                                     [&engine](T* p) { engine.free_host(p); });
+    T* data = host.get();
+    generate_data(parse_data_pattern(opt.data), opt.seed, n, opt.threads, [data](size_t i, double r) { data[i] = Sample<T>::make(r); });
+    const size_t at = planted_index(opt, n);
+    if (plant && at < n) data[at] = Sample<T>::planted();
+    return host;
+}
+
+// Timing summary of engine.last_run(): one CSV row or the verbose lines
+static void report(const Options& opt, const FindMaxEngine& engine, size_t n, const char* vstr, Op op, DType t, size_t segments) {
+    const RunStats& stats = engine.last_run();
+    const ProgramBuild& built = engine.build_info();
+    const double kernel_ms = (double)stats.kernel_ns / 1.0e6;
+    const double wall_ms = (double)stats.wall_ns / 1.0e6;
+    const char* hstr = host_mem_name(engine.host_mem());
+    if (opt.csv) {
+        // CSV: size,variant,kernel_ms,passes,wg,items_per_thread,build_ms,cache,host_mem,wall_ms,vec,dtype,op,segments
+        std::printf("%zu,%s,%.6f,%d,%d,%d,%.3f,%s,%s,%.6f,%d,%s,%s,%zu\n", n, vstr, kernel_ms, stats.passes, engine.wg(), engine.items_per_thread(),
+                    built.build_ms, cache_status(built), hstr, wall_ms, engine.vec(), dtype_name(t), op_name(op), segments);
+    } else if (opt.verbose) {
+        std::printf("Kernel passes: %d (vec %d)\n", stats.passes, engine.vec());
+        std::printf("Total kernel time: %.6f ms\n", kernel_ms);
+        const double bytes = (double)n * (double)dtype_size(t);
+        std::printf("End-to-end time (%s): %.6f ms (upload %.6f ms)\n", hstr, wall_ms, (double)stats.upload_ns / 1.0e6);
+        if (stats.kernel_ns > 0 && stats.wall_ns > 0) {
+            std::printf("Bandwidth: %.2f GB/s kernel, %.2f GB/s end to end\n", gb_per_s(bytes, (double)stats.kernel_ns),
+                        gb_per_s(bytes, (double)stats.wall_ns));
+        }
+        if (opt.hybrid && engine.backend() == Backend::Gpu) {
+            std::printf("Hybrid split: GPU %.1f%% / CPU %.1f%% (CPU share %.6f ms on %u threads, next split %.3f)\n",
+                        100.0 * stats.gpu_fraction, 100.0 * (1.0 - stats.gpu_fraction), (double)stats.cpu_ns / 1.0e6,
+                        engine.cpu_threads(), engine.gpu_fraction(t, op));
+        }
+        if (segments > 1 && stats.wall_ns > 0 && stats.kernel_ns > 0) {
+            std::printf("Segments per second: %.0f (kernel only %.0f)\n", (double)segments * 1.0e9 / (double)stats.wall_ns,
+                        (double)segments * 1.0e9 / (double)stats.kernel_ns);
+        }
+        std::printf("Peak device allocation: %.3f MiB\n", (double)engine.peak_device_bytes() / (1024.0 * 1024.0));
+        if (engine.backend() == Backend::Gpu) {
+            const BufferPool::Stats pool = engine.pool_stats();
+            std::printf("Buffer pool: %llu requests, %.1f%% hits, high water %.3f MiB (%.3f MiB pooled)\n",
+                        (unsigned long long)pool.requests, 100.0 * pool.hit_rate(), (double)pool.high_water_bytes / (1024.0 * 1024.0),
+                        (double)pool.pooled_bytes / (1024.0 * 1024.0));
+        }
+    }
+}
+
+// --devices: one CSV row, or per-device shares and the aggregate bandwidth
+static void report_multi(const Options& opt, const MultiDeviceEngine& multi, size_t n, Op op, DType t) {
+    const size_t esize = dtype_size(t);
+    const uint64_t wall_ns = multi.last_wall_ns();
+    uint64_t kernel_ns = 0; // slowest device: the shares run concurrently
+    int passes = 0;
+    for (const MultiDeviceEngine::Share& s : multi.last_shares()) {
+        kernel_ns = std::max(kernel_ns, s.stats.kernel_ns);
+        passes += s.stats.passes;
+    }
+    const FindMaxEngine& first = multi.engine(0);
+    if (opt.csv) {
+        const ProgramBuild& built = first.build_info();
+        std::printf("%zu,multi,%.6f,%d,%d,%d,%.3f,%s,%s,%.6f,%d,%s,%s,%d\n", n, (double)kernel_ns / 1.0e6, passes, first.wg(), first.items_per_thread(),
+                    built.build_ms, cache_status(built), host_mem_name(first.host_mem()), (double)wall_ns / 1.0e6, first.vec(),
+                    dtype_name(t), op_name(op), 1);
+    } else if (opt.verbose) {
+        for (size_t i = 0; i < multi.device_count(); ++i) {
+            const MultiDeviceEngine::Share& s = multi.last_shares()[i];
+            const double gbs = s.stats.wall_ns > 0 ? (double)(s.elems * esize) / (double)s.stats.wall_ns : 0.0;
+            std::printf("Device %zu (%s): %zu elements (%.1f%%), %.6f ms (kernel %.6f ms), %.2f GB/s\n", i,
+                        multi.engine(i).device_name().c_str(), s.elems, n ? 100.0 * (double)s.elems / (double)n : 0.0,
+                        (double)s.stats.wall_ns / 1.0e6, (double)s.stats.kernel_ns / 1.0e6, gbs);
+        }
+        std::printf("Aggregate over %zu devices: %.6f ms, %.2f GB/s\n", multi.device_count(), (double)wall_ns / 1.0e6,
+                    wall_ns > 0 ? (double)(n * esize) / (double)wall_ns : 0.0);
+    }
+}
+
+// Host phases of the CLI itself (setup, input, reference check) for
+// --timings and --trace
+struct Timeline {
+    struct Span {
+        const char* name;
+        std::chrono::steady_clock::time_point begin, end;
+    };
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    std::vector<Span> spans;
+    void add(const char* name, std::chrono::steady_clock::time_point begin) {
+        spans.push_back(Span{ name, begin, std::chrono::steady_clock::now() });
+    }
+};
+static Timeline timeline;
+
+static bool tracing(const Options& opt) { return opt.timings || !opt.trace.empty(); }
+
+static EngineOptions engine_options(const Options& opt) {
+    EngineOptions eopt;
+    eopt.wg = opt.wg;
+    eopt.groups_max = opt.groups_max;
+    eopt.variant = opt.variant;
+    eopt.cache_dir = opt.cache_dir;
+    eopt.host_mem = opt.host_mem;
+    eopt.vec = opt.vec;
+    eopt.items_per_thread = opt.items;
+    eopt.dtype = opt.dtype;
+    eopt.chunk_elems = opt.chunk;
+    eopt.stream_buffers = opt.stream_buffers;
+    eopt.device = opt.device;
+    eopt.cpu_threads = opt.threads;
+    eopt.gpu_fraction = opt.gpu_fraction;
+    eopt.trace = tracing(opt);
+    eopt.nan_policy = opt.nan_policy;
+    eopt.specialize = opt.specialize;
+    eopt.layout = opt.layout;
+    eopt.prefetch = opt.prefetch;
+    eopt.queues = opt.queues;
+    eopt.reserve_elems = opt.reserve;
+    return eopt;
+}
+
+// Kernel and wall time of every timed run and, when tracing, the engine
+// stats of each (one per device for --devices)
+struct Samples {
+    std::vector<double> kernel_ns;
+    std::vector<double> wall_ns;
+    std::vector<std::vector<RunStats>> traced;
+};
+
+// --bench: opt.warmup untimed calls, then opt.reps timed ones; otherwise a
+// single timed call. stats() returns the timing of the call just made and
+// detail() the per-device stats kept when tracing.
+static Samples repeat(const Options& opt, const std::function<void()>& once, const std::function<RunStats()>& stats,
+                      const std::function<std::vector<RunStats>()>& detail) {
+    Samples s;
+    const int reps = opt.bench ? opt.reps : 1;
+    for (int i = 0; opt.bench && i < opt.warmup; ++i) once();
+    for (int i = 0; i < reps; ++i) {
+        once();
+        const RunStats r = stats();
+        s.kernel_ns.push_back((double)r.kernel_ns);
+        s.wall_ns.push_back((double)r.wall_ns);
+        if (tracing(opt)) s.traced.push_back(detail());
+    }
+    return s;
+}
+
+static double ms_between(std::chrono::steady_clock::time_point a, std::chrono::steady_clock::time_point b) {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(b - a).count() / 1.0e6;
+}
+
+// --timings: CLI phases, then the host phases and profiled commands of the
+// last timed run (queued -> submit -> start -> end from the event counters)
+static void report_timings(const Samples& samples) {
+    std::printf("Phase timings (ms from start):\n");
+    for (const Timeline::Span& sp : timeline.spans) {
+        std::printf("  %-24s at %10.3f  took %10.3f\n", sp.name, ms_between(timeline.origin, sp.begin), ms_between(sp.begin, sp.end));
+    }
+    if (samples.traced.empty()) return;
+    const std::vector<RunStats>& last = samples.traced.back();
+    for (size_t d = 0; d < last.size(); ++d) {
+        const RunStats& r = last[d];
+        const double base = ms_between(timeline.origin, r.started);
+        if (last.size() > 1) std::printf("Device %zu:\n", d);
+        for (const PhaseTiming& ph : r.phases) {
+            std::printf("  %-24s at %10.3f  took %10.3f\n", ph.name, base + (double)ph.begin_ns / 1.0e6, (double)ph.ns / 1.0e6);
+        }
+        if (r.commands.empty()) continue;
+        std::printf("  %-28s %12s %10s %6s %12s %12s %12s\n", "command", "elements", "global", "local", "queue->sub us",
+                    "sub->start us", "start->end us");
+        for (const CommandTiming& c : r.commands) {
+            const std::string name = c.pass >= 0 ? "pass " + std::to_string(c.pass) + " " + c.name : std::string(c.name) + (c.copy_queue ? " (copy q)" : "");
+            std::printf("  %-28s %12llu %10zu %6zu %12.3f %12.3f %12.3f\n", name.c_str(), (unsigned long long)c.elems, c.global, c.local,
+                        (double)(c.submit - c.queued) / 1.0e3, (double)(c.start - c.submit) / 1.0e3, (double)(c.end - c.start) / 1.0e3);
+        }
+    }
+}
+
+// --trace: CLI phases and every timed run as a Chrome trace
+static void write_trace(const Options& opt, const Samples& samples) {
+    ChromeTrace trace(timeline.origin);
+    for (const Timeline::Span& sp : timeline.spans) trace.host(sp.name, sp.begin, sp.end);
+    for (size_t i = 0; i < samples.traced.size(); ++i) {
+        for (size_t d = 0; d < samples.traced[i].size(); ++d) {
+            trace.run(samples.traced[i][d], "run " + std::to_string(i), (int)d);
+        }
+    }
+    trace.write(opt.trace);
+    if (opt.verbose) std::printf("Trace written to %s\n", opt.trace.c_str());
+}
+
+static std::string json_distribution_ms(const Distribution& d) {
+    char b[256];
+    std::snprintf(b, sizeof(b), "{\"min\":%.6f,\"median\":%.6f,\"p95\":%.6f,\"p99\":%.6f,\"max\":%.6f,\"mean\":%.6f,\"stddev\":%.6f}",
+                  d.min / 1.0e6, d.median / 1.0e6, d.p95 / 1.0e6, d.p99 / 1.0e6, d.max / 1.0e6, d.mean / 1.0e6, d.stddev / 1.0e6);
+    return b;
+}
+
+// --bench / --json: statistics of the timed runs as one CSV row, one JSON
+// object or verbose lines. Bandwidth counts the input bytes read once.
+static void report_bench(const Options& opt, const FindMaxEngine& engine, const Samples& samples, size_t n, const char* vstr, Op op,
+                         DType t, int passes) {
+    const Distribution k = summarize(samples.kernel_ns);
+    const Distribution w = summarize(samples.wall_ns);
+    const double bytes = (double)n * (double)dtype_size(t);
+    const double gbs = gb_per_s(bytes, k.median);
+    const double best_gbs = gb_per_s(bytes, k.min);
+    const double e2e_gbs = gb_per_s(bytes, w.median); // host data to result, uploads included
+    const double pct_peak = opt.peak_gbs > 0.0 ? 100.0 * gbs / opt.peak_gbs : 0.0;
+    const int warmup = opt.bench ? opt.warmup : 0;
+    const char* hstr = host_mem_name(engine.host_mem());
+    if (opt.csv) {
+        // CSV: size,variant,dtype,op,host_mem,wg,items_per_thread,vec,passes,warmup,reps,
+        //      kernel_{min,median,p95,p99,stddev}_ms,wall_{min,median,p95,p99,stddev}_ms,gbs_median,gbs_best,peak_gbs,pct_peak
+        std::printf("%zu,%s,%s,%s,%s,%d,%d,%d,%d,%d,%zu,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.3f,%.3f,%.3f,%.2f\n", n, vstr,
+                    dtype_name(t), op_name(op), hstr, engine.wg(), engine.items_per_thread(), engine.vec(), passes, warmup, k.count,
+                    k.min / 1.0e6, k.median / 1.0e6, k.p95 / 1.0e6, k.p99 / 1.0e6, k.stddev / 1.0e6, w.min / 1.0e6, w.median / 1.0e6,
+                    w.p95 / 1.0e6, w.p99 / 1.0e6, w.stddev / 1.0e6, gbs, best_gbs, opt.peak_gbs, pct_peak);
+    } else if (opt.json) {
+        std::printf("{\"size\":%zu,\"variant\":\"%s\",\"device\":\"%s\",\"backend\":\"%s\",\"dtype\":\"%s\",\"op\":\"%s\",\"host_mem\":\"%s\","
+                    "\"wg\":%d,\"items_per_thread\":%d,\"vec\":%d,\"specialized\":%s,\"layout\":\"%s\",\"passes\":%d,\"warmup\":%d,\"reps\":%zu,\"bytes\":%.0f,"
+                    "\"kernel_ms\":%s,\"wall_ms\":%s,\"gbs_median\":%.3f,\"gbs_best\":%.3f,\"e2e_gbs_median\":%.3f,\"peak_gbs\":%.3f,\"pct_peak\":%.2f,"
+                    "\"pool_hit_rate\":%.4f,\"pool_high_water_bytes\":%zu}\n",
+                    n, vstr, json_escape(engine.device_name()).c_str(), backend_name(engine.backend()), dtype_name(t), op_name(op), hstr,
+                    engine.wg(), engine.items_per_thread(), engine.vec(), engine.specialized() ? "true" : "false",
+                    engine.prefetch() ? "blocked+prefetch" : layout_name(engine.layout()), passes, warmup, k.count, bytes,
+                    json_distribution_ms(k).c_str(), json_distribution_ms(w).c_str(), gbs, best_gbs, e2e_gbs, opt.peak_gbs, pct_peak,
+                    engine.pool_stats().hit_rate(), engine.pool_stats().high_water_bytes);
+    } else if (opt.verbose) {
+        std::printf("Benchmark: %d warm-up, %zu timed runs\n", warmup, k.count);
+        std::printf("Kernel ms: min %.6f, median %.6f, p95 %.6f, p99 %.6f, stddev %.6f\n", k.min / 1.0e6, k.median / 1.0e6,
+                    k.p95 / 1.0e6, k.p99 / 1.0e6, k.stddev / 1.0e6);
+        std::printf("Wall ms:   min %.6f, median %.6f, p95 %.6f, p99 %.6f, stddev %.6f\n", w.min / 1.0e6, w.median / 1.0e6,
+                    w.p95 / 1.0e6, w.p99 / 1.0e6, w.stddev / 1.0e6);
+        if (opt.peak_gbs > 0.0) {
+            std::printf("Effective bandwidth: %.2f GB/s median, %.2f GB/s best (%.1f%% of %.1f GB/s peak)\n", gbs, best_gbs, pct_peak,
+                        opt.peak_gbs);
+        } else {
+            std::printf("Effective bandwidth: %.2f GB/s median, %.2f GB/s best\n", gbs, best_gbs);
+        }
+        std::printf("End-to-end bandwidth: %.2f GB/s median (%s)\n", e2e_gbs, hstr);
+    }
+}
+
+// --batch: K segments of S elements reduced by one launch, checked per segment
+template <typename T>
+static int run_batch(const Options& opt, FindMaxEngine& engine) {
+    using S = Sample<T>;
+    const Op op = parse_op(opt.op);
+    const size_t k = opt.batch;
+    const size_t n = k * opt.segment_size;
+    if (opt.segment_size == 0 || n / opt.segment_size != k || n > std::numeric_limits<uint32_t>::max()) {
+        throw std::runtime_error("--batch K --segment-size S needs S > 0 and K * S below 2^32");
+    }
+    const auto d0 = std::chrono::steady_clock::now();
+    auto host = make_data<T>(engine, n, opt, false);
+    timeline.add("input", d0);
+    const T* data = host.get();
+    std::vector<uint32_t> offsets(k + 1);
+    for (size_t s = 0; s <= k; ++s) offsets[s] = (uint32_t)(s * opt.segment_size);
+
+    std::vector<T> gpu(k, op == Op::Min ? DTypeTraits<T>::highest() : DTypeTraits<T>::lowest());
+    const Samples samples = repeat(
+        opt, [&]() { engine.reduce_segments_host(DTypeTraits<T>::dtype, op, data, offsets, gpu.data()); },
+        [&]() { return engine.last_run(); }, [&]() { return std::vector<RunStats>(1, engine.last_run()); });
+
+    // max and min are exact in every type, so the comparison is too
+    const auto v0 = std::chrono::steady_clock::now();
+    for (size_t s = 0; s < k; ++s) {
+        auto cpu = S::key(op == Op::Min ? DTypeTraits<T>::highest() : DTypeTraits<T>::lowest());
+        for (size_t i = offsets[s]; i < offsets[s + 1]; ++i) {
+            const auto v = S::key(data[i]);
+            cpu = op == Op::Min ? std::min(cpu, v) : std::max(cpu, v);
+        }
+        if (S::key(gpu[s]) != cpu) {
+            std::fprintf(stderr, "Mismatch detected in segment %zu: GPU %s, CPU %s\n", s, format_value(S::key(gpu[s])).c_str(),
+                         format_value(cpu).c_str());
+            return 2;
+        }
+    }
+    timeline.add("cpu reference", v0);
+    if (opt.verbose) std::printf("Segments: %zu x %zu elements, all %s values match.\n", k, opt.segment_size, op_name(op));
+
+    if (opt.bench || opt.json) {
+        if (opt.verbose && !opt.csv && !opt.json) report(opt, engine, n, "batch", op, DTypeTraits<T>::dtype, k);
+        report_bench(opt, engine, samples, n, "batch", op, DTypeTraits<T>::dtype, engine.last_run().passes);
+    } else {
+        report(opt, engine, n, "batch", op, DTypeTraits<T>::dtype, k);
+    }
+    if (opt.timings && opt.verbose && !opt.csv && !opt.json) report_timings(samples);
+    if (!opt.trace.empty()) write_trace(opt, samples);
+    return 0;
+}
+
+// --window W: the synthetic data arrives in --append chunks; after each one
+// the max (or min) of the last W elements comes from a RangeMaxIndex and is
+// checked against a scan of the same elements on a sample of the steps
+template <typename T>
+static int run_window(const Options& opt, FindMaxEngine& engine) {
+    using S = Sample<T>;
+    const Op op = parse_op(opt.op);
+    const DType dt = DTypeTraits<T>::dtype;
+    const size_t n = opt.size;
+    const auto d0 = std::chrono::steady_clock::now();
+    auto host = make_data<T>(engine, n, opt);
+    timeline.add("input", d0);
+    const T* data = host.get();
+
+    const auto s0 = std::chrono::steady_clock::now();
+    RangeMaxIndex index(engine, dt, op, opt.window, opt.block);
+    timeline.add("index setup", s0);
+    if (opt.verbose) {
+        std::printf("Range index: window %zu, block %zu, %d levels, %.3f MiB above the data\n", index.capacity(), index.block(),
+                    index.levels(), (double)index.index_bytes() / (1024.0 * 1024.0));
+    }
+
+    const size_t steps = (n + opt.append - 1) / opt.append;
+    const size_t check_every = std::max<size_t>(1, steps / 16);
+    std::vector<double> append_ns, query_ns;
+    append_ns.reserve(steps);
+    query_ns.reserve(steps);
+    for (size_t step = 0; step < steps; ++step) {
+        const size_t first = step * opt.append;
+        const size_t count = std::min(opt.append, n - first);
+        index.append(data + first, count);
+        append_ns.push_back((double)index.last_run().wall_ns);
+        const size_t w = index.size();
+        const T got = index.window<T>(w);
+        query_ns.push_back((double)index.last_run().wall_ns);
+        if (step % check_every != 0 && step + 1 != steps) continue;
+        T ref = op == Op::Min ? DTypeTraits<T>::highest() : DTypeTraits<T>::lowest();
+        const T* win = data + first + count - w;
+        cpu_reduce(dt, op, win, w, &ref, opt.threads);
+        cpu_apply_nan_policy(dt, op, engine.nan_policy(), win, w, &ref, opt.threads);
+        if (!same_value(S::key(got), S::key(ref))) {
+            std::fprintf(stderr, "Mismatch detected after %zu elements: index %s, CPU %s\n", first + count,
+                         format_value(S::key(got)).c_str(), format_value(S::key(ref)).c_str());
+            return 2;
+        }
+    }
+
+    const Distribution a = summarize(append_ns);
+    const Distribution q = summarize(query_ns);
+    if (opt.csv) {
+        // CSV: size,window,append,block,levels,appends,append_median_ms,append_p99_ms,query_median_ms,query_p99_ms
+        std::printf("%zu,%zu,%zu,%zu,%d,%zu,%.6f,%.6f,%.6f,%.6f\n", n, index.capacity(), opt.append, index.block(), index.levels(),
+                    a.count, a.median / 1.0e6, a.p99 / 1.0e6, q.median / 1.0e6, q.p99 / 1.0e6);
+    } else if (opt.json) {
+        std::printf("{\"size\":%zu,\"window\":%zu,\"append\":%zu,\"block\":%zu,\"levels\":%d,\"device\":\"%s\",\"dtype\":\"%s\","
+                    "\"op\":\"%s\",\"appends\":%zu,\"append_ms\":%s,\"query_ms\":%s}\n",
+                    n, index.capacity(), opt.append, index.block(), index.levels(), json_escape(engine.device_name()).c_str(),
+                    dtype_name(dt), op_name(op), a.count, json_distribution_ms(a).c_str(), json_distribution_ms(q).c_str());
+    } else if (opt.verbose) {
+        std::printf("Window %s over %zu appends of %zu elements: all sampled values match.\n", op_name(op), a.count, opt.append);
+        std::printf("Append ms: median %.6f, p99 %.6f (full rescan would read %zu elements each)\n", a.median / 1.0e6, a.p99 / 1.0e6,
+                    index.capacity());
+        std::printf("Query ms:  median %.6f, p99 %.6f\n", q.median / 1.0e6, q.p99 / 1.0e6);
+    }
+    return 0;
+}
+
+// --queries Q: a static RangeMaxIndex is built once over the synthetic data
+// and answers Q random (lo, hi) ranges per batch; a sample of the answers is
+// checked against a scan of the same range
+template <typename T>
+static int run_queries(const Options& opt, FindMaxEngine& engine) {
+    using S = Sample<T>;
+    const Op op = parse_op(opt.op);
+    const DType dt = DTypeTraits<T>::dtype;
+    const size_t n = opt.size;
+    const auto d0 = std::chrono::steady_clock::now();
+    auto host = make_data<T>(engine, n, opt);
+    timeline.add("input", d0);
+    const T* data = host.get();
+
+    // Uploaded once; on the GPU the index reads that buffer in place
+    const auto s0 = std::chrono::steady_clock::now();
+    std::unique_ptr<RangeMaxIndex> index;
+    if (engine.backend() == Backend::Gpu) {
+        cl_int err = CL_SUCCESS;
+        cl_mem buf = clCreateBuffer(engine.context(), CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, n * sizeof(T), (void*)data, &err);
+        check(err, "clCreateBuffer(query data)");
+        try {
+            index.reset(new RangeMaxIndex(engine, dt, op, buf, n, opt.block));
+        } catch (...) {
+            clReleaseMemObject(buf);
+            throw;
+        }
+        clReleaseMemObject(buf);
+    } else {
+        index.reset(new RangeMaxIndex(engine, dt, op, n, opt.block));
+        index->append(data, n);
+    }
+    const double build_ns = (double)index->last_run().wall_ns;
+    timeline.add("index setup", s0);
+    if (opt.verbose) {
+        std::printf("Range index: %zu elements, block %zu, %d levels, %.3f MiB above the data (%.2f%%), built in %.6f ms\n", n,
+                    index->block(), index->levels(), (double)index->index_bytes() / (1024.0 * 1024.0),
+                    100.0 * (double)index->index_bytes() / (double)(n * sizeof(T)), build_ns / 1.0e6);
+    }
+
+    std::vector<uint64_t> ranges(2 * opt.queries);
+    // A stream of draws apart from the data's
+    const uint64_t qseed = ~(uint64_t)opt.seed;
+    auto pick = [&](uint64_t draw, uint64_t m) { return std::min(m - 1, (uint64_t)(counter_uniform(qseed, draw) * (double)m)); };
+    for (size_t i = 0; i < opt.queries; ++i) {
+        const uint64_t lo = pick(2 * i, n);
+        ranges[2 * i] = lo;
+        ranges[2 * i + 1] = lo + 1 + pick(2 * i + 1, n - lo);
+    }
+
+    std::vector<T> got(opt.queries);
+    std::vector<double> batch_ns;
+    const int runs = opt.bench ? opt.warmup + opt.reps : 1;
+    for (int r = 0; r < runs; ++r) {
+        index->query_batch(ranges.data(), opt.queries, got.data());
+        if (!opt.bench || r >= opt.warmup) batch_ns.push_back((double)index->last_run().wall_ns);
+    }
+
+    const size_t check_every = std::max<size_t>(1, opt.queries / 16);
+    for (size_t i = 0; i < opt.queries; i += check_every) {
+        T ref = op == Op::Min ? DTypeTraits<T>::highest() : DTypeTraits<T>::lowest();
+        const T* r = data + ranges[2 * i];
+        const size_t len = (size_t)(ranges[2 * i + 1] - ranges[2 * i]);
+        cpu_reduce(dt, op, r, len, &ref, opt.threads);
+        cpu_apply_nan_policy(dt, op, engine.nan_policy(), r, len, &ref, opt.threads);
+        if (!same_value(S::key(got[i]), S::key(ref))) {
+            std::fprintf(stderr, "Mismatch detected for range [%llu, %llu): index %s, CPU %s\n", (unsigned long long)ranges[2 * i],
+                         (unsigned long long)ranges[2 * i + 1], format_value(S::key(got[i])).c_str(), format_value(S::key(ref)).c_str());
+            return 2;
+        }
+    }
+
+    const Distribution b = summarize(batch_ns);
+    const double qps = b.median > 0.0 ? (double)opt.queries * 1.0e9 / b.median : 0.0;
+    if (opt.csv) {
+        // CSV: size,block,levels,index_bytes,queries,build_ms,batch_median_ms,batch_p99_ms,queries_per_s
+        std::printf("%zu,%zu,%d,%zu,%zu,%.6f,%.6f,%.6f,%.0f\n", n, index->block(), index->levels(), index->index_bytes(), opt.queries,
+                    build_ns / 1.0e6, b.median / 1.0e6, b.p99 / 1.0e6, qps);
+    } else if (opt.json) {
+        std::printf("{\"size\":%zu,\"block\":%zu,\"levels\":%d,\"index_bytes\":%zu,\"device\":\"%s\",\"dtype\":\"%s\",\"op\":\"%s\","
+                    "\"queries\":%zu,\"build_ms\":%.6f,\"batch_ms\":%s,\"queries_per_s\":%.0f}\n",
+                    n, index->block(), index->levels(), index->index_bytes(), json_escape(engine.device_name()).c_str(), dtype_name(dt),
+                    op_name(op), opt.queries, build_ns / 1.0e6, json_distribution_ms(b).c_str(), qps);
+    } else if (opt.verbose) {
+        std::printf("%zu range %s queries per batch: all sampled values match.\n", opt.queries, op_name(op));
+        std::printf("Batch ms: median %.6f, p99 %.6f (%.0f queries/s, %.1f ns per query)\n", b.median / 1.0e6, b.p99 / 1.0e6, qps,
+                    b.median / (double)opt.queries);
+    }
+    return 0;
+}
+
+static void print_launch(const char* source, const LaunchConfig& c) {
+    std::printf("Launch config (%s): wg %d, groups-max %d, items %d, vec %d\n", source, c.wg, c.groups_max, c.items_per_thread, c.vec);
+}
+
+// Launch shape of the reduction: --autotune sweeps it on this input and
+// stores the winner; otherwise the device profile entry for the dtype, op
+// and size applies unless the shape was given on the command line
+static void tune_launch(const Options& opt, FindMaxEngine& engine, DType t, Op op, const void* data, size_t n) {
+    if (engine.backend() == Backend::Cpu) {
+        if (opt.autotune) throw std::runtime_error("--autotune needs the GPU backend");
+        return;
+    }
+    if (opt.autotune) {
+        TuneProgress progress;
+        if (opt.verbose) {
+            progress = [](const LaunchConfig& c, double ms) {
+                if (std::isinf(ms)) std::printf("  wg %4d groups-max %4d items %2d vec %2d: failed\n", c.wg, c.groups_max, c.items_per_thread, c.vec);
+                else std::printf("  wg %4d groups-max %4d items %2d vec %2d: %.6f ms\n", c.wg, c.groups_max, c.items_per_thread, c.vec, ms);
+            };
+        }
+        const TuneResult r = autotune(engine, t, op, data, n, 5, progress);
+        if (opt.verbose) {
+            std::printf("Autotune: %d candidates, best kernel %.6f ms%s\n", r.tried, r.kernel_ms,
+                        tuning_file(engine).empty() ? " (not stored: cache disabled)" : "");
+            print_launch("autotuned", r.config);
+        }
+        return;
+    }
+    LaunchConfig c;
+    if (opt.launch_given || !opt.profile || !load_tuning(engine, t, op, n, &c)) return;
+    engine.set_launch_config(c);
+    if (opt.verbose) print_launch("profile", c);
+}
+
+// CPU reference of a single-value op over data into *ref, with the NaN
+// policy applied. max and min are exact; sums get the tolerance of the
+// single-input check in run().
+template <typename T>
+static bool matches_reference(const Options& opt, NanPolicy policy, Op op, const T* data, size_t n, T got, T* ref) {
+    using S = Sample<T>;
+    const DType dt = DTypeTraits<T>::dtype;
+    *ref = op == Op::Min ? DTypeTraits<T>::highest() : op == Op::Sum ? T() : DTypeTraits<T>::lowest();
+    T ref_mm[2] = { DTypeTraits<T>::highest(), DTypeTraits<T>::lowest() };
+    cpu_reduce(dt, op, data, n, ref, opt.threads);
+    cpu_apply_nan_policy(dt, op, policy, data, n, ref, opt.threads);
+    cpu_reduce(dt, Op::MinMax, data, n, ref_mm, opt.threads);
+    const double max_abs = std::max(std::abs((double)S::key(ref_mm[0])), std::abs((double)S::key(ref_mm[1])));
+    const double tol = 64.0 * (double)std::numeric_limits<decltype(S::key(T()))>::epsilon() * (double)n * max_abs;
+    const bool rounded = op == Op::Sum && dtype_is_float(dt);
+    return same_value(S::key(got), S::key(*ref)) || (rounded && std::abs((double)S::key(got) - (double)S::key(*ref)) <= tol);
+}
+
+// --concurrent K: K independent inputs of --size elements; every round
+// reduces all of them once back to back through the blocking call, then
+// once with K asynchronous calls in flight (spread over --queues queues).
+// Every result of the last round is checked against the CPU.
+template <typename T>
+static int run_concurrent(const Options& opt, FindMaxEngine& engine) {
+    using S = Sample<T>;
+    const Op op = parse_op(opt.op);
+    const DType dt = DTypeTraits<T>::dtype;
+    const size_t n = opt.size;
+    const size_t k = opt.concurrent;
+    if ((n * k) / k != n) throw std::runtime_error("--concurrent K --size N overflows");
+    const auto d0 = std::chrono::steady_clock::now();
+    auto host = make_data<T>(engine, n * k, opt, false);
+    timeline.add("input", d0);
+    const T* data = host.get();
+    tune_launch(opt, engine, dt, op, data, n);
+
+    std::vector<T> got(k);
+    std::vector<std::future<T>> pending(k);
+    std::vector<double> serial_ns, concurrent_ns;
+    const int runs = opt.bench ? opt.warmup + opt.reps : 1;
+    for (int r = 0; r < runs; ++r) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < k; ++i) engine.reduce_host(dt, op, data + i * n, n, &got[i]);
+        const double serial = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+        t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < k; ++i) pending[i] = engine.reduce_async(op, data + i * n, n);
+        for (size_t i = 0; i < k; ++i) got[i] = pending[i].get();
+        const double concurrent = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+        if (opt.bench && r < opt.warmup) continue;
+        serial_ns.push_back(serial);
+        concurrent_ns.push_back(concurrent);
+    }
+
+    for (size_t i = 0; i < k; ++i) {
+        T ref = T();
+        if (!matches_reference(opt, engine.nan_policy(), op, data + i * n, n, got[i], &ref)) {
+            std::fprintf(stderr, "Mismatch detected for request %zu: GPU %s, CPU %s\n", i, format_value(S::key(got[i])).c_str(),
+                         format_value(S::key(ref)).c_str());
+            return 2;
+        }
+    }
+
+    const Distribution a = summarize(serial_ns);
+    const Distribution c = summarize(concurrent_ns);
+    const double bytes = (double)k * (double)n * (double)sizeof(T);
+    const double rps = c.median > 0.0 ? (double)k * 1.0e9 / c.median : 0.0;
+    const double gbs = gb_per_s(bytes, c.median);
+    const double speedup = c.median > 0.0 ? a.median / c.median : 0.0;
+    if (opt.csv) {
+        // CSV: size,requests,queues,dtype,op,serial_median_ms,concurrent_median_ms,concurrent_p99_ms,speedup,requests_per_s,gbs
+        std::printf("%zu,%zu,%d,%s,%s,%.6f,%.6f,%.6f,%.3f,%.0f,%.3f\n", n, k, engine.queues(), dtype_name(dt), op_name(op), a.median / 1.0e6,
+                    c.median / 1.0e6, c.p99 / 1.0e6, speedup, rps, gbs);
+    } else if (opt.json) {
+        std::printf("{\"size\":%zu,\"requests\":%zu,\"queues\":%d,\"device\":\"%s\",\"backend\":\"%s\",\"dtype\":\"%s\",\"op\":\"%s\","
+                    "\"serial_ms\":%s,\"concurrent_ms\":%s,\"speedup\":%.3f,\"requests_per_s\":%.0f,\"gbs\":%.3f}\n",
+                    n, k, engine.queues(), json_escape(engine.device_name()).c_str(), backend_name(engine.backend()), dtype_name(dt),
+                    op_name(op), json_distribution_ms(a).c_str(), json_distribution_ms(c).c_str(), speedup, rps, gbs);
+    } else if (opt.verbose) {
+        std::printf("%zu concurrent %s reductions of %zu elements on %d queue%s: all values match.\n", k, op_name(op), n, engine.queues(),
+                    engine.queues() == 1 ? "" : "s");
+        std::printf("Round ms: back to back median %.6f, concurrent median %.6f, p99 %.6f (%.2fx)\n", a.median / 1.0e6, c.median / 1.0e6,
+                    c.p99 / 1.0e6, speedup);
+        std::printf("Throughput: %.0f requests/s, %.2f GB/s aggregate\n", rps, gbs);
+    }
+    return 0;
+}
+
+// Which side of the roofline a size sits on: a kernel well under the read
+// ceiling has headroom left in itself ("kernel"); one near it whose
+// end-to-end rate is far lower is held back by moving the data ("transfer")
+static const char* roofline_limit(double pct_ceiling, double kernel_gbs, double e2e_gbs) {
+    if (pct_ceiling < 60.0) return "kernel";
+    if (e2e_gbs < 0.5 * kernel_gbs) return "transfer";
+    return "memory";
+}
 
-        // Create data
-        std::vector<float> data(opt.size);
-        std::srand(opt.seed);
-        for (size_t i = 0; i < data.size(); ++i) {
-            // Spread across a range; include occasional NaN-safe values
-            data[i] = ((float)std::rand() / RAND_MAX) * 1000.0f - 500.0f;
-        }
-        // Plant a clear maximum
-        if (!data.empty()) data[data.size() / 2] = 123456.0f;
-
-        // Pick Intel GPU if present
-        cl_uint num_platforms = 0;
-        check(clGetPlatformIDs(0, nullptr, &num_platforms), "clGetPlatformIDs(query)");
-        std::vector<cl_platform_id> plats(num_platforms);
-        check(clGetPlatformIDs(num_platforms, plats.data(), nullptr), "clGetPlatformIDs(list)");
-
-        cl_platform_id chosen_platform = nullptr;
-        cl_device_id chosen_device = nullptr;
-        for (auto p : plats) {
-            cl_uint num_devices = 0;
-            if (clGetDeviceIDs(p, CL_DEVICE_TYPE_GPU, 0, nullptr, &num_devices) != CL_SUCCESS || num_devices == 0) continue;
-            std::vector<cl_device_id> devs(num_devices);
-            if (clGetDeviceIDs(p, CL_DEVICE_TYPE_GPU, num_devices, devs.data(), nullptr) != CL_SUCCESS) continue;
-            for (auto d : devs) {
-                char vendor[256] = {0};
-                clGetDeviceInfo(d, CL_DEVICE_VENDOR, sizeof(vendor), vendor, nullptr);
-                if (is_intel(vendor)) { chosen_platform = p; chosen_device = d; break; }
+// --roofline: the device limits and the bandwidth ceiling measured by the
+// microkernels, then every variant (only --variant when one is given) on
+// sizes from 64Ki elements up to --size in steps of 4x. Each size runs
+// --warmup plus --reps reductions of host data; the medians of the kernel
+// and wall times give its GB/s as a share of the read ceiling.
+template <typename T>
+static int run_roofline(const Options& opt, FindMaxEngine& engine) {
+    using S = Sample<T>;
+    const Op op = parse_op(opt.op);
+    const DType dt = DTypeTraits<T>::dtype;
+    const DeviceCaps caps = device_caps(engine);
+    const auto c0 = std::chrono::steady_clock::now();
+    const BandwidthCeiling roof = measure_bandwidth(engine, DEFAULT_CEILING_BYTES, opt.reps);
+    timeline.add("bandwidth ceiling", c0);
+    if (opt.verbose && !opt.csv && !opt.json) {
+        if (engine.backend() == Backend::Cpu) {
+            std::printf("Device: %s, %u threads (%s)\n", caps.name.c_str(), caps.compute_units, cpu_simd_name());
+        } else {
+            std::printf("Device: %s, %u compute units at %u MHz, %.0f MiB global memory (%s), max alloc %.0f MiB\n", caps.name.c_str(),
+                        caps.compute_units, caps.clock_mhz, (double)caps.global_mem_bytes / (1024.0 * 1024.0),
+                        caps.unified_memory ? "unified with the host" : "discrete", (double)caps.max_alloc_bytes / (1024.0 * 1024.0));
+            std::printf("Caches: %.0f KiB global (%u-byte lines), %.0f KiB local per group\n", (double)caps.global_cache_bytes / 1024.0,
+                        caps.cacheline_bytes, (double)caps.local_mem_bytes / 1024.0);
+        }
+        std::printf("Bandwidth ceiling over %.0f MiB: read %.2f GB/s, copy %.2f GB/s", (double)roof.bytes / (1024.0 * 1024.0),
+                    roof.read_gbs, roof.copy_gbs);
+        if (roof.upload_gbs > 0.0) std::printf(", upload %.2f GB/s", roof.upload_gbs);
+        if (opt.peak_gbs > 0.0) std::printf(" (read %.1f%% of %.1f GB/s peak)", 100.0 * roof.read_gbs / opt.peak_gbs, opt.peak_gbs);
+        std::printf("\n");
+    }
+
+    std::vector<size_t> sizes;
+    for (size_t s = (size_t)1 << 16; s < opt.size; s *= 4) sizes.push_back(s);
+    sizes.push_back(opt.size);
+    const auto d0 = std::chrono::steady_clock::now();
+    auto host = make_data<T>(engine, opt.size, opt);
+    timeline.add("input", d0);
+    const T* data = host.get();
+
+    // The CPU backend runs the same host code whatever the variant
+    std::vector<std::string> variants;
+    if (engine.backend() == Backend::Cpu || opt.variant != "auto") variants.push_back(variant_name(engine.variant()));
+    else variants = { "local", "wg", "atomic", "subgroup" };
+    Options timed = opt;
+    timed.bench = true;
+    Options quiet = opt;
+    quiet.verbose = false;
+    if (opt.verbose && !opt.csv && !opt.json) {
+        std::printf("%12s %-9s %12s %10s %12s %10s  %s\n", "size", "variant", "kernel GB/s", "% ceiling", "e2e GB/s", "% ceiling", "limit");
+    }
+    for (const std::string& v : variants) {
+        std::unique_ptr<FindMaxEngine> own;
+        FindMaxEngine* e = &engine;
+        if (v != variant_name(engine.variant())) {
+            EngineOptions eopt = engine_options(opt);
+            eopt.variant = v;
+            try {
+                own.reset(new FindMaxEngine(eopt));
+            } catch (const std::exception& ex) {
+                if (opt.verbose && !opt.csv && !opt.json) std::printf("%12s %-9s skipped: %s\n", "", v.c_str(), ex.what());
+                continue;
             }
-            if (chosen_device) break;
-        }
-        if (!chosen_device) {
-            // Fallback: first GPU device anywhere
-            for (auto p : plats) {
-                cl_uint num_devices = 0;
-                if (clGetDeviceIDs(p, CL_DEVICE_TYPE_GPU, 0, nullptr, &num_devices) != CL_SUCCESS || num_devices == 0) continue;
-                std::vector<cl_device_id> devs(num_devices);
-                if (clGetDeviceIDs(p, CL_DEVICE_TYPE_GPU, num_devices, devs.data(), nullptr) != CL_SUCCESS) continue;
-                chosen_platform = p; chosen_device = devs[0];
-                break;
+            e = own.get();
+        }
+        const char* vstr = e->backend() == Backend::Cpu ? "cpu" : variant_name(e->variant());
+        if (!e->supports(dt, op)) {
+            if (opt.verbose && !opt.csv && !opt.json) {
+                std::printf("%12s %-9s skipped: no %s over %s\n", "", vstr, op_name(op), dtype_name(dt));
             }
+            continue;
         }
-        if (!chosen_device) {
-            std::fprintf(stderr, "No OpenCL GPU device found.\n");
-            return 1;
+        for (size_t n : sizes) {
+            tune_launch(quiet, *e, dt, op, data, n);
+            T got = T();
+            const Samples samples = repeat(
+                timed, [&]() { e->reduce_host(dt, op, data, n, &got); }, [&]() { return e->last_run(); },
+                [&]() { return std::vector<RunStats>(1, e->last_run()); });
+            T ref = T();
+            if (!matches_reference(opt, e->nan_policy(), op, data, n, got, &ref)) {
+                std::fprintf(stderr, "Mismatch detected (%s, %zu elements): GPU %s, CPU %s\n", vstr, n, format_value(S::key(got)).c_str(),
+                             format_value(S::key(ref)).c_str());
+                return 2;
+            }
+            const Distribution k = summarize(samples.kernel_ns);
+            const Distribution w = summarize(samples.wall_ns);
+            const double bytes = (double)n * (double)sizeof(T);
+            const double kernel_gbs = gb_per_s(bytes, k.median);
+            const double e2e_gbs = gb_per_s(bytes, w.median);
+            const double pct = roof.read_gbs > 0.0 ? 100.0 * kernel_gbs / roof.read_gbs : 0.0;
+            const double e2e_pct = roof.read_gbs > 0.0 ? 100.0 * e2e_gbs / roof.read_gbs : 0.0;
+            const char* limit = roofline_limit(pct, kernel_gbs, e2e_gbs);
+            if (opt.csv) {
+                // CSV: size,variant,dtype,op,host_mem,kernel_median_ms,wall_median_ms,kernel_gbs,e2e_gbs,
+                //      read_ceiling_gbs,copy_ceiling_gbs,upload_gbs,pct_ceiling,e2e_pct_ceiling,limit
+                std::printf("%zu,%s,%s,%s,%s,%.6f,%.6f,%.3f,%.3f,%.3f,%.3f,%.3f,%.2f,%.2f,%s\n", n, vstr, dtype_name(dt), op_name(op),
+                            host_mem_name(e->host_mem()), k.median / 1.0e6, w.median / 1.0e6, kernel_gbs, e2e_gbs, roof.read_gbs,
+                            roof.copy_gbs, roof.upload_gbs, pct, e2e_pct, limit);
+            } else if (opt.json) {
+                std::printf("{\"size\":%zu,\"variant\":\"%s\",\"device\":\"%s\",\"backend\":\"%s\",\"dtype\":\"%s\",\"op\":\"%s\",\"host_mem\":\"%s\","
+                            "\"compute_units\":%u,\"clock_mhz\":%u,\"global_mem_bytes\":%llu,\"unified_memory\":%s,\"kernel_ms\":%s,\"wall_ms\":%s,"
+                            "\"kernel_gbs\":%.3f,\"e2e_gbs\":%.3f,\"read_ceiling_gbs\":%.3f,\"copy_ceiling_gbs\":%.3f,\"upload_gbs\":%.3f,"
+                            "\"peak_gbs\":%.3f,\"pct_ceiling\":%.2f,\"e2e_pct_ceiling\":%.2f,\"limit\":\"%s\"}\n",
+                            n, vstr, json_escape(caps.name).c_str(), backend_name(e->backend()), dtype_name(dt), op_name(op),
+                            host_mem_name(e->host_mem()), caps.compute_units, caps.clock_mhz, (unsigned long long)caps.global_mem_bytes,
+                            caps.unified_memory ? "true" : "false", json_distribution_ms(k).c_str(), json_distribution_ms(w).c_str(),
+                            kernel_gbs, e2e_gbs, roof.read_gbs, roof.copy_gbs, roof.upload_gbs, opt.peak_gbs, pct, e2e_pct, limit);
+            } else if (opt.verbose) {
+                std::printf("%12zu %-9s %12.2f %9.1f%% %12.2f %9.1f%%  %s\n", n, vstr, kernel_gbs, pct, e2e_gbs, e2e_pct, limit);
+            }
         }
+    }
+    return 0;
+}
 
-        char name[256] = {0};
-        clGetDeviceInfo(chosen_device, CL_DEVICE_NAME, sizeof(name), name, nullptr);
-        char vendor[256] = {0};
-        clGetDeviceInfo(chosen_device, CL_DEVICE_VENDOR, sizeof(vendor), vendor, nullptr);
-        if (opt.verbose) std::printf("Using device: %s (%s)\n", name, vendor);
+template <typename T>
+static int run(const Options& opt, FindMaxEngine& engine, MultiDeviceEngine* multi) {
+    using S = Sample<T>;
+    if (opt.batch > 0) return run_batch<T>(opt, engine);
+    if (opt.window > 0) return run_window<T>(opt, engine);
+    if (opt.queries > 0) return run_queries<T>(opt, engine);
+    if (opt.concurrent > 0) return run_concurrent<T>(opt, engine);
+    if (opt.roofline) return run_roofline<T>(opt, engine);
+    // --input maps the file read-only and reduces it in place; otherwise
+    // synthetic data with a clear maximum planted in the middle
+    std::unique_ptr<MappedFile> file;
+    std::unique_ptr<T, std::function<void(T*)>> host;
+    const T* data = nullptr;
+    size_t n = opt.size;
+    const auto d0 = std::chrono::steady_clock::now();
+    if (!opt.input.empty()) {
+        file.reset(new MappedFile(opt.input));
+        if (opt.input_offset > file->size()) throw std::runtime_error("--input-offset is past the end of " + opt.input);
+        if (opt.input_offset % sizeof(T) != 0) throw std::runtime_error("--input-offset must be a multiple of the element size");
+        n = (file->size() - opt.input_offset) / sizeof(T);
+        if (opt.size_given) n = std::min(n, opt.size);
+        data = reinterpret_cast<const T*>(static_cast<const char*>(file->data()) + opt.input_offset);
+    } else {
+        host = make_data<T>(engine, n, opt);
+        // --nans: K quiet NaNs at scattered positions, never on the planted maximum
+        if constexpr (!std::is_integral<T>::value) {
+            const size_t planted = planted_index(opt, n);
+            for (size_t j = 0; j < std::min(opt.nans, n > 1 ? n - 1 : 0); ++j) {
+                size_t pos = (size_t)(((uint64_t)j * 2654435761u + 1) % (uint64_t)n);
+                while (pos == planted || std::isnan((double)S::key(host.get()[pos]))) pos = (pos + 1) % n;
+                host.get()[pos] = S::nan();
+            }
+        }
+        data = host.get();
+    }
+    timeline.add("input", d0);
 
-        cl_int err = CL_SUCCESS;
-        cl_context_properties props[] = { CL_CONTEXT_PLATFORM, (cl_context_properties)chosen_platform, 0 };
-        cl_context ctx = clCreateContext(props, 1, &chosen_device, nullptr, nullptr, &err);
-        check(err, "clCreateContext");
-        cl_command_queue q = clCreateCommandQueue(ctx, chosen_device, CL_QUEUE_PROFILING_ENABLE, &err);
-        check(err, "clCreateCommandQueue");
-
-        // Load kernel source (try cwd, exe dir, then src/)
-        std::string kernel_path = resolve_kernel_path();
-        std::string src = load_text_file(kernel_path);
-        const char* src_ptr = src.c_str();
-        size_t src_len = src.size();
-        cl_program prog = clCreateProgramWithSource(ctx, 1, &src_ptr, &src_len, &err);
-        check(err, "clCreateProgramWithSource");
-
-        bool can_use_wg_reduce = is_opencl_c_ge_20(chosen_device);
-        std::string build_opts;
-        // Decide variant
-        auto tolower_str = [](std::string s){ for(char& c: s) c = (char)std::tolower((unsigned char)c); return s; };
-        std::string var = tolower_str(opt.variant);
-        bool use_wg = false;
-        if (var == "auto") {
-            use_wg = can_use_wg_reduce;
-        } else if (var == "wg" || var == "ocl20" || var == "cl2" || var == "cl20") {
-            if (!can_use_wg_reduce) {
-                std::fprintf(stderr, "Requested variant 'wg' requires OpenCL C 2.0 support.\n");
-                return 1;
+    const Op op = parse_op(opt.op);
+    if (multi) {
+        for (size_t i = 0; i < multi->device_count(); ++i) {
+            tune_launch(opt, multi->engine(i), DTypeTraits<T>::dtype, op, nullptr, n / multi->device_count());
+        }
+    } else if (!opt.argmax) {
+        tune_launch(opt, engine, DTypeTraits<T>::dtype, op, data, n);
+    }
+    T gpu_val = T();
+    T gpu_val2 = T(); // max of Op::MinMax
+    ArgMax<T> gpu_arg;
+    bool streamed = opt.stream;
+    // One reduction of the whole input along the selected path
+    auto once = [&]() {
+        if (multi) {
+            T out[2] = {T(), T()};
+            multi->reduce_host(DTypeTraits<T>::dtype, op, data, n, out);
+            gpu_val = out[0];
+            gpu_val2 = out[1];
+        } else if (opt.argmax) {
+            gpu_arg = engine.argmax(data, n);
+            gpu_val = gpu_arg.value;
+        } else if (opt.stream || opt.hybrid || file) {
+            T out[2] = {T(), T()};
+            if (opt.hybrid) {
+                engine.reduce_hybrid(DTypeTraits<T>::dtype, op, data, n, out);
+            } else if (opt.stream) {
+                engine.reduce_stream(DTypeTraits<T>::dtype, op, data, n, out);
+            } else {
+                streamed = !engine.reduce_mapped(DTypeTraits<T>::dtype, op, data, n, out);
             }
-            use_wg = true;
-        } else if (var == "local" || var == "ocl12" || var == "cl1.2" || var == "cl12") {
-            use_wg = false;
+            gpu_val = out[0];
+            gpu_val2 = out[1];
+        } else if (op == Op::Min) {
+            gpu_val = engine.min(data, n);
+        } else if (op == Op::Sum) {
+            gpu_val = engine.sum(data, n);
+        } else if (op == Op::MinMax) {
+            const MinMax<T> mm = engine.minmax(data, n);
+            gpu_val = mm.min;
+            gpu_val2 = mm.max;
         } else {
-            std::fprintf(stderr, "Unknown --variant value: %s\n", opt.variant.c_str());
-            return 1;
-        }
-        if (use_wg) build_opts = "-cl-std=CL2.0 -DUSE_WG_REDUCE=1"; else build_opts = "-cl-std=CL1.2";
-        err = clBuildProgram(prog, 1, &chosen_device, build_opts.c_str(), nullptr, nullptr);
-        if (err != CL_SUCCESS) {
-            size_t log_sz = 0;
-            clGetProgramBuildInfo(prog, chosen_device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &log_sz);
-            std::string log(log_sz, '\0');
-            clGetProgramBuildInfo(prog, chosen_device, CL_PROGRAM_BUILD_LOG, log_sz, log.data(), nullptr);
-            std::fprintf(stderr, "Build failed. Options: %s\n%s\n", build_opts.c_str(), log.c_str());
-            return 1;
-        }
-
-        cl_kernel krn = clCreateKernel(prog, "reduce_max_stage", &err);
-        check(err, "clCreateKernel(reduce_max_stage)");
-
-        // Buffers
-        const size_t n = data.size();
-        cl_mem bufA = clCreateBuffer(ctx, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(float) * n, data.data(), &err);
-        check(err, "clCreateBuffer(A)");
-        cl_mem bufB = clCreateBuffer(ctx, CL_MEM_READ_WRITE, sizeof(float) * n, nullptr, &err);
-        check(err, "clCreateBuffer(B)");
-
-        // Reduction loop
-        const int wg = opt.wg; // 128 or 256 are good starting points on Intel iGPU
-        const int ITEMS_PER_THREAD = 8; // tuning knob; 8–16 works well typically
-        size_t in_count = n;
-        bool use_A_as_input = true;
-        uint64_t total_kernel_ns = 0;
-        int pass_count = 0;
-
-        auto launch_pass = [&](size_t count, cl_mem in_buf, cl_mem out_buf) -> size_t {
-            // determine number of groups for this pass
-            size_t groups = (count + (size_t)wg * ITEMS_PER_THREAD - 1) / ((size_t)wg * ITEMS_PER_THREAD);
-            if (groups == 0) groups = 1;
-            if ((int)groups > opt.groups_max) groups = (size_t)opt.groups_max;
-            const size_t global = groups * (size_t)wg;
-
-            cl_int e = 0;
-            if (use_wg) {
-                e = clSetKernelArg(krn, 0, sizeof(cl_mem), &in_buf);
-                e |= clSetKernelArg(krn, 1, sizeof(cl_mem), &out_buf);
-                cl_uint n_arg = (cl_uint)count;
-                e |= clSetKernelArg(krn, 2, sizeof(cl_uint), &n_arg);
-                check(e, "clSetKernelArg(wg)");
+            gpu_val = engine.max(data, n);
+        }
+    };
+    // Timing of the call just made; the devices of --devices run concurrently
+    auto stats = [&]() {
+        if (!multi) return engine.last_run();
+        RunStats r;
+        for (const MultiDeviceEngine::Share& sh : multi->last_shares()) {
+            r.kernel_ns = std::max(r.kernel_ns, sh.stats.kernel_ns);
+            r.passes += sh.stats.passes;
+            r.nan_count += sh.stats.nan_count;
+        }
+        r.wall_ns = multi->last_wall_ns();
+        return r;
+    };
+    // Without --bench, one warm-up run still measures each device or
+    // calibrates the hybrid split (unless fixed or already stored)
+    if (!opt.bench && (multi || opt.hybrid)) once();
+    auto detail = [&]() {
+        std::vector<RunStats> v;
+        if (!multi) v.push_back(engine.last_run());
+        else for (const MultiDeviceEngine::Share& sh : multi->last_shares()) v.push_back(sh.stats);
+        return v;
+    };
+    const Samples samples = repeat(opt, once, stats, detail);
+    if (file && opt.verbose) {
+        std::printf("Input: %s, %zu %s elements from byte %zu (%s)\n", file->path().c_str(), n, dtype_name(DTypeTraits<T>::dtype),
+                    opt.input_offset, opt.argmax || multi ? host_mem_name(engine.host_mem()) : streamed ? "streamed" : "pages wrapped in place");
+    }
+
+    // CPU verification with the threaded host reduction (first occurrence
+    // wins, matching the kernel's tie-break), with the NaN policy applied to
+    // the max/min reference. Integer sums wrap like the kernel; floating-point
+    // sums are compensated in double.
+    using K = decltype(S::key(T()));
+    const DType dt = DTypeTraits<T>::dtype;
+    const auto ref_t0 = std::chrono::steady_clock::now();
+    T ref_mm[2] = {DTypeTraits<T>::highest(), DTypeTraits<T>::lowest()};
+    cpu_reduce(dt, Op::MinMax, data, n, ref_mm, opt.threads);
+    const NanPolicy policy = engine.nan_policy();
+    const uint64_t cpu_nans = cpu_apply_nan_policy(dt, Op::MinMax, policy, data, n, ref_mm, opt.threads);
+    T ref_sum = T();
+    if (op == Op::Sum) cpu_reduce(dt, Op::Sum, data, n, &ref_sum, opt.threads);
+    T ref_arg = T();
+    const uint64_t cpu_idx = opt.argmax ? cpu_argmax(dt, data, n, &ref_arg, opt.threads) : ARGMAX_NONE;
+    const double ref_ms = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - ref_t0).count() / 1.0e6;
+    const K cpu_min = S::key(ref_mm[0]);
+    const K cpu_max = S::key(ref_mm[1]);
+    const K cpu_sum = S::key(ref_sum);
+    timeline.add("cpu reference", ref_t0);
+    if (opt.verbose) {
+        std::printf("CPU reference: %.3f ms (%u threads, %s)\n", ref_ms, opt.threads ? opt.threads : cpu_default_threads(), cpu_simd_name());
+    }
+    const bool counted = policy == NanPolicy::Count && op != Op::Sum && dtype_is_float(dt);
+
+    // Values to compare: one per result of the op
+    struct Check { const char* what; K gpu; K cpu; };
+    std::vector<Check> checks;
+    if (op == Op::MinMax) {
+        checks.push_back(Check{ "min", S::key(gpu_val), cpu_min });
+        checks.push_back(Check{ "max", S::key(gpu_val2), cpu_max });
+    } else {
+        checks.push_back(Check{ op_name(op), S::key(gpu_val), op == Op::Min ? cpu_min : op == Op::Sum ? cpu_sum : cpu_max });
+    }
+
+    if (opt.verbose) {
+        const char* who = engine.backend() == Backend::Cpu ? "Backend" : "GPU";
+        for (const Check& c : checks) {
+            if (opt.argmax) {
+                std::printf("%s max: %s at index %llu\n", who, format_value(c.gpu).c_str(), (unsigned long long)gpu_arg.index);
+                std::printf("CPU max: %s at index %llu\n", format_value(c.cpu).c_str(), (unsigned long long)cpu_idx);
             } else {
-                e = clSetKernelArg(krn, 0, sizeof(cl_mem), &in_buf);
-                e |= clSetKernelArg(krn, 1, sizeof(cl_mem), &out_buf);
-                cl_uint n_arg = (cl_uint)count;
-                e |= clSetKernelArg(krn, 2, sizeof(cl_uint), &n_arg);
-                // local memory scratch: one float per work-item
-                e |= clSetKernelArg(krn, 3, sizeof(float) * (size_t)wg, nullptr);
-                check(e, "clSetKernelArg(local)");
+                std::printf("%s %s: %s\n", who, c.what, format_value(c.gpu).c_str());
+                std::printf("CPU %s: %s\n", c.what, format_value(c.cpu).c_str());
             }
+        }
+        if (counted) {
+            std::printf("%s NaNs: %llu\n", who, (unsigned long long)stats().nan_count);
+            std::printf("CPU NaNs: %llu\n", (unsigned long long)cpu_nans);
+        }
+    }
+    // max and min select an input element, so they must match exactly (see
+    // same_value()); sums allow a rounding error relative to n * max|x|
+    const double max_abs = std::max(std::abs((double)cpu_min), std::abs((double)cpu_max));
+    const double tol = 64.0 * (double)std::numeric_limits<K>::epsilon() * (double)n * max_abs;
+    for (const Check& c : checks) {
+        const double diff = std::abs((double)c.gpu - (double)c.cpu);
+        const bool rounded = op == Op::Sum && dtype_is_float(dt);
+        if (!same_value(c.gpu, c.cpu) && !(rounded && diff <= tol)) {
+            std::fprintf(stderr, "Mismatch detected (%s): GPU %s, CPU %s\n", c.what, format_value(c.gpu).c_str(), format_value(c.cpu).c_str());
+            return 2;
+        }
+    }
+    if (counted && stats().nan_count != cpu_nans) {
+        std::fprintf(stderr, "NaN count mismatch detected: GPU %llu, CPU %llu\n", (unsigned long long)stats().nan_count,
+                     (unsigned long long)cpu_nans);
+        return 2;
+    }
+    if (opt.argmax && gpu_arg.index != cpu_idx) {
+        std::fprintf(stderr, "Index mismatch detected: GPU %llu, CPU %llu\n",
+                     (unsigned long long)gpu_arg.index, (unsigned long long)cpu_idx);
+        return 2;
+    } else if (opt.verbose) {
+        std::printf("Match.\n");
+    }
 
-            const size_t lsize = (size_t)wg;
-            cl_event evt = nullptr;
-            e = clEnqueueNDRangeKernel(q, krn, 1, nullptr, &global, &lsize, 0, nullptr, &evt);
-            check(e, "clEnqueueNDRangeKernel");
-            check(clWaitForEvents(1, &evt), "clWaitForEvents");
-            cl_ulong t0 = 0, t1 = 0;
-            check(clGetEventProfilingInfo(evt, CL_PROFILING_COMMAND_START, sizeof(t0), &t0, nullptr), "clGetEventProfilingInfo(start)");
-            check(clGetEventProfilingInfo(evt, CL_PROFILING_COMMAND_END, sizeof(t1), &t1, nullptr), "clGetEventProfilingInfo(end)");
-            if (t1 > t0) total_kernel_ns += (uint64_t)(t1 - t0);
-            ++pass_count;
-            clReleaseEvent(evt);
-            return groups;
-        };
+    // Report GPU kernel timing (sum of all passes) and end-to-end wall time
+    // (argmax and minmax always run the local-memory pair kernels)
+    const char* vstr = multi ? "multi" : engine.backend() == Backend::Cpu ? "cpu" : opt.hybrid ? "hybrid" : opt.argmax ? "argmax" : streamed ? "stream" : op == Op::MinMax ? "local" : variant_name(engine.variant());
+    const bool summary = opt.bench || opt.json;
+    if (!summary || (opt.verbose && !opt.csv && !opt.json)) {
+        if (multi) report_multi(opt, *multi, n, op, DTypeTraits<T>::dtype);
+        else report(opt, engine, n, vstr, op, DTypeTraits<T>::dtype, 1);
+    }
+    if (summary) report_bench(opt, multi ? multi->engine(0) : engine, samples, n, vstr, op, DTypeTraits<T>::dtype, stats().passes);
+    if (opt.timings && opt.verbose && !opt.csv && !opt.json) report_timings(samples);
+    if (!opt.trace.empty()) write_trace(opt, samples);
+    return 0;
+}
+
+static int dispatch(const Options& opt, FindMaxEngine& engine, MultiDeviceEngine* multi) {
+    switch (engine.dtype()) {
+        case DType::Int32: return run<int32_t>(opt, engine, multi);
+        case DType::UInt32: return run<uint32_t>(opt, engine, multi);
+        case DType::Int64: return run<int64_t>(opt, engine, multi);
+        case DType::Half: return run<half_t>(opt, engine, multi);
+        case DType::Double: return run<double>(opt, engine, multi);
+        default: return run<float>(opt, engine, multi);
+    }
+}
+
+static void print_devices() {
+    const std::vector<GpuDevice> gpus = list_gpu_devices();
+    if (gpus.empty()) std::printf("No OpenCL GPU device found.\n");
+    for (size_t i = 0; i < gpus.size(); ++i) {
+        cl_ulong mem = 0;
+        clGetDeviceInfo(gpus[i].device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(mem), &mem, nullptr);
+        std::printf("%zu: %s (%s), %.0f MiB\n", i, get_device_string(gpus[i].device, CL_DEVICE_NAME).c_str(),
+                    get_device_string(gpus[i].device, CL_DEVICE_VENDOR).c_str(), (double)mem / (1024.0 * 1024.0));
+    }
+}
 
-        while (in_count > 1) {
-            size_t out_count = launch_pass(in_count, use_A_as_input ? bufA : bufB, use_A_as_input ? bufB : bufA);
-            in_count = out_count;
-            use_A_as_input = !use_A_as_input;
+int main(int argc, char** argv) {
+    try {
+        Options opt = parse_args(argc, argv);
+        if (opt.list_devices) {
+            print_devices();
+            return 0;
         }
 
-        // Read result back from the last output buffer
-        float gpu_max = -std::numeric_limits<float>::infinity();
-        cl_mem result_buf = use_A_as_input ? bufA : bufB; // last output buffer
-        check(clEnqueueReadBuffer(q, result_buf, CL_TRUE, 0, sizeof(float), &gpu_max, 0, nullptr, nullptr), "clEnqueueReadBuffer(result)");
+        const EngineOptions eopt = engine_options(opt);
 
-        // CPU verification
-        float cpu_max = -std::numeric_limits<float>::infinity();
-        for (float v : data) cpu_max = std::max(cpu_max, v);
+        if (!opt.devices.empty()) {
+            const auto s0 = std::chrono::steady_clock::now();
+            MultiDeviceEngine multi(eopt, parse_device_list(opt.devices));
+            timeline.add("engine setup", s0);
+            if (opt.verbose) {
+                for (size_t i = 0; i < multi.device_count(); ++i) {
+                    const FindMaxEngine& e = multi.engine(i);
+                    std::printf("Using device %zu: %s (%s), build %.3f ms (cache %s)\n", i, e.device_name().c_str(),
+                                e.device_vendor().c_str(), e.build_info().build_ms, cache_status(e.build_info()));
+                }
+            }
+            return dispatch(opt, multi.engine(0), &multi);
+        }
+
+        const auto s0 = std::chrono::steady_clock::now();
+        FindMaxEngine engine(eopt);
+        timeline.add("engine setup", s0);
 
+        const ProgramBuild& built = engine.build_info();
         if (opt.verbose) {
-            std::printf("GPU max: %.6f\n", gpu_max);
-            std::printf("CPU max: %.6f\n", cpu_max);
+            if (engine.backend() == Backend::Cpu && opt.device != "cpu") std::printf("No OpenCL GPU device found; using the CPU backend.\n");
+            std::printf("Using device: %s (%s)\n", engine.device_name().c_str(), engine.device_vendor().c_str());
+            if (engine.backend() == Backend::Gpu) {
+                std::printf("Program build: %.3f ms (cache %s, dtype %s%s)\n", built.build_ms, cache_status(built), dtype_name(engine.dtype()),
+                            engine.specialized() ? ", specialized" : "");
+            }
         }
-        const float diff = std::abs(gpu_max - cpu_max);
-        if (diff > 1e-4f) {
-            std::fprintf(stderr, "Mismatch detected: |GPU-CPU| = %g\n", diff);
-            return 2;
-        } else if (opt.verbose) {
-            std::printf("Match.\n");
-        }
-
-        // Report GPU kernel timing (sum of all passes)
-        const double kernel_ms = (double)total_kernel_ns / 1.0e6;
-        if (opt.csv) {
-            // CSV: size,variant,kernel_ms,passes,wg,items_per_thread
-            const char* vstr = use_wg ? "wg" : "local";
-            std::printf("%zu,%s,%.6f,%d,%d,%d\n", n, vstr, kernel_ms, pass_count, wg, ITEMS_PER_THREAD);
-        } else if (opt.verbose) {
-            std::printf("Kernel passes: %d\n", pass_count);
-            std::printf("Total kernel time: %.6f ms\n", kernel_ms);
-        }
-
-        // Cleanup
-        clReleaseMemObject(bufA);
-        clReleaseMemObject(bufB);
-        clReleaseKernel(krn);
-        clReleaseProgram(prog);
-        clReleaseCommandQueue(q);
-        clReleaseContext(ctx);
-        return 0;
+
+        return dispatch(opt, engine, nullptr);
     } catch (const std::exception& e) {
         std::fprintf(stderr, "Error: %s\n", e.what());
         return 1;
@@ -0,0 +1,81 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace findmax {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) : path_(path) {
+    HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (f == INVALID_HANDLE_VALUE) throw std::runtime_error("Failed to open file: " + path);
+    file_ = f;
+    LARGE_INTEGER len;
+    if (!GetFileSizeEx(f, &len)) {
+        CloseHandle(f);
+        throw std::runtime_error("Failed to query size of file: " + path);
+    }
+    size_ = (size_t)len.QuadPart;
+    if (size_ == 0) return;
+    HANDLE m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m) {
+        CloseHandle(f);
+        throw std::runtime_error("Failed to map file: " + path);
+    }
+    mapping_ = m;
+    data_ = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    if (!data_) {
+        CloseHandle(m);
+        CloseHandle(f);
+        throw std::runtime_error("Failed to map file: " + path);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (data_) UnmapViewOfFile(data_);
+    if (mapping_) CloseHandle((HANDLE)mapping_);
+    if (file_) CloseHandle((HANDLE)file_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) : path_(path) {
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) throw std::runtime_error("Failed to open file: " + path);
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) {
+        ::close(fd_);
+        throw std::runtime_error("Failed to query size of file: " + path);
+    }
+    size_ = (size_t)st.st_size;
+    if (size_ == 0) return;
+    void* p = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED) {
+        ::close(fd_);
+        throw std::runtime_error("Failed to map file: " + path);
+    }
+    // One front-to-back pass by the device or the CPU check
+    ::madvise(p, size_, MADV_SEQUENTIAL);
+    data_ = p;
+}
+
+MappedFile::~MappedFile() {
+    if (data_) ::munmap(data_, size_);
+    if (fd_ >= 0) ::close(fd_);
+}
+
+#endif
+
+} // namespace findmax
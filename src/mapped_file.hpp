@@ -0,0 +1,38 @@
+// Read-only memory mapping of a raw binary file
+// - mmap on POSIX, CreateFileMapping/MapViewOfFile on Windows
+// - pages are faulted in on first touch, so opening a large file is cheap
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace findmax {
+
+class MappedFile {
+public:
+    // Throws std::runtime_error when the file cannot be opened or mapped.
+    // An empty file maps to data() == nullptr, size() == 0.
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Start of the mapping (page aligned) and its length in bytes
+    const void* data() const { return data_; }
+    size_t size() const { return size_; }
+    const std::string& path() const { return path_; }
+
+private:
+    std::string path_;
+    void* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;    // HANDLE
+    void* mapping_ = nullptr; // HANDLE
+#else
+    int fd_ = -1;
+#endif
+};
+
+} // namespace findmax
@@ -0,0 +1,128 @@
+#include "multi_device.hpp"
+#include "cpu_reduce.hpp"
+#include "ocl_utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <future>
+#include <stdexcept>
+
+namespace findmax {
+
+std::vector<int> parse_device_list(const std::string& spec) {
+    std::vector<int> out;
+    if (spec.empty() || spec == "all") return out;
+    size_t pos = 0;
+    while (pos <= spec.size()) {
+        const size_t comma = std::min(spec.find(',', pos), spec.size());
+        const std::string item = spec.substr(pos, comma - pos);
+        char* end = nullptr;
+        const long v = std::strtol(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || v < 0) throw std::runtime_error("Bad --devices entry: '" + item + "' in " + spec);
+        if (std::find(out.begin(), out.end(), (int)v) == out.end()) out.push_back((int)v);
+        pos = comma + 1;
+    }
+    return out;
+}
+
+MultiDeviceEngine::MultiDeviceEngine(const EngineOptions& opt, const std::vector<int>& devices) {
+    if (parse_host_mem(opt.host_mem) == HostMem::Svm) {
+        throw std::runtime_error("--devices needs --host-mem copy or zero-copy");
+    }
+    std::vector<int> indices = devices;
+    if (indices.empty()) {
+        const size_t count = list_gpu_devices().size();
+        if (count == 0) throw std::runtime_error("No OpenCL GPU device found.");
+        for (size_t i = 0; i < count; ++i) indices.push_back((int)i);
+    }
+    for (int index : indices) {
+        EngineOptions o = opt;
+        o.device = "gpu";
+        o.gpu_index = index;
+        engines_.emplace_back(new FindMaxEngine(o));
+    }
+    rate_.assign(engines_.size(), 0.0);
+    shares_.resize(engines_.size());
+}
+
+void MultiDeviceEngine::reduce_host(DType t, Op op, const void* data, size_t n, void* result) {
+    if (n == 0) return;
+    const size_t k = engines_.size();
+    const size_t esize = dtype_size(t);
+    const size_t nres = op == Op::MinMax ? 2 : 1;
+
+    // Shares proportional to the measured rates (even until all are known),
+    // ending on page boundaries; the last device takes the remainder
+    const bool measured = std::all_of(rate_.begin(), rate_.end(), [](double r) { return r > 0.0; });
+    double total_rate = 0.0;
+    for (double r : rate_) total_rate += measured ? r : 1.0;
+    const size_t align = std::max<size_t>(1, HOST_ALIGNMENT / esize);
+    size_t offset = 0;
+    for (size_t i = 0; i < k; ++i) {
+        size_t elems = n - offset;
+        if (i + 1 < k) {
+            const double frac = (measured ? rate_[i] : 1.0) / total_rate;
+            elems = std::min(elems, (size_t)((double)n * frac) / align * align);
+        }
+        shares_[i] = Share();
+        shares_[i].offset = offset;
+        shares_[i].elems = elems;
+        offset += elems;
+    }
+
+    // Enqueue every share without waiting, then collect them all
+    const auto t0 = std::chrono::steady_clock::now();
+    std::vector<char> partials(k * nres * esize);
+    std::vector<std::promise<void>> done(k);
+    std::vector<std::future<void>> pending;
+    std::exception_ptr err;
+    for (size_t i = 0; i < k && !err; ++i) {
+        Share& s = shares_[i];
+        if (s.elems == 0) continue;
+        std::promise<void>* p = &done[i];
+        try {
+            engines_[i]->reduce_host_async(t, op, static_cast<const char*>(data) + s.offset * esize, s.elems,
+                                           partials.data() + i * nres * esize,
+                                           [p, &s](const RunStats& stats, std::exception_ptr e) {
+                                               s.stats = stats;
+                                               if (e) p->set_exception(e);
+                                               else p->set_value();
+                                           });
+            pending.push_back(p->get_future());
+        } catch (...) {
+            err = std::current_exception();
+        }
+    }
+    for (std::future<void>& f : pending) {
+        try {
+            f.get();
+        } catch (...) {
+            if (!err) err = std::current_exception();
+        }
+    }
+    if (err) std::rethrow_exception(err);
+
+    // Merge the partials of the devices that had work
+    std::vector<char> used;
+    size_t count = 0;
+    for (size_t i = 0; i < k; ++i) {
+        if (shares_[i].elems == 0) continue;
+        used.insert(used.end(), partials.begin() + (std::ptrdiff_t)(i * nres * esize),
+                    partials.begin() + (std::ptrdiff_t)((i + 1) * nres * esize));
+        ++count;
+    }
+    cpu_merge_partials(t, op, used.data(), count, result, engines_[0]->nan_policy());
+    wall_ns_ = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+
+    // Throughput of each device, damped across calls
+    for (size_t i = 0; i < k; ++i) {
+        const Share& s = shares_[i];
+        if (s.elems == 0 || s.stats.wall_ns == 0) continue;
+        const double r = (double)s.elems / (double)s.stats.wall_ns;
+        rate_[i] = rate_[i] > 0.0 ? 0.5 * (rate_[i] + r) : r;
+    }
+}
+
+} // namespace findmax
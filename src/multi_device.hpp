@@ -0,0 +1,61 @@
+// Reductions fanned out over several GPUs
+// - one FindMaxEngine (context, queue, programs) per selected device
+// - the input is split in proportion to each device's measured throughput
+// - the shares run concurrently and their partial results merge on the host
+
+#pragma once
+
+#include "find_max.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace findmax {
+
+// "all" (or empty) selects every GPU; otherwise comma-separated
+// list_gpu_devices() indices such as "0,2"
+std::vector<int> parse_device_list(const std::string& spec);
+
+class MultiDeviceEngine {
+public:
+    // One engine per list_gpu_devices() index in devices (every GPU when
+    // empty), all built from opt. Throws when there is no GPU, an index is
+    // out of range, or host_mem is svm (SVM memory belongs to one context).
+    explicit MultiDeviceEngine(const EngineOptions& opt, const std::vector<int>& devices = std::vector<int>());
+    MultiDeviceEngine(const MultiDeviceEngine&) = delete;
+    MultiDeviceEngine& operator=(const MultiDeviceEngine&) = delete;
+
+    template <typename T>
+    typename DTypeTraits<T>::value_type max(const T* data, size_t n) {
+        T out = DTypeTraits<T>::lowest();
+        reduce_host(DTypeTraits<T>::dtype, Op::Max, data, n, &out);
+        return out;
+    }
+    // Type-erased form: result as in FindMaxEngine::reduce_host(). The first
+    // call splits evenly; later calls follow the throughput of the last ones.
+    void reduce_host(DType t, Op op, const void* data, size_t n, void* result);
+
+    // Share of the input each device reduced in the last call
+    struct Share {
+        size_t offset = 0;
+        size_t elems = 0;
+        RunStats stats; // that device's chain: wall_ns is enqueue to result, nan_count its NaNs
+    };
+    const std::vector<Share>& last_shares() const { return shares_; }
+    uint64_t last_wall_ns() const { return wall_ns_; } // whole fan-out and merge
+
+    size_t device_count() const { return engines_.size(); }
+    FindMaxEngine& engine(size_t i) { return *engines_[i]; }
+    const FindMaxEngine& engine(size_t i) const { return *engines_[i]; }
+
+private:
+    std::vector<std::unique_ptr<FindMaxEngine>> engines_;
+    std::vector<double> rate_; // elements per ns of each device; 0 until measured
+    std::vector<Share> shares_;
+    uint64_t wall_ns_ = 0;
+};
+
+} // namespace findmax
@@ -0,0 +1,279 @@
+#include "ocl_utils.hpp"
+
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace findmax {
+
+void check(cl_int err, const char* msg) {
+    if (err != CL_SUCCESS) {
+        throw std::runtime_error(std::string(msg) + " failed with error " + std::to_string(err));
+    }
+}
+
+std::string load_text_file(const std::string& path) {
+    std::ifstream ifs(path, std::ios::in | std::ios::binary);
+    if (!ifs) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    std::string content;
+    ifs.seekg(0, std::ios::end);
+    content.resize(static_cast<size_t>(ifs.tellg()));
+    ifs.seekg(0, std::ios::beg);
+    ifs.read(&content[0], content.size());
+    return content;
+}
+
+bool file_exists(const std::string& path) {
+    std::ifstream f(path, std::ios::in | std::ios::binary);
+    return (bool)f;
+}
+
+bool write_file_atomically(const std::string& path, const void* data, size_t bytes) {
+    // pid plus a per-process counter: no two writers, in one process or
+    // several, ever share a temp file
+    static std::atomic<unsigned> seq{ 0 };
+#ifdef _WIN32
+    const unsigned long pid = (unsigned long)GetCurrentProcessId();
+#else
+    const unsigned long pid = (unsigned long)getpid();
+#endif
+    const std::string tmp = path + ".tmp." + std::to_string(pid) + "." + std::to_string(seq++);
+    bool ok = false;
+    {
+        std::ofstream ofs(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!ofs) return false;
+        ofs.write(static_cast<const char*>(data), (std::streamsize)bytes);
+        ofs.close();
+        ok = !ofs.fail();
+    }
+    std::error_code ec;
+    if (ok) std::filesystem::rename(tmp, path, ec);
+    if (!ok || ec) {
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+std::string get_exe_dir() {
+#ifdef _WIN32
+    char buf[MAX_PATH] = {0};
+    DWORD len = GetModuleFileNameA(nullptr, buf, (DWORD)sizeof(buf));
+    if (len == 0 || len >= sizeof(buf)) return std::string();
+    std::string full(buf, buf + len);
+    size_t pos = full.find_last_of("/\\");
+    if (pos == std::string::npos) return std::string();
+    return full.substr(0, pos);
+#else
+    return std::string();
+#endif
+}
+
+std::string resolve_kernel_path() {
+    // Try current working directory first
+    const char* fname = "kernels.cl";
+    std::vector<std::string> candidates;
+    candidates.emplace_back(fname);
+
+    std::string exedir = get_exe_dir();
+    if (!exedir.empty()) {
+        candidates.emplace_back(exedir + std::string("/") + fname);
+    }
+    // Fallback to typical source layout when running from repo root
+    candidates.emplace_back("src/kernels.cl");
+
+    for (const auto& p : candidates) {
+        if (file_exists(p)) return p;
+    }
+    throw std::runtime_error("Failed to open file: " + std::string(fname));
+}
+
+std::string get_device_string(cl_device_id dev, cl_device_info param) {
+    size_t sz = 0;
+    if (clGetDeviceInfo(dev, param, 0, nullptr, &sz) != CL_SUCCESS || sz == 0) return std::string();
+    std::string s(sz, '\0');
+    if (clGetDeviceInfo(dev, param, sz, &s[0], nullptr) != CL_SUCCESS) return std::string();
+    while (!s.empty() && s.back() == '\0') s.pop_back();
+    return s;
+}
+
+bool is_intel(const char* s) {
+    if (!s) return false;
+    std::string str(s);
+    for (auto& c : str) c = (char)std::tolower((unsigned char)c);
+    return str.find("intel") != std::string::npos;
+}
+
+bool is_opencl_c_ge_20(cl_device_id dev) {
+    // Prefer OpenCL C version query if available; fallback to device version.
+    char buf[256] = {0};
+    cl_int err = clGetDeviceInfo(dev, CL_DEVICE_OPENCL_C_VERSION, sizeof(buf), buf, nullptr);
+    if (err != CL_SUCCESS) {
+        // Fallback
+        err = clGetDeviceInfo(dev, CL_DEVICE_VERSION, sizeof(buf), buf, nullptr);
+        if (err != CL_SUCCESS) return false;
+    }
+    // Format: "OpenCL C 2.0 ..." or "OpenCL 3.0 ..."
+    int major = 0, minor = 0;
+    if (std::sscanf(buf, "OpenCL C %d.%d", &major, &minor) == 2) {
+        return (major > 2) || (major == 2 && minor >= 0);
+    }
+    if (std::sscanf(buf, "OpenCL %d.%d", &major, &minor) == 2) {
+        return (major > 2) || (major == 2 && minor >= 0);
+    }
+    return false;
+}
+
+cl_command_queue create_queue(cl_context ctx, cl_device_id dev, cl_command_queue_properties props, const char* what) {
+    // The 2.0 entry point is missing from 1.x platforms, and the 1.x one is
+    // deprecated from 2.0 on
+    char buf[256] = {0};
+    int major = 1, minor = 0;
+    if (clGetDeviceInfo(dev, CL_DEVICE_VERSION, sizeof(buf), buf, nullptr) == CL_SUCCESS) {
+        std::sscanf(buf, "OpenCL %d.%d", &major, &minor);
+    }
+    cl_int err = CL_SUCCESS;
+    cl_command_queue q = nullptr;
+    if (major >= 2) {
+        const cl_queue_properties list[] = { CL_QUEUE_PROPERTIES, (cl_queue_properties)props, 0 };
+        q = clCreateCommandQueueWithProperties(ctx, dev, list, &err);
+    } else {
+        q = clCreateCommandQueue(ctx, dev, props, &err);
+    }
+    check(err, what);
+    return q;
+}
+
+void* aligned_host_alloc(size_t bytes, size_t alignment) {
+    if (bytes == 0) bytes = alignment;
+#ifdef _WIN32
+    void* p = _aligned_malloc(bytes, alignment);
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, alignment, bytes) != 0) p = nullptr;
+#endif
+    if (!p) throw std::runtime_error("Host allocation of " + std::to_string(bytes) + " bytes failed");
+    return p;
+}
+
+void aligned_host_free(void* p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
+bool has_extension(cl_device_id dev, const char* ext) {
+    // CL_DEVICE_EXTENSIONS is a space-separated list; match whole names only
+    const std::string list = " " + get_device_string(dev, CL_DEVICE_EXTENSIONS) + " ";
+    return list.find(" " + std::string(ext) + " ") != std::string::npos;
+}
+
+std::string json_escape(const std::string& v) {
+    std::string out;
+    for (char c : v) {
+        if (c == '"' || c == '\\') out += '\\';
+        if ((unsigned char)c < 0x20) continue;
+        out += c;
+    }
+    return out;
+}
+
+uint64_t fnv1a64(const std::string& s, uint64_t h) {
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+bool select_gpu_device(cl_platform_id* platform, cl_device_id* device) {
+    cl_uint num_platforms = 0;
+    // No ICD loaded (CL_PLATFORM_NOT_FOUND_KHR) counts as no GPU, so callers can fall back
+    if (clGetPlatformIDs(0, nullptr, &num_platforms) != CL_SUCCESS || num_platforms == 0) return false;
+    std::vector<cl_platform_id> plats(num_platforms);
+    check(clGetPlatformIDs(num_platforms, plats.data(), nullptr), "clGetPlatformIDs(list)");
+
+    cl_platform_id chosen_platform = nullptr;
+    cl_device_id chosen_device = nullptr;
+    for (auto p : plats) {
+        cl_uint num_devices = 0;
+        if (clGetDeviceIDs(p, CL_DEVICE_TYPE_GPU, 0, nullptr, &num_devices) != CL_SUCCESS || num_devices == 0) continue;
+        std::vector<cl_device_id> devs(num_devices);
+        if (clGetDeviceIDs(p, CL_DEVICE_TYPE_GPU, num_devices, devs.data(), nullptr) != CL_SUCCESS) continue;
+        for (auto d : devs) {
+            char vendor[256] = {0};
+            clGetDeviceInfo(d, CL_DEVICE_VENDOR, sizeof(vendor), vendor, nullptr);
+            if (is_intel(vendor)) { chosen_platform = p; chosen_device = d; break; }
+        }
+        if (chosen_device) break;
+    }
+    if (!chosen_device) {
+        // Fallback: first GPU device anywhere
+        for (auto p : plats) {
+            cl_uint num_devices = 0;
+            if (clGetDeviceIDs(p, CL_DEVICE_TYPE_GPU, 0, nullptr, &num_devices) != CL_SUCCESS || num_devices == 0) continue;
+            std::vector<cl_device_id> devs(num_devices);
+            if (clGetDeviceIDs(p, CL_DEVICE_TYPE_GPU, num_devices, devs.data(), nullptr) != CL_SUCCESS) continue;
+            chosen_platform = p; chosen_device = devs[0];
+            break;
+        }
+    }
+    if (!chosen_device) return false;
+    *platform = chosen_platform;
+    *device = chosen_device;
+    return true;
+}
+
+std::vector<GpuDevice> list_gpu_devices() {
+    std::vector<GpuDevice> out;
+    cl_uint num_platforms = 0;
+    if (clGetPlatformIDs(0, nullptr, &num_platforms) != CL_SUCCESS || num_platforms == 0) return out;
+    std::vector<cl_platform_id> plats(num_platforms);
+    check(clGetPlatformIDs(num_platforms, plats.data(), nullptr), "clGetPlatformIDs(list)");
+    for (auto p : plats) {
+        cl_uint num_devices = 0;
+        if (clGetDeviceIDs(p, CL_DEVICE_TYPE_GPU, 0, nullptr, &num_devices) != CL_SUCCESS || num_devices == 0) continue;
+        std::vector<cl_device_id> devs(num_devices);
+        if (clGetDeviceIDs(p, CL_DEVICE_TYPE_GPU, num_devices, devs.data(), nullptr) != CL_SUCCESS) continue;
+        for (auto d : devs) {
+            GpuDevice g;
+            g.platform = p;
+            g.device = d;
+            out.push_back(g);
+        }
+    }
+    return out;
+}
+
+uint64_t event_ns(cl_event e) {
+    cl_ulong t0 = 0, t1 = 0;
+    if (clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_START, sizeof(t0), &t0, nullptr) != CL_SUCCESS ||
+        clGetEventProfilingInfo(e, CL_PROFILING_COMMAND_END, sizeof(t1), &t1, nullptr) != CL_SUCCESS) {
+        return 0;
+    }
+    return t1 > t0 ? (uint64_t)(t1 - t0) : 0;
+}
+
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point t0) {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+}
+
+} // namespace findmax
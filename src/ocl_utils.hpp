@@ -0,0 +1,67 @@
+// Small OpenCL helpers shared by the find_max library and the CLI
+// - error checking, file loading and writing, kernel path resolution
+// - device queries and GPU device selection
+
+#pragma once
+
+#include <CL/cl.h>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace findmax {
+
+// Throws std::runtime_error("<msg> failed with error <err>") on failure.
+void check(cl_int err, const char* msg);
+
+std::string load_text_file(const std::string& path);
+bool file_exists(const std::string& path);
+// Writes bytes to path through a uniquely named temp file and a rename, so
+// readers see the old file or the whole new one. On failure the temp file
+// is removed and false is returned.
+bool write_file_atomically(const std::string& path, const void* data, size_t bytes);
+std::string get_exe_dir();
+
+// Locate kernels.cl: cwd, executable directory, then src/ (repo root).
+std::string resolve_kernel_path();
+
+std::string get_device_string(cl_device_id dev, cl_device_info param);
+bool is_intel(const char* s);
+bool is_opencl_c_ge_20(cl_device_id dev);
+bool has_extension(cl_device_id dev, const char* ext);
+
+// Command queue with props (e.g. CL_QUEUE_PROFILING_ENABLE), created with
+// clCreateCommandQueueWithProperties on OpenCL 2.0+ devices and
+// clCreateCommandQueue before. Throws check(err, what) on failure.
+cl_command_queue create_queue(cl_context ctx, cl_device_id dev, cl_command_queue_properties props, const char* what);
+
+// Aligned host allocation; release with aligned_host_free().
+void* aligned_host_alloc(size_t bytes, size_t alignment);
+void aligned_host_free(void* p);
+
+// START to END of a profiled command in ns; 0 when the counters are unavailable
+uint64_t event_ns(cl_event e);
+// Host time since t0 in ns
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point t0);
+
+// v as the inside of a JSON string: quotes and backslashes escaped, control
+// characters dropped. Used by the trace writer and the CLI's --json output.
+std::string json_escape(const std::string& v);
+
+uint64_t fnv1a64(const std::string& s, uint64_t h = 1469598103934665603ull);
+
+// Pick the first Intel GPU, else the first GPU on any platform.
+// Returns false when no OpenCL GPU device (or no OpenCL platform) exists.
+bool select_gpu_device(cl_platform_id* platform, cl_device_id* device);
+
+struct GpuDevice {
+    cl_platform_id platform = nullptr;
+    cl_device_id device = nullptr;
+};
+
+// Every GPU device of every platform, in platform then device order; the
+// position in this list is the index --devices and EngineOptions::gpu_index use
+std::vector<GpuDevice> list_gpu_devices();
+
+} // namespace findmax
@@ -0,0 +1,101 @@
+#include "program_cache.hpp"
+#include "ocl_utils.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+namespace findmax {
+
+const char* cache_status(const ProgramBuild& b) {
+    return !b.cache_enabled ? "off" : (b.cache_hit ? "hit" : "miss");
+}
+
+std::string default_cache_dir() {
+    const char* env = std::getenv("OCL_FIND_MAX_CACHE_DIR");
+    if (env && *env) return std::string(env);
+    return "ocl_cache";
+}
+
+std::string get_build_log(cl_program prog, cl_device_id dev) {
+    size_t log_sz = 0;
+    clGetProgramBuildInfo(prog, dev, CL_PROGRAM_BUILD_LOG, 0, nullptr, &log_sz);
+    std::string log(log_sz, '\0');
+    if (log_sz) clGetProgramBuildInfo(prog, dev, CL_PROGRAM_BUILD_LOG, log_sz, &log[0], nullptr);
+    return log;
+}
+
+static std::string cache_file_for(cl_device_id dev, const std::string& src,
+                                  const std::string& build_opts, const std::string& cache_dir) {
+    uint64_t h = fnv1a64(src);
+    h = fnv1a64(std::string(1, '\0') + get_device_string(dev, CL_DEVICE_NAME), h);
+    h = fnv1a64(std::string(1, '\0') + get_device_string(dev, CL_DEVICE_VERSION), h);
+    h = fnv1a64(std::string(1, '\0') + get_device_string(dev, CL_DRIVER_VERSION), h);
+    h = fnv1a64(std::string(1, '\0') + build_opts, h);
+    char name[32] = {0};
+    std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)h);
+    return cache_dir + "/" + name;
+}
+
+static void save_binary(cl_program prog, const std::string& cache_dir, const std::string& cache_file) {
+    size_t bin_len = 0;
+    if (clGetProgramInfo(prog, CL_PROGRAM_BINARY_SIZES, sizeof(bin_len), &bin_len, nullptr) != CL_SUCCESS || bin_len == 0) return;
+    std::vector<unsigned char> bin(bin_len);
+    unsigned char* bin_ptr = bin.data();
+    if (clGetProgramInfo(prog, CL_PROGRAM_BINARIES, sizeof(bin_ptr), &bin_ptr, nullptr) != CL_SUCCESS) return;
+
+    // Concurrent runs never see a partial entry; a failed write just leaves none
+    std::error_code ec;
+    std::filesystem::create_directories(cache_dir, ec);
+    write_file_atomically(cache_file, bin.data(), bin.size());
+}
+
+ProgramBuild build_program(cl_context ctx, cl_device_id dev, const std::string& src,
+                           const std::string& build_opts, const std::string& cache_dir) {
+    ProgramBuild out;
+    out.cache_enabled = !cache_dir.empty();
+    const auto t0 = std::chrono::steady_clock::now();
+
+    const std::string cache_file = out.cache_enabled ? cache_file_for(dev, src, build_opts, cache_dir) : std::string();
+
+    cl_int err = CL_SUCCESS;
+    if (out.cache_enabled && file_exists(cache_file)) {
+        std::string bin = load_text_file(cache_file);
+        const unsigned char* bin_ptr = reinterpret_cast<const unsigned char*>(bin.data());
+        const size_t bin_len = bin.size();
+        cl_int bin_status = CL_SUCCESS;
+        cl_program prog = clCreateProgramWithBinary(ctx, 1, &dev, &bin_len, &bin_ptr, &bin_status, &err);
+        if (err == CL_SUCCESS && bin_status == CL_SUCCESS &&
+            clBuildProgram(prog, 1, &dev, build_opts.c_str(), nullptr, nullptr) == CL_SUCCESS) {
+            out.prog = prog;
+            out.cache_hit = true;
+        } else if (prog) {
+            clReleaseProgram(prog); // stale or foreign binary: rebuild from source
+        }
+    }
+
+    if (!out.prog) {
+        const char* src_ptr = src.c_str();
+        size_t src_len = src.size();
+        cl_program prog = clCreateProgramWithSource(ctx, 1, &src_ptr, &src_len, &err);
+        check(err, "clCreateProgramWithSource");
+        err = clBuildProgram(prog, 1, &dev, build_opts.c_str(), nullptr, nullptr);
+        if (err != CL_SUCCESS) {
+            std::string log = get_build_log(prog, dev);
+            clReleaseProgram(prog);
+            throw std::runtime_error("Build failed. Options: " + build_opts + "\n" + log);
+        }
+        out.prog = prog;
+        if (out.cache_enabled) save_binary(prog, cache_dir, cache_file);
+    }
+
+    const auto t1 = std::chrono::steady_clock::now();
+    out.build_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    return out;
+}
+
+} // namespace findmax
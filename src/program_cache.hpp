@@ -0,0 +1,33 @@
+// Program build with an on-disk cache of device binaries
+// - cache entries are keyed by kernel source, device, driver and build options
+// - stale or rejected binaries fall back to a source build
+
+#pragma once
+
+#include <CL/cl.h>
+#include <string>
+
+namespace findmax {
+
+struct ProgramBuild {
+    cl_program prog = nullptr;
+    bool cache_hit = false;
+    bool cache_enabled = false;
+    double build_ms = 0.0; // create + build, wall clock
+};
+
+// "off", "hit" or "miss"
+const char* cache_status(const ProgramBuild& b);
+
+// OCL_FIND_MAX_CACHE_DIR if set, else ./ocl_cache
+std::string default_cache_dir();
+
+std::string get_build_log(cl_program prog, cl_device_id dev);
+
+// Build the program, reusing device binaries from cache_dir when possible
+// (an empty cache_dir disables the cache). Throws on build failure, with
+// the build log in the message.
+ProgramBuild build_program(cl_context ctx, cl_device_id dev, const std::string& src,
+                           const std::string& build_opts, const std::string& cache_dir);
+
+} // namespace findmax
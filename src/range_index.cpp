@@ -0,0 +1,400 @@
+#include "range_index.hpp"
+#include "cpu_reduce.hpp"
+#include "ocl_utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace findmax {
+
+namespace {
+
+template <typename T>
+void store_identity(Op op, void* out) {
+    const T v = op == Op::Min ? DTypeTraits<T>::highest() : DTypeTraits<T>::lowest();
+    std::memcpy(out, &v, sizeof(v));
+}
+
+// Identity of op (Max or Min) for t, dtype_size(t) bytes
+void identity_of(DType t, Op op, void* out) {
+    switch (t) {
+        case DType::Int32: store_identity<int32_t>(op, out); break;
+        case DType::UInt32: store_identity<uint32_t>(op, out); break;
+        case DType::Int64: store_identity<int64_t>(op, out); break;
+        case DType::Half: store_identity<half_t>(op, out); break;
+        case DType::Double: store_identity<double>(op, out); break;
+        default: store_identity<float>(op, out); break;
+    }
+}
+
+// Smallest power of two >= v, capped at limit (itself a power of two)
+size_t pow2_at_least(size_t v, size_t limit) {
+    size_t p = 1;
+    while (p < v && p < limit) p <<= 1;
+    return p;
+}
+
+} // namespace
+
+RangeMaxIndex::RangeMaxIndex(FindMaxEngine& engine, DType t, Op op, size_t capacity, size_t block)
+    : engine_(engine), t_(t), op_(op), esize_(dtype_size(t)), capacity_(capacity),
+      block_(block == 0 ? DEFAULT_INDEX_BLOCK : block) {
+    setup();
+    if (engine_.backend() == Backend::Cpu) {
+        // Slots never written hold the identity, so no entry needs a fill check
+        std::vector<char> ident(esize_);
+        identity_of(t_, op_, ident.data());
+        host_data_.resize(capacity_ * esize_);
+        host_levels_.resize(index_bytes());
+        for (size_t i = 0; i < capacity_; ++i) std::memcpy(host_data_.data() + i * esize_, ident.data(), esize_);
+        for (size_t i = 0; i < host_levels_.size(); i += esize_) std::memcpy(host_levels_.data() + i, ident.data(), esize_);
+        return;
+    }
+    engine_.kernel(t_, op_, "index_build_level"); // build (and report dtype errors) first
+    create_buffers(true);
+}
+
+RangeMaxIndex::RangeMaxIndex(FindMaxEngine& engine, DType t, Op op, cl_mem buf, size_t n, size_t block)
+    : engine_(engine), t_(t), op_(op), esize_(dtype_size(t)), capacity_(n), block_(block == 0 ? DEFAULT_INDEX_BLOCK : block),
+      static_(true) {
+    const auto t0 = std::chrono::steady_clock::now();
+    if (engine_.backend() == Backend::Cpu) throw std::runtime_error("A range index over a cl_mem buffer needs the GPU backend");
+    setup();
+    size_t bytes = 0;
+    cl_context ctx = nullptr;
+    check(clGetMemObjectInfo(buf, CL_MEM_SIZE, sizeof(bytes), &bytes, nullptr), "clGetMemObjectInfo(CL_MEM_SIZE)");
+    check(clGetMemObjectInfo(buf, CL_MEM_CONTEXT, sizeof(ctx), &ctx, nullptr), "clGetMemObjectInfo(CL_MEM_CONTEXT)");
+    if (ctx != engine_.context()) throw std::runtime_error("Range index buffer belongs to another context");
+    if (bytes < n * esize_) {
+        throw std::runtime_error("Range index buffer holds " + std::to_string(bytes) + " bytes, " + std::to_string(n * esize_) + " needed");
+    }
+    engine_.kernel(t_, op_, "index_build_level");
+    check(clRetainMemObject(buf), "clRetainMemObject");
+    data_ = buf;
+    create_buffers(false);
+    total_ = n;
+    try {
+        Range all;
+        all.hi = capacity_;
+        rebuild(all);
+    } catch (...) {
+        clFinish(engine_.queue());
+        release_events();
+        for (cl_mem m : { data_, levels_, level_off_ }) clReleaseMemObject(m);
+        throw;
+    }
+    finish(t0);
+}
+
+RangeMaxIndex::~RangeMaxIndex() {
+    for (cl_mem m : { data_, levels_, level_off_, ranges_, results_ }) {
+        if (m) clReleaseMemObject(m);
+    }
+}
+
+void RangeMaxIndex::setup() {
+    if (op_ != Op::Max && op_ != Op::Min) throw std::runtime_error("Range index supports ops max and min only.");
+    if (capacity_ == 0) throw std::runtime_error("Range index capacity must be positive");
+    if (block_ < 2 || block_ > std::numeric_limits<cl_uint>::max()) throw std::runtime_error("Range index block must be at least 2");
+    if (!engine_.supports(t_, op_)) {
+        throw std::runtime_error(std::string("Range index: dtype ") + dtype_name(t_) + " is not supported on this device.");
+    }
+    len_.push_back(capacity_);
+    size_t total_levels = 0;
+    while (len_.back() > 1) {
+        off_.push_back(total_levels);
+        len_.push_back((len_.back() + block_ - 1) / block_);
+        total_levels += len_.back();
+    }
+}
+
+void RangeMaxIndex::create_buffers(bool own_data) {
+    const size_t total_levels = index_bytes() / esize_;
+    std::vector<char> ident(esize_);
+    identity_of(t_, op_, ident.data());
+    cl_command_queue q = engine_.queue();
+    try {
+        cl_int err = CL_SUCCESS;
+        if (own_data) {
+            data_ = clCreateBuffer(engine_.context(), CL_MEM_READ_WRITE, capacity_ * esize_, nullptr, &err);
+            check(err, "clCreateBuffer(index data)");
+            check(clEnqueueFillBuffer(q, data_, ident.data(), esize_, 0, capacity_ * esize_, 0, nullptr, nullptr),
+                  "clEnqueueFillBuffer(index data)");
+        }
+        // Never empty, so the query kernel always has a valid levels argument
+        levels_ = clCreateBuffer(engine_.context(), CL_MEM_READ_WRITE, std::max<size_t>(1, total_levels) * esize_, nullptr, &err);
+        check(err, "clCreateBuffer(index levels)");
+        std::vector<cl_ulong> offs(off_.begin(), off_.end());
+        offs.push_back(0);
+        level_off_ = clCreateBuffer(engine_.context(), CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, offs.size() * sizeof(cl_ulong),
+                                    offs.data(), &err);
+        check(err, "clCreateBuffer(index offsets)");
+        if (total_levels > 0) {
+            check(clEnqueueFillBuffer(q, levels_, ident.data(), esize_, 0, total_levels * esize_, 0, nullptr, nullptr),
+                  "clEnqueueFillBuffer(index levels)");
+        }
+        check(clFinish(q), "clFinish");
+    } catch (...) {
+        for (cl_mem m : { data_, levels_, level_off_ }) {
+            if (m) clReleaseMemObject(m);
+        }
+        throw;
+    }
+}
+
+size_t RangeMaxIndex::index_bytes() const {
+    size_t entries = 0;
+    for (size_t k = 1; k < len_.size(); ++k) entries += len_[k];
+    return entries * esize_;
+}
+
+std::vector<RangeMaxIndex::Range> RangeMaxIndex::ring_ranges(uint64_t a, uint64_t b) const {
+    std::vector<Range> out;
+    if (a >= b) return out;
+    const size_t lo = (size_t)(a % capacity_);
+    const size_t len = (size_t)(b - a);
+    Range r;
+    r.lo = lo;
+    r.hi = std::min(capacity_, lo + len);
+    out.push_back(r);
+    if (lo + len > capacity_) {
+        r.lo = 0;
+        r.hi = lo + len - capacity_;
+        out.push_back(r);
+    }
+    return out;
+}
+
+void RangeMaxIndex::host_fold(const char* level, size_t lo, size_t hi, void* result) const {
+    cpu_reduce(t_, op_, level + lo * esize_, hi - lo, result, 1);
+    cpu_apply_nan_policy(t_, op_, engine_.nan_policy(), level + lo * esize_, hi - lo, result, 1);
+}
+
+void RangeMaxIndex::launch(cl_kernel k, size_t groups, size_t local) {
+    const size_t global = groups * local;
+    cl_event evt = nullptr;
+    check(clEnqueueNDRangeKernel(engine_.queue(), k, 1, nullptr, &global, &local, 0, nullptr, &evt), "clEnqueueNDRangeKernel");
+    kernels_.push_back(evt);
+}
+
+// Recompute the entries above ring slots [r.lo, r.hi), level by level
+void RangeMaxIndex::rebuild(Range r) {
+    if (engine_.backend() == Backend::Cpu) {
+        for (size_t k = 0; k + 1 < len_.size(); ++k) {
+            const char* in = k == 0 ? host_data_.data() : host_levels_.data() + off_[k - 1] * esize_;
+            char* out = host_levels_.data() + off_[k] * esize_;
+            const size_t first = r.lo / block_, last = (r.hi - 1) / block_;
+            for (size_t e = first; e <= last; ++e) host_fold(in, e * block_, std::min(len_[k], (e + 1) * block_), out + e * esize_);
+            r.lo = first;
+            r.hi = last + 1;
+        }
+        return;
+    }
+    cl_kernel krn = engine_.kernel(t_, op_, "index_build_level");
+    const size_t local = pow2_at_least(block_, (size_t)engine_.wg());
+    const cl_uint block_arg = (cl_uint)block_;
+    for (size_t k = 0; k + 1 < len_.size(); ++k) {
+        const size_t first = r.lo / block_, last = (r.hi - 1) / block_;
+        const cl_ulong in_off = k == 0 ? 0 : (cl_ulong)off_[k - 1];
+        const cl_ulong in_n = (cl_ulong)len_[k];
+        const cl_ulong out_off = (cl_ulong)off_[k];
+        const cl_ulong first_arg = (cl_ulong)first;
+        cl_int e = clSetKernelArg(krn, 0, sizeof(cl_mem), k == 0 ? &data_ : &levels_);
+        e |= clSetKernelArg(krn, 1, sizeof(cl_ulong), &in_off);
+        e |= clSetKernelArg(krn, 2, sizeof(cl_ulong), &in_n);
+        e |= clSetKernelArg(krn, 3, sizeof(cl_mem), &levels_);
+        e |= clSetKernelArg(krn, 4, sizeof(cl_ulong), &out_off);
+        e |= clSetKernelArg(krn, 5, sizeof(cl_ulong), &first_arg);
+        e |= clSetKernelArg(krn, 6, sizeof(cl_uint), &block_arg);
+        e |= clSetKernelArg(krn, 7, esize_ * local, nullptr);
+        check(e, "clSetKernelArg(index build)");
+        launch(krn, last - first + 1, local);
+        r.lo = first;
+        r.hi = last + 1;
+    }
+}
+
+// Wait for the commands of the call, then time them into stats_
+void RangeMaxIndex::finish(std::chrono::steady_clock::time_point t0) {
+    const cl_int err = clFinish(engine_.queue());
+    RunStats s;
+    s.started = t0;
+    for (cl_event e : kernels_) s.kernel_ns += event_ns(e);
+    for (cl_event e : uploads_) s.upload_ns += event_ns(e);
+    s.passes = (int)kernels_.size();
+    release_events();
+    check(err, "clFinish");
+    s.wall_ns = elapsed_ns(t0);
+    stats_ = s;
+}
+
+void RangeMaxIndex::finish_cpu(std::chrono::steady_clock::time_point t0, int passes) {
+    stats_ = RunStats();
+    stats_.started = t0;
+    stats_.passes = passes;
+    stats_.kernel_ns = stats_.wall_ns = stats_.cpu_ns = elapsed_ns(t0);
+    stats_.gpu_fraction = 0.0;
+}
+
+void RangeMaxIndex::release_events() {
+    for (auto* list : { &kernels_, &uploads_ }) {
+        for (cl_event e : *list) clReleaseEvent(e);
+        list->clear();
+    }
+}
+
+void RangeMaxIndex::append(const void* data, size_t count) {
+    const auto t0 = std::chrono::steady_clock::now();
+    if (static_) throw std::runtime_error("Cannot append to a static range index");
+    // Only the newest capacity elements can still be queried
+    const size_t skip = count > capacity_ ? count - capacity_ : 0;
+    const char* src = static_cast<const char*>(data) + skip * esize_;
+    const std::vector<Range> pieces = ring_ranges(total_ + skip, total_ + count);
+    try {
+        for (const Range& r : pieces) {
+            const size_t bytes = (r.hi - r.lo) * esize_;
+            if (engine_.backend() == Backend::Cpu) {
+                std::memcpy(host_data_.data() + r.lo * esize_, src, bytes);
+            } else {
+                cl_event evt = nullptr;
+                check(clEnqueueWriteBuffer(engine_.queue(), data_, CL_FALSE, r.lo * esize_, bytes, src, 0, nullptr, &evt),
+                      "clEnqueueWriteBuffer(index append)");
+                uploads_.push_back(evt);
+            }
+            src += bytes;
+            rebuild(r);
+        }
+    } catch (...) {
+        if (engine_.backend() == Backend::Gpu) clFinish(engine_.queue());
+        release_events();
+        throw;
+    }
+    total_ += count;
+    if (engine_.backend() == Backend::Gpu) finish(t0);
+    else finish_cpu(t0, levels());
+}
+
+void RangeMaxIndex::host_query(uint64_t a, uint64_t b, void* result) const {
+    identity_of(t_, op_, result);
+    // Same walk as index_query: edge blocks per level, whole blocks one level up
+    std::vector<char> edges;
+    for (const Range& piece : ring_ranges(std::max(a, first()), std::min(b, total_))) {
+        size_t lo = piece.lo, hi = piece.hi;
+        for (size_t k = 0; lo < hi; ++k) {
+            const char* level = k == 0 ? host_data_.data() : host_levels_.data() + off_[k - 1] * esize_;
+            const size_t lo_up = (lo + block_ - 1) / block_, hi_up = hi / block_;
+            auto fold = [&](size_t b0, size_t b1) {
+                if (b0 >= b1) return;
+                edges.resize(edges.size() + esize_);
+                host_fold(level, b0, b1, edges.data() + edges.size() - esize_);
+            };
+            if (k + 1 == len_.size() || lo_up >= hi_up) {
+                fold(lo, hi);
+                break;
+            }
+            fold(lo, lo_up * block_);
+            fold(hi_up * block_, hi);
+            lo = lo_up;
+            hi = hi_up;
+        }
+    }
+    if (!edges.empty()) cpu_merge_partials(t_, op_, edges.data(), edges.size() / esize_, result, engine_.nan_policy());
+}
+
+// Grow the host batch buffers to at least count pairs
+void RangeMaxIndex::reserve_batch(size_t count) {
+    if (count <= batch_cap_) return;
+    const size_t cap = std::max(count, 2 * batch_cap_);
+    for (cl_mem* m : { &ranges_, &results_ }) {
+        if (*m) clReleaseMemObject(*m);
+        *m = nullptr;
+    }
+    batch_cap_ = 0;
+    cl_int err = CL_SUCCESS;
+    ranges_ = clCreateBuffer(engine_.context(), CL_MEM_READ_ONLY, cap * 2 * sizeof(cl_ulong), nullptr, &err);
+    check(err, "clCreateBuffer(index ranges)");
+    results_ = clCreateBuffer(engine_.context(), CL_MEM_WRITE_ONLY, cap * esize_, nullptr, &err);
+    check(err, "clCreateBuffer(index results)");
+    batch_cap_ = cap;
+}
+
+void RangeMaxIndex::launch_query(cl_mem ranges, size_t count, cl_mem results) {
+    cl_kernel krn = engine_.kernel(t_, op_, "index_query");
+    const size_t local = pow2_at_least(2 * block_, (size_t)engine_.wg());
+    const cl_uint num_levels = (cl_uint)levels();
+    const cl_uint block_arg = (cl_uint)block_;
+    const cl_ulong capacity = (cl_ulong)capacity_;
+    const cl_ulong first_arg = (cl_ulong)first();
+    const cl_ulong total = (cl_ulong)total_;
+    cl_int e = clSetKernelArg(krn, 0, sizeof(cl_mem), &data_);
+    e |= clSetKernelArg(krn, 1, sizeof(cl_mem), &levels_);
+    e |= clSetKernelArg(krn, 2, sizeof(cl_mem), &level_off_);
+    e |= clSetKernelArg(krn, 3, sizeof(cl_uint), &num_levels);
+    e |= clSetKernelArg(krn, 4, sizeof(cl_uint), &block_arg);
+    e |= clSetKernelArg(krn, 5, sizeof(cl_ulong), &capacity);
+    e |= clSetKernelArg(krn, 6, sizeof(cl_ulong), &first_arg);
+    e |= clSetKernelArg(krn, 7, sizeof(cl_ulong), &total);
+    e |= clSetKernelArg(krn, 8, sizeof(cl_mem), &ranges);
+    e |= clSetKernelArg(krn, 9, sizeof(cl_mem), &results);
+    e |= clSetKernelArg(krn, 10, esize_ * local, nullptr);
+    check(e, "clSetKernelArg(index query)");
+    launch(krn, count, local);
+}
+
+void RangeMaxIndex::query(uint64_t a, uint64_t b, void* result) {
+    if (a > b || a < first() || b > total_) {
+        throw std::runtime_error("Range index query [" + std::to_string(a) + ", " + std::to_string(b) + ") is outside the held positions [" +
+                                 std::to_string(first()) + ", " + std::to_string(total_) + ")");
+    }
+    if (a == b) return;
+    const uint64_t pair[2] = { a, b };
+    query_batch(pair, 1, result);
+}
+
+void RangeMaxIndex::query_batch(const uint64_t* ranges, size_t count, void* results) {
+    const auto t0 = std::chrono::steady_clock::now();
+    if (count == 0) return;
+    char* out = static_cast<char*>(results);
+    if (engine_.backend() == Backend::Cpu) {
+        for (size_t i = 0; i < count; ++i) host_query(ranges[2 * i], ranges[2 * i + 1], out + i * esize_);
+        finish_cpu(t0, 1);
+        return;
+    }
+    static_assert(sizeof(cl_ulong) == sizeof(uint64_t), "cl_ulong pairs are uploaded as is");
+    cl_command_queue q = engine_.queue();
+    try {
+        reserve_batch(count);
+        cl_event evt = nullptr;
+        check(clEnqueueWriteBuffer(q, ranges_, CL_FALSE, 0, count * 2 * sizeof(cl_ulong), ranges, 0, nullptr, &evt),
+              "clEnqueueWriteBuffer(index ranges)");
+        uploads_.push_back(evt);
+        launch_query(ranges_, count, results_);
+        check(clEnqueueReadBuffer(q, results_, CL_FALSE, 0, count * esize_, out, 0, nullptr, nullptr),
+              "clEnqueueReadBuffer(index results)");
+    } catch (...) {
+        clFinish(q);
+        release_events();
+        throw;
+    }
+    finish(t0);
+}
+
+void RangeMaxIndex::query_batch(cl_mem ranges, size_t count, cl_mem results) {
+    const auto t0 = std::chrono::steady_clock::now();
+    if (engine_.backend() == Backend::Cpu) throw std::runtime_error("Range index queries on cl_mem buffers need the GPU backend");
+    if (count == 0) return;
+    try {
+        launch_query(ranges, count, results);
+    } catch (...) {
+        clFinish(engine_.queue());
+        release_events();
+        throw;
+    }
+    finish(t0);
+}
+
+} // namespace findmax
@@ -0,0 +1,140 @@
+// Device-resident block index for repeated range max (or min) queries
+// - level 0 is a ring buffer holding the last capacity() appended elements;
+//   entry j of level k + 1 is the max of entries [j * block, (j + 1) * block)
+//   of level k, up to a single top entry
+// - append() uploads the new elements and rebuilds only the index entries
+//   whose blocks they touch: one launch per level
+// - query() answers [a, b) in one launch that reads fewer than 2 * block
+//   entries per level, instead of scanning the range; query_batch() answers
+//   many (lo, hi) pairs in one launch, one work-group per pair
+// - a static index is built once over a buffer already on the device and
+//   reads it in place
+// - the CPU backend keeps the same hierarchy in host memory
+
+#pragma once
+
+#include "find_max.hpp"
+
+#include <CL/cl.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace findmax {
+
+constexpr size_t DEFAULT_INDEX_BLOCK = 64; // index entries per block; levels above 0 add about 1 / (block - 1) of the data
+
+class RangeMaxIndex {
+public:
+    // An empty index over the ring of capacity elements of type t. op is Max
+    // or Min; block (>= 2) is the fan-out of each level, 0 selects
+    // DEFAULT_INDEX_BLOCK. The engine must outlive the index.
+    RangeMaxIndex(FindMaxEngine& engine, DType t, Op op, size_t capacity, size_t block = 0);
+    // A static index over the first n elements of buf, a buffer of the
+    // engine's context that is read in place and must not change while the
+    // index lives. All levels are built here; append() throws. GPU backend
+    // only: on the CPU backend use the constructor above and one append().
+    RangeMaxIndex(FindMaxEngine& engine, DType t, Op op, cl_mem buf, size_t n, size_t block = 0);
+    ~RangeMaxIndex();
+    RangeMaxIndex(const RangeMaxIndex&) = delete;
+    RangeMaxIndex& operator=(const RangeMaxIndex&) = delete;
+
+    // Append count elements; once the ring is full the oldest ones are
+    // overwritten. data is only read during the call.
+    void append(const void* data, size_t count);
+
+    // Reduction of the elements at positions [a, b), counted from the first
+    // append; first() <= a <= b <= total() or it throws. result points at one
+    // element and is left untouched for an empty range.
+    void query(uint64_t a, uint64_t b, void* result);
+    // One result per (lo, hi) pair of positions: ranges holds 2 * count
+    // values and results count elements. Pairs are clamped to the held
+    // positions instead of throwing, and an empty range yields the identity
+    // (lowest() for max, highest() for min).
+    void query_batch(const uint64_t* ranges, size_t count, void* results);
+    // Device-resident form: ranges is a buffer of 2 * count cl_ulong and
+    // results one of count elements. The call waits for the launch.
+    void query_batch(cl_mem ranges, size_t count, cl_mem results);
+    template <typename T>
+    std::vector<T> batch(const std::vector<uint64_t>& ranges) {
+        std::vector<T> out(ranges.size() / 2);
+        query_batch(ranges.data(), out.size(), out.data());
+        return out;
+    }
+    // The last w elements, w <= size()
+    void query_window(size_t w, void* result) { query(total_ - w, total_, result); }
+    template <typename T>
+    typename DTypeTraits<T>::value_type window(size_t w) {
+        T out = op_ == Op::Min ? DTypeTraits<T>::highest() : DTypeTraits<T>::lowest();
+        query_window(w, &out);
+        return out;
+    }
+
+    uint64_t total() const { return total_; }  // elements appended so far
+    uint64_t first() const { return total_ - size(); } // oldest position still held
+    size_t size() const { return total_ < capacity_ ? (size_t)total_ : capacity_; }
+    size_t capacity() const { return capacity_; }
+    size_t block() const { return block_; }
+    int levels() const { return (int)len_.size() - 1; } // above the data
+    size_t index_bytes() const; // memory of the levels above the data
+    DType dtype() const { return t_; }
+    Op op() const { return op_; }
+    bool is_static() const { return static_; }
+
+    // Timing of the last append() or query*(): kernel_ns and passes cover its
+    // launches, upload_ns the profiled writes, wall_ns the whole call
+    const RunStats& last_run() const { return stats_; }
+
+private:
+    // A half-open range of level 0 (ring slots)
+    struct Range {
+        size_t lo = 0, hi = 0;
+    };
+    // Ring slots of positions [a, b): one range, or two when it wraps
+    std::vector<Range> ring_ranges(uint64_t a, uint64_t b) const;
+    // Validates the arguments and sizes the levels for capacity_ slots
+    void setup();
+    // GPU backend: the level buffers (and the ring unless own_data is false),
+    // filled with the identity
+    void create_buffers(bool own_data);
+    void rebuild(Range r);
+    void launch(cl_kernel k, size_t groups, size_t local);
+    void finish(std::chrono::steady_clock::time_point t0);
+    void finish_cpu(std::chrono::steady_clock::time_point t0, int passes);
+    void release_events();
+    // CPU backend: result = reduction of entries [lo, hi) of level, with the NaN policy
+    void host_fold(const char* level, size_t lo, size_t hi, void* result) const;
+    // CPU backend: one pair of query_batch(), same walk as index_query
+    void host_query(uint64_t a, uint64_t b, void* result) const;
+    void launch_query(cl_mem ranges, size_t count, cl_mem results);
+    void reserve_batch(size_t count);
+
+    FindMaxEngine& engine_;
+    DType t_;
+    Op op_;
+    size_t esize_;
+    size_t capacity_;
+    size_t block_;
+    uint64_t total_ = 0;
+    bool static_ = false;
+    std::vector<size_t> len_; // entries per level; len_[0] == capacity_
+    std::vector<size_t> off_; // level k >= 1 starts at entry off_[k - 1] of the levels storage
+
+    // GPU backend
+    cl_mem data_ = nullptr;
+    cl_mem levels_ = nullptr;
+    cl_mem level_off_ = nullptr; // off_ as cl_ulong, for index_query
+    cl_mem ranges_ = nullptr;    // (lo, hi) cl_ulong pairs of a host query batch
+    cl_mem results_ = nullptr;   // one element per pair
+    size_t batch_cap_ = 0;       // pairs ranges_ and results_ hold
+    std::vector<cl_event> kernels_;
+    std::vector<cl_event> uploads_;
+    // CPU backend
+    std::vector<char> host_data_;
+    std::vector<char> host_levels_;
+
+    RunStats stats_;
+};
+
+} // namespace findmax
@@ -0,0 +1,156 @@
+#include "roofline.hpp"
+
+#include "bench.hpp"
+#include "cpu_reduce.hpp"
+#include "ocl_utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace findmax {
+
+namespace {
+
+constexpr size_t WORD_BYTES = 16; // one uint4
+constexpr size_t GROUPS_PER_CU = 64; // resident groups per compute unit to hide the load latency
+
+// Released on every exit of measure_bandwidth()
+struct MemGuard {
+    cl_mem m = nullptr;
+    ~MemGuard() {
+        if (m) clReleaseMemObject(m);
+    }
+};
+
+template <typename V>
+V device_value(cl_device_id dev, cl_device_info what) {
+    V v = V();
+    if (clGetDeviceInfo(dev, what, sizeof(v), &v, nullptr) != CL_SUCCESS) return V();
+    return v;
+}
+
+// Best time of reps runs of once() after one warm-up; once() returns ns
+template <typename F>
+double best_ns(int reps, F once) {
+    once();
+    double best = 0.0;
+    for (int i = 0; i < reps; ++i) {
+        const double ns = once();
+        if (i == 0 || ns < best) best = ns;
+    }
+    return best;
+}
+
+// Kernel or upload time of evt, which is released
+double profiled_ns(cl_event evt) {
+    const cl_int err = clWaitForEvents(1, &evt);
+    const double ns = err == CL_SUCCESS ? (double)event_ns(evt) : 0.0;
+    clReleaseEvent(evt);
+    check(err, "clWaitForEvents");
+    return ns;
+}
+
+BandwidthCeiling measure_cpu(const FindMaxEngine& engine, size_t bytes, int reps) {
+    BandwidthCeiling c;
+    c.bytes = bytes;
+    const size_t half = bytes / 2;
+    std::vector<int64_t> src(bytes / sizeof(int64_t), 1);
+    std::vector<char> dst(half);
+    int64_t out = 0;
+    // A wrapping integer sum: one add per word, so the loads set the pace
+    c.read_gbs = gb_per_s((double)bytes, best_ns(reps, [&]() {
+        const auto t0 = std::chrono::steady_clock::now();
+        cpu_reduce(DType::Int64, Op::Sum, src.data(), src.size(), &out, engine.cpu_threads());
+        return (double)elapsed_ns(t0);
+    }));
+    c.copy_gbs = gb_per_s(2.0 * (double)half, best_ns(reps, [&]() {
+        const auto t0 = std::chrono::steady_clock::now();
+        std::memcpy(dst.data(), src.data(), half);
+        return (double)elapsed_ns(t0);
+    }));
+    return c;
+}
+
+} // namespace
+
+DeviceCaps device_caps(const FindMaxEngine& engine) {
+    DeviceCaps c;
+    c.name = engine.device_name();
+    if (engine.backend() == Backend::Cpu) {
+        c.compute_units = engine.cpu_threads() ? engine.cpu_threads() : cpu_default_threads();
+        c.unified_memory = true;
+        return c;
+    }
+    const cl_device_id dev = engine.device();
+    c.compute_units = device_value<cl_uint>(dev, CL_DEVICE_MAX_COMPUTE_UNITS);
+    c.clock_mhz = device_value<cl_uint>(dev, CL_DEVICE_MAX_CLOCK_FREQUENCY);
+    c.global_mem_bytes = device_value<cl_ulong>(dev, CL_DEVICE_GLOBAL_MEM_SIZE);
+    c.max_alloc_bytes = device_value<cl_ulong>(dev, CL_DEVICE_MAX_MEM_ALLOC_SIZE);
+    c.global_cache_bytes = device_value<cl_ulong>(dev, CL_DEVICE_GLOBAL_MEM_CACHE_SIZE);
+    c.cacheline_bytes = device_value<cl_uint>(dev, CL_DEVICE_GLOBAL_MEM_CACHELINE_SIZE);
+    c.local_mem_bytes = device_value<cl_ulong>(dev, CL_DEVICE_LOCAL_MEM_SIZE);
+    c.unified_memory = device_value<cl_bool>(dev, CL_DEVICE_HOST_UNIFIED_MEMORY) != CL_FALSE;
+    return c;
+}
+
+BandwidthCeiling measure_bandwidth(FindMaxEngine& engine, size_t bytes, int reps) {
+    if (reps < 1) throw std::runtime_error("measure_bandwidth needs reps >= 1");
+    const DeviceCaps caps = device_caps(engine);
+    if (caps.max_alloc_bytes > 0) bytes = std::min<size_t>(bytes, (size_t)caps.max_alloc_bytes);
+    // Whole words, and an even count so the copy test splits the buffer in halves
+    bytes = bytes / (2 * WORD_BYTES) * (2 * WORD_BYTES);
+    if (bytes == 0) throw std::runtime_error("measure_bandwidth needs at least 32 bytes");
+    if (engine.backend() == Backend::Cpu) return measure_cpu(engine, bytes, reps);
+
+    cl_context ctx = engine.context();
+    cl_command_queue q = engine.queue();
+    cl_kernel read = engine.kernel(engine.dtype(), Op::Max, "bandwidth_read");
+    cl_kernel copy = engine.kernel(engine.dtype(), Op::Max, "bandwidth_copy");
+    size_t max_wg = 0;
+    check(clGetKernelWorkGroupInfo(read, engine.device(), CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_wg), &max_wg, nullptr),
+          "clGetKernelWorkGroupInfo");
+    const size_t local = std::max<size_t>(1, std::min<size_t>((size_t)engine.wg(), max_wg));
+    const size_t words = bytes / WORD_BYTES;
+    const size_t groups = std::max<size_t>(1, std::min((words + local - 1) / local, GROUPS_PER_CU * std::max(1u, caps.compute_units)));
+    const size_t global = groups * local;
+
+    BandwidthCeiling c;
+    c.bytes = bytes;
+    cl_int err = CL_SUCCESS;
+    MemGuard in, sink, half;
+    in.m = clCreateBuffer(ctx, CL_MEM_READ_ONLY, bytes, nullptr, &err);
+    check(err, "clCreateBuffer(bandwidth input)");
+    sink.m = clCreateBuffer(ctx, CL_MEM_WRITE_ONLY, global * sizeof(cl_uint), nullptr, &err);
+    check(err, "clCreateBuffer(bandwidth sink)");
+    half.m = clCreateBuffer(ctx, CL_MEM_WRITE_ONLY, bytes / 2, nullptr, &err);
+    check(err, "clCreateBuffer(bandwidth copy)");
+    const cl_uint pattern = 0x9e3779b9u;
+    check(clEnqueueFillBuffer(q, in.m, &pattern, sizeof(pattern), 0, bytes, 0, nullptr, nullptr), "clEnqueueFillBuffer");
+    check(clFinish(q), "clFinish");
+
+    auto run = [&](cl_kernel k, cl_mem out, size_t n_words) {
+        const cl_ulong n = (cl_ulong)n_words;
+        cl_int e = clSetKernelArg(k, 0, sizeof(cl_mem), &in.m);
+        e |= clSetKernelArg(k, 1, sizeof(cl_ulong), &n);
+        e |= clSetKernelArg(k, 2, sizeof(cl_mem), &out);
+        check(e, "clSetKernelArg(bandwidth)");
+        cl_event evt = nullptr;
+        check(clEnqueueNDRangeKernel(q, k, 1, nullptr, &global, &local, 0, nullptr, &evt), "clEnqueueNDRangeKernel");
+        return profiled_ns(evt);
+    };
+    c.read_gbs = gb_per_s((double)bytes, best_ns(reps, [&]() { return run(read, sink.m, words); }));
+    c.copy_gbs = gb_per_s((double)bytes, best_ns(reps, [&]() { return run(copy, half.m, words / 2); }));
+
+    const std::vector<char> host(bytes / 2, 1);
+    c.upload_gbs = gb_per_s((double)host.size(), best_ns(reps, [&]() {
+        cl_event evt = nullptr;
+        check(clEnqueueWriteBuffer(q, half.m, CL_FALSE, 0, host.size(), host.data(), 0, nullptr, &evt), "clEnqueueWriteBuffer");
+        return profiled_ns(evt);
+    }));
+    return c;
+}
+
+} // namespace findmax
@@ -0,0 +1,48 @@
+// Roofline report: how close the reductions come to the device's limits
+// - device capabilities from clGetDeviceInfo (compute units, clock, memory)
+// - a measured bandwidth ceiling: the bandwidth_read and bandwidth_copy
+//   microkernels of kernels.cl and a host-to-device upload
+// - the CPU backend times a threaded integer sum (cpu_reduce) and a memcpy instead
+
+#pragma once
+
+#include "find_max.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace findmax {
+
+constexpr size_t DEFAULT_CEILING_BYTES = (size_t)256 << 20; // well past the last-level caches
+
+struct DeviceCaps {
+    std::string name;
+    unsigned compute_units = 0;      // CL_DEVICE_MAX_COMPUTE_UNITS; CPU backend: worker threads
+    unsigned clock_mhz = 0;          // CL_DEVICE_MAX_CLOCK_FREQUENCY; 0 on the CPU backend
+    uint64_t global_mem_bytes = 0;   // CL_DEVICE_GLOBAL_MEM_SIZE
+    uint64_t max_alloc_bytes = 0;    // CL_DEVICE_MAX_MEM_ALLOC_SIZE
+    uint64_t global_cache_bytes = 0; // CL_DEVICE_GLOBAL_MEM_CACHE_SIZE
+    unsigned cacheline_bytes = 0;    // CL_DEVICE_GLOBAL_MEM_CACHELINE_SIZE
+    uint64_t local_mem_bytes = 0;    // CL_DEVICE_LOCAL_MEM_SIZE
+    bool unified_memory = false;     // CL_DEVICE_HOST_UNIFIED_MEMORY
+};
+
+// Capabilities of the engine's device (zeros where a query fails)
+DeviceCaps device_caps(const FindMaxEngine& engine);
+
+// Best of the timed repetitions of each test, in GB/s
+struct BandwidthCeiling {
+    size_t bytes = 0;         // buffer each test streams
+    double read_gbs = 0.0;    // bandwidth_read: bytes read over kernel time
+    double copy_gbs = 0.0;    // bandwidth_copy: bytes read plus bytes written
+    double upload_gbs = 0.0;  // clEnqueueWriteBuffer from pageable host memory; 0 on the CPU backend
+};
+
+// Measure the ceiling over bytes bytes (rounded down to 16-byte words,
+// capped by CL_DEVICE_MAX_MEM_ALLOC_SIZE): one warm-up, then reps timed runs
+// of each test. The reductions read their input once, so read_gbs is the
+// roof they are compared against. Throws when a buffer or launch fails.
+BandwidthCeiling measure_bandwidth(FindMaxEngine& engine, size_t bytes = DEFAULT_CEILING_BYTES, int reps = 5);
+
+} // namespace findmax
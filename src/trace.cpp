@@ -0,0 +1,102 @@
+#include "trace.hpp"
+#include "ocl_utils.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+namespace findmax {
+
+// Track ids: 0 host, then three per device
+static int device_tid(int device, int track) { return 1 + 3 * device + track; }
+enum { TRACK_COMMANDS = 0, TRACK_COPY = 1, TRACK_QUEUE = 2 };
+
+ChromeTrace::ChromeTrace(Clock::time_point origin) : origin_(origin) {}
+
+double ChromeTrace::us_since_origin(Clock::time_point t) const {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(t - origin_).count() / 1.0e3;
+}
+
+void ChromeTrace::host(const std::string& name, Clock::time_point begin, Clock::time_point end) {
+    Event e;
+    e.name = name;
+    e.ts_us = us_since_origin(begin);
+    e.dur_us = us_since_origin(end) - e.ts_us;
+    events_.push_back(e);
+}
+
+void ChromeTrace::run(const RunStats& stats, const std::string& label, int device) {
+    devices_ = std::max(devices_, device + 1);
+    const double base = us_since_origin(stats.started);
+    for (const PhaseTiming& ph : stats.phases) {
+        Event e;
+        e.name = label + ": " + ph.name;
+        e.ts_us = base + (double)ph.begin_ns / 1.0e3;
+        e.dur_us = (double)ph.ns / 1.0e3;
+        events_.push_back(e);
+    }
+    for (const CommandTiming& c : stats.commands) {
+        if (c.end == 0 || c.queued == 0) continue; // profiling unavailable
+        const std::string name = c.pass >= 0 ? "pass " + std::to_string(c.pass) + " " + c.name : std::string(c.name);
+        const double queued = base + (double)c.host_ns / 1.0e3;
+        const double submit = queued + (double)(c.submit - c.queued) / 1.0e3;
+        const double start = queued + (double)(c.start - c.queued) / 1.0e3;
+        const double end = queued + (double)(c.end - c.queued) / 1.0e3;
+        char args[256];
+        std::snprintf(args, sizeof(args),
+                      "\"label\":\"%s\",\"elems\":%llu,\"global\":%zu,\"local\":%zu,\"queued_to_submit_us\":%.3f,"
+                      "\"submit_to_start_us\":%.3f,\"start_to_end_us\":%.3f",
+                      json_escape(label).c_str(), (unsigned long long)c.elems, c.global, c.local, submit - queued, start - submit,
+                      end - start);
+
+        Event run;
+        run.name = name;
+        run.tid = device_tid(device, c.copy_queue ? TRACK_COPY : TRACK_COMMANDS);
+        run.ts_us = start;
+        run.dur_us = end - start;
+        run.args = args;
+        events_.push_back(run);
+
+        Event wait;
+        wait.tid = device_tid(device, TRACK_QUEUE);
+        wait.name = name + " queued";
+        wait.ts_us = queued;
+        wait.dur_us = submit - queued;
+        events_.push_back(wait);
+        wait.name = name + " submitted";
+        wait.ts_us = submit;
+        wait.dur_us = start - submit;
+        events_.push_back(wait);
+    }
+}
+
+void ChromeTrace::write(const std::string& path) const {
+    std::ofstream ofs(path, std::ios::out | std::ios::trunc);
+    if (!ofs) throw std::runtime_error("Failed to write trace file: " + path);
+    ofs << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    ofs << "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"ocl_find_max\"}}";
+    auto thread_name = [&](int tid, const std::string& name) {
+        ofs << ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"name\":\"thread_name\",\"args\":{\"name\":\"" << json_escape(name) << "\"}}";
+        ofs << ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"name\":\"thread_sort_index\",\"args\":{\"sort_index\":" << tid << "}}";
+    };
+    thread_name(0, "host");
+    for (int d = 0; d < devices_; ++d) {
+        const std::string dev = "device " + std::to_string(d);
+        thread_name(device_tid(d, TRACK_COMMANDS), dev);
+        thread_name(device_tid(d, TRACK_COPY), dev + " upload queue");
+        thread_name(device_tid(d, TRACK_QUEUE), dev + " queue latency");
+    }
+    char num[64];
+    for (const Event& e : events_) {
+        ofs << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid << ",\"name\":\"" << json_escape(e.name) << "\"";
+        std::snprintf(num, sizeof(num), ",\"ts\":%.3f,\"dur\":%.3f", e.ts_us, std::max(0.0, e.dur_us));
+        ofs << num;
+        if (!e.args.empty()) ofs << ",\"args\":{" << e.args << "}";
+        ofs << "}";
+    }
+    ofs << "\n]}\n";
+    if (!ofs) throw std::runtime_error("Failed to write trace file: " + path);
+}
+
+} // namespace findmax
@@ -0,0 +1,48 @@
+// Chrome trace export (chrome://tracing, ui.perfetto.dev) of traced runs
+// - host phases on one track, and per device a track for executing
+//   commands, one for the upload queue and one for queue latency
+//   (queued -> submit -> start)
+// - device counters are placed on the host timeline at the host time each
+//   command was enqueued, which is when CL_PROFILING_COMMAND_QUEUED is taken
+
+#pragma once
+
+#include "find_max.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace findmax {
+
+class ChromeTrace {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Timestamps in the file are relative to origin
+    explicit ChromeTrace(Clock::time_point origin = Clock::now());
+
+    // Host slice, e.g. a setup phase or the CPU reference check
+    void host(const std::string& name, Clock::time_point begin, Clock::time_point end);
+    // Phases and commands of a run traced with EngineOptions::trace. label
+    // prefixes the host phases; device selects the device tracks.
+    void run(const RunStats& stats, const std::string& label, int device = 0);
+
+    // Throws std::runtime_error when the file cannot be written
+    void write(const std::string& path) const;
+
+private:
+    struct Event {
+        std::string name;
+        int tid = 0;
+        double ts_us = 0.0;
+        double dur_us = 0.0;
+        std::string args; // JSON object body, may be empty
+    };
+    double us_since_origin(Clock::time_point t) const;
+    Clock::time_point origin_;
+    std::vector<Event> events_;
+    int devices_ = 0;
+};
+
+} // namespace findmax
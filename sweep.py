@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""Cross-platform benchmark sweep over sizes and variants (see run.bat).
+
+Runs ocl_find_max in --bench --json mode for every size and configuration
+and writes the statistics of each run as a CSV row and a JSON object:
+
+    python3 sweep.py --sizes 1000000 16777216 --variants local wg --reps 20
+
+--layouts strided blocked compares the reduce_stage load layouts and
+--specialize adds a run of every variant with kernels compiled for the
+launch shape (ocl_find_max --specialize).
+
+Configurations the device does not support (for example wg on an OpenCL 1.2
+driver) are reported and skipped.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+
+CSV_HEADER = ("size,variant,dtype,op,host_mem,wg,items_per_thread,vec,specialized,layout,passes,warmup,reps,"
+              "kernel_min_ms,kernel_median_ms,kernel_p95_ms,kernel_p99_ms,kernel_stddev_ms,"
+              "wall_min_ms,wall_median_ms,wall_p95_ms,wall_p99_ms,wall_stddev_ms,"
+              "gbs_median,gbs_best,e2e_gbs_median,peak_gbs,pct_peak")
+
+DEFAULT_SIZES = [1000000, 4000000, 16777216, 33554432, 67108864]
+DEFAULT_VARIANTS = ["local", "wg", "atomic", "subgroup"]
+# Extra modes run once per size on top of the kernel variants
+MODES = {
+    "cpu": ["--device", "cpu"],
+    "hybrid": ["--hybrid"],
+    "multi": ["--devices", "all"],
+    "stream": ["--stream"],
+}
+
+
+def csv_row(o):
+    k, w = o["kernel_ms"], o["wall_ms"]
+    fields = [o["size"], o["variant"], o["dtype"], o["op"], o["host_mem"], o["wg"], o["items_per_thread"], o["vec"],
+              int(o.get("specialized", False)), o.get("layout", "strided"), o["passes"], o["warmup"], o["reps"], k["min"], k["median"], k["p95"], k["p99"], k["stddev"],
+              w["min"], w["median"], w["p95"], w["p99"], w["stddev"], o["gbs_median"], o["gbs_best"],
+              o.get("e2e_gbs_median", 0.0), o["peak_gbs"], o["pct_peak"]]
+    return ",".join(str(f) for f in fields)
+
+
+def find_exe(script_dir):
+    exe = "ocl_find_max.exe" if os.name == "nt" else "ocl_find_max"
+    for sub in ("build/Release", "build/Debug", "build", "."):
+        path = os.path.join(script_dir, sub, exe)
+        if os.path.isfile(path):
+            return path
+    return None
+
+
+def main():
+    script_dir = os.path.dirname(os.path.abspath(__file__))
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--exe", help="ocl_find_max binary (default: build/Release, build/Debug, build, .)")
+    ap.add_argument("--sizes", type=int, nargs="+", default=DEFAULT_SIZES)
+    ap.add_argument("--variants", nargs="+", default=DEFAULT_VARIANTS)
+    ap.add_argument("--specialize", action="store_true",
+                    help="also run every variant with kernels compiled for the launch shape")
+    ap.add_argument("--layouts", nargs="+", default=["strided"], choices=["strided", "blocked", "blocked+prefetch"],
+                    help="reduce_stage load layouts to run every variant with")
+    ap.add_argument("--modes", nargs="*", default=[], choices=sorted(MODES), help="extra runs per size")
+    ap.add_argument("--dtype", default="float")
+    ap.add_argument("--op", default="max")
+    ap.add_argument("--warmup", type=int, default=3)
+    ap.add_argument("--reps", type=int, default=10)
+    ap.add_argument("--peak-gbs", type=float, default=0.0, help="theoretical device bandwidth")
+    ap.add_argument("--out", default=os.path.join(script_dir, "bench.csv"))
+    ap.add_argument("--json-out", default=os.path.join(script_dir, "bench.json"))
+    ap.add_argument("extra", nargs=argparse.REMAINDER, help="further ocl_find_max options after --")
+    args = ap.parse_args()
+
+    exe = os.path.abspath(args.exe) if args.exe else find_exe(script_dir)
+    if not exe or not os.path.isfile(exe):
+        sys.exit("Executable not found. Build the project first, for example:\n"
+                 "  cmake -S . -B build -DCMAKE_BUILD_TYPE=Release\n"
+                 "  cmake --build build --config Release")
+    extra = [a for a in args.extra if a != "--"]
+    common = ["--dtype", args.dtype, "--op", args.op, "--quiet", "--bench", "--warmup", str(args.warmup),
+              "--reps", str(args.reps), "--peak-gbs", str(args.peak_gbs)] + extra
+
+    runs = []
+    for size in args.sizes:
+        for v in args.variants:
+            for layout in args.layouts:
+                flags = ["--variant", v, "--layout", layout.split("+")[0]] + (["--prefetch"] if "+" in layout else [])
+                label = "variant %s %s" % (v, layout)
+                runs.append((size, label, flags))
+                if args.specialize:
+                    runs.append((size, label + " specialized", flags + ["--specialize"]))
+        for m in args.modes:
+            runs.append((size, m, MODES[m]))
+
+    rows, objects, failed = [], [], 0
+    # Run from the executable directory so kernels.cl is found next to it
+    cwd = os.path.dirname(exe)
+    for size, label, flags in runs:
+        print("Running %s size %d ..." % (label, size), flush=True)
+        res = subprocess.run([exe, "--size", str(size)] + flags + common + ["--json"], cwd=cwd,
+                             capture_output=True, text=True)
+        if res.returncode != 0:
+            failed += 1
+            print("  skipped: " + res.stderr.strip(), flush=True)
+            continue
+        for line in res.stdout.splitlines():
+            if line.startswith("{"):
+                obj = json.loads(line)
+                objects.append(obj)
+                rows.append(csv_row(obj))
+
+    with open(args.out, "w") as f:
+        f.write(CSV_HEADER + "\n")
+        for r in rows:
+            f.write(r + "\n")
+    with open(args.json_out, "w") as f:
+        json.dump(objects, f, indent=1)
+        f.write("\n")
+    print("Done. %d runs (%d skipped); results saved to %s and %s" % (len(rows), failed, args.out, args.json_out))
+
+
+if __name__ == "__main__":
+    main()
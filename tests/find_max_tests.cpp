@@ -0,0 +1,313 @@
+// Host-side checks that need no OpenCL device
+// - cpu_reduce: NaN policies, -0.0 / +0.0 order, argmax ties, and agreement
+//   of every float fold this machine can run
+// - RangeMaxIndex on the CPU backend against a brute-force scan
+// - BufferPool size classes, --devices parsing and benchmark statistics
+
+#include "bench.hpp"
+#include "buffer_pool.hpp"
+#include "cpu_reduce.hpp"
+#include "datagen.hpp"
+#include "find_max.hpp"
+#include "multi_device.hpp"
+#include "range_index.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace findmax;
+
+static int failures = 0;
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            ++failures;                                                              \
+        }                                                                            \
+    } while (0)
+
+static bool same_bits(float a, float b) {
+    return std::memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static const float NaN = std::numeric_limits<float>::quiet_NaN();
+static const unsigned THREADS = 4; // enough to split the larger inputs
+
+// Random floats in [-1000, 1000) with every stride-th element a NaN (none for 0)
+static std::vector<float> random_floats(size_t n, uint64_t seed, size_t stride) {
+    std::vector<float> v(n);
+    for (size_t i = 0; i < n; ++i) {
+        v[i] = (float)(counter_uniform(seed, i) * 2000.0 - 1000.0);
+        if (stride && i % stride == stride / 2) v[i] = NaN;
+    }
+    return v;
+}
+
+// Scalar reference: NaN skipped, -0.0 below +0.0
+static float reference(const std::vector<float>& v, bool is_max) {
+    float r = is_max ? -INFINITY : INFINITY;
+    for (float x : v) {
+        if (std::isnan(x)) continue;
+        const bool above = x > r || (x == r && std::signbit(r) && !std::signbit(x));
+        const bool below = x < r || (x == r && !std::signbit(r) && std::signbit(x));
+        if (is_max ? above : below) r = x;
+    }
+    return r;
+}
+
+static float reduce_f32(Op op, const std::vector<float>& v) {
+    float r = 0.0f;
+    cpu_reduce(DType::Float, op, v.data(), v.size(), &r, THREADS);
+    return r;
+}
+
+static void test_nan_policies() {
+    std::vector<float> v = random_floats(100000, 1, 0);
+    v[10] = NaN;
+    v[5000] = NaN;
+    v[99999] = NaN;
+    const float expect = reference(v, true);
+
+    // Ignore: NaN is skipped and nothing is counted
+    float r = reduce_f32(Op::Max, v);
+    CHECK(cpu_apply_nan_policy(DType::Float, Op::Max, NanPolicy::Ignore, v.data(), v.size(), &r, THREADS) == 0);
+    CHECK(same_bits(r, expect));
+
+    // Propagate: one NaN makes the result NaN
+    r = reduce_f32(Op::Max, v);
+    cpu_apply_nan_policy(DType::Float, Op::Max, NanPolicy::Propagate, v.data(), v.size(), &r, THREADS);
+    CHECK(std::isnan(r));
+    float mm[2] = { 0.0f, 0.0f };
+    cpu_reduce(DType::Float, Op::MinMax, v.data(), v.size(), mm, THREADS);
+    cpu_apply_nan_policy(DType::Float, Op::MinMax, NanPolicy::Propagate, v.data(), v.size(), mm, THREADS);
+    CHECK(std::isnan(mm[0]) && std::isnan(mm[1]));
+
+    // Count: the number of NaNs, with the result as under Ignore
+    r = reduce_f32(Op::Max, v);
+    CHECK(cpu_apply_nan_policy(DType::Float, Op::Max, NanPolicy::Count, v.data(), v.size(), &r, THREADS) == 3);
+    CHECK(same_bits(r, expect));
+    CHECK(cpu_count_nans(DType::Float, v.data(), v.size(), THREADS) == 3);
+
+    // Without NaNs Propagate changes nothing, and integers have none
+    std::vector<float> clean = random_floats(1000, 2, 0);
+    r = reduce_f32(Op::Min, clean);
+    cpu_apply_nan_policy(DType::Float, Op::Min, NanPolicy::Propagate, clean.data(), clean.size(), &r, THREADS);
+    CHECK(same_bits(r, reference(clean, false)));
+    const std::vector<int32_t> ints = { 3, -7, 12, 0 };
+    int32_t ri = 0;
+    cpu_reduce(DType::Int32, Op::Max, ints.data(), ints.size(), &ri, THREADS);
+    CHECK(cpu_apply_nan_policy(DType::Int32, Op::Max, NanPolicy::Count, ints.data(), ints.size(), &ri, THREADS) == 0);
+    CHECK(ri == 12);
+}
+
+static void test_signed_zeros() {
+    const std::vector<float> mixed = { -0.0f, 0.0f, -0.0f };
+    CHECK(same_bits(reduce_f32(Op::Max, mixed), 0.0f));
+    CHECK(same_bits(reduce_f32(Op::Min, mixed), -0.0f));
+    const std::vector<float> neg = { -0.0f, -0.0f };
+    CHECK(same_bits(reduce_f32(Op::Max, neg), -0.0f));
+
+    // Large enough for several workers and the vector folds; the winning
+    // zero sits in one worker's range only
+    for (size_t at : { (size_t)0, (size_t)12345, (size_t)(1 << 20) - 1 }) {
+        std::vector<float> v((size_t)1 << 20, -0.0f);
+        v[at] = 0.0f;
+        CHECK(same_bits(reduce_f32(Op::Max, v), 0.0f));
+        CHECK(same_bits(reduce_f32(Op::Min, v), -0.0f));
+        float mm[2] = { 1.0f, 1.0f };
+        cpu_reduce(DType::Float, Op::MinMax, v.data(), v.size(), mm, THREADS);
+        CHECK(same_bits(mm[0], -0.0f) && same_bits(mm[1], 0.0f));
+    }
+    std::vector<double> d(100000, 0.0);
+    d[777] = -0.0;
+    double rd = 1.0;
+    cpu_reduce(DType::Double, Op::Min, d.data(), d.size(), &rd, THREADS);
+    CHECK(rd == 0.0 && std::signbit(rd));
+}
+
+static void test_argmax_ties() {
+    std::vector<float> v = random_floats(300000, 3, 0);
+    v[250000] = 5000.0f;
+    v[70000] = 5000.0f;
+    v[299999] = 5000.0f;
+    float value = 0.0f;
+    CHECK(cpu_argmax(DType::Float, v.data(), v.size(), &value, THREADS) == 70000);
+    CHECK(value == 5000.0f);
+
+    // +0.0 orders above -0.0, so it wins over an earlier -0.0
+    const std::vector<float> zeros = { -1.0f, -0.0f, 0.0f, 0.0f };
+    CHECK(cpu_argmax(DType::Float, zeros.data(), zeros.size(), &value, THREADS) == 2);
+    CHECK(same_bits(value, 0.0f));
+
+    const std::vector<int32_t> ints = { 4, 9, 1, 9, 9 };
+    int32_t vi = 0;
+    CHECK(cpu_argmax(DType::Int32, ints.data(), ints.size(), &vi, THREADS) == 1);
+    const std::vector<float> nans = { NaN, NaN };
+    CHECK(cpu_argmax(DType::Float, nans.data(), nans.size(), &value, THREADS) == ARGMAX_NONE);
+}
+
+static void test_simd_agreement() {
+    const std::string initial = cpu_simd_name();
+    const std::vector<std::string> paths = cpu_simd_paths();
+    CHECK(!paths.empty() && paths.front() == initial);
+    CHECK(!cpu_set_simd("no-such-path"));
+    const size_t sizes[] = { 1, 7, 31, 32, 33, 100, 1000, 4097, (size_t)1 << 20 };
+    for (const std::string& path : paths) {
+        CHECK(cpu_set_simd(path));
+        CHECK(path == cpu_simd_name());
+        uint64_t seed = 10;
+        for (size_t n : sizes) {
+            for (size_t stride : { (size_t)0, (size_t)5 }) {
+                const std::vector<float> v = random_floats(n, seed++, stride);
+                for (bool is_max : { true, false }) {
+                    const float got = reduce_f32(is_max ? Op::Max : Op::Min, v);
+                    if (!same_bits(got, reference(v, is_max))) {
+                        std::fprintf(stderr, "%s path: n=%zu stride=%zu %s disagrees\n", path.c_str(), n, stride,
+                                     is_max ? "max" : "min");
+                        ++failures;
+                    }
+                }
+            }
+        }
+    }
+    cpu_set_simd(initial);
+}
+
+static void test_range_index() {
+    EngineOptions opt;
+    opt.device = "cpu";
+    opt.cpu_threads = THREADS;
+    FindMaxEngine engine(opt);
+    CHECK(engine.backend() == Backend::Cpu);
+
+    for (Op op : { Op::Max, Op::Min }) {
+        const bool is_max = op == Op::Max;
+        RangeMaxIndex index(engine, DType::Float, op, 1000, 4);
+        CHECK(index.levels() > 1);
+        std::vector<float> history;
+        uint64_t seed = 100;
+        // Appends of uneven size wrap the ring several times
+        for (int round = 0; round < 80; ++round) {
+            const std::vector<float> chunk = random_floats(37 + round % 5, seed++, 0);
+            index.append(chunk.data(), chunk.size());
+            history.insert(history.end(), chunk.begin(), chunk.end());
+            CHECK(index.total() == history.size());
+            CHECK(index.size() == std::min<size_t>(history.size(), 1000));
+
+            std::vector<uint64_t> ranges;
+            for (int q = 0; q < 8; ++q) {
+                const uint64_t span = index.total() - index.first();
+                uint64_t a = index.first() + (uint64_t)(counter_uniform(seed, 2 * q) * (double)span);
+                uint64_t b = index.first() + (uint64_t)(counter_uniform(seed, 2 * q + 1) * (double)(span + 1));
+                if (a > b) std::swap(a, b);
+                ranges.push_back(a);
+                ranges.push_back(b);
+            }
+            const std::vector<float> got = index.batch<float>(ranges);
+            for (size_t q = 0; q < got.size(); ++q) {
+                const uint64_t a = ranges[2 * q], b = ranges[2 * q + 1];
+                const float expect = reference(std::vector<float>(history.begin() + a, history.begin() + b), is_max);
+                CHECK(same_bits(got[q], expect));
+                float one = 0.0f;
+                if (a < b) {
+                    index.query(a, b, &one);
+                    CHECK(same_bits(one, expect));
+                }
+            }
+            const size_t w = std::min<size_t>(index.size(), 250);
+            CHECK(same_bits(index.window<float>(w), reference(std::vector<float>(history.end() - w, history.end()), is_max)));
+        }
+        // Positions that already left the ring are rejected
+        bool threw = false;
+        float r = 0.0f;
+        try {
+            index.query(0, 1, &r);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        CHECK(threw);
+    }
+}
+
+static void test_buffer_pool_classes() {
+    BufferPool pool(nullptr, 0);
+    CHECK(pool.class_bytes(1) == 4096);
+    CHECK(pool.class_bytes(4096) == 4096);
+    CHECK(pool.class_bytes(4097) == 5120);
+    CHECK(pool.class_bytes(8192) == 8192);
+    CHECK(pool.class_bytes(10000) == 10240);
+    // Four classes per power of two: never below the request, under 25% above it
+    for (size_t bytes = 4097; bytes < ((size_t)1 << 24); bytes = bytes * 5 / 4 + 3) {
+        const size_t c = pool.class_bytes(bytes);
+        CHECK(c >= bytes && (double)c < 1.25 * (double)bytes);
+        CHECK(pool.class_bytes(c) == c);
+    }
+    // A class past the device limit falls back to the exact request
+    BufferPool capped(nullptr, 9000);
+    CHECK(capped.class_bytes(8500) == 8500);
+    CHECK(capped.class_bytes(8192) == 8192);
+}
+
+static void test_parse_device_list() {
+    CHECK(parse_device_list("").empty());
+    CHECK(parse_device_list("all").empty());
+    CHECK(parse_device_list("2") == std::vector<int>({ 2 }));
+    CHECK(parse_device_list("0,2,2,1") == std::vector<int>({ 0, 2, 1 }));
+    for (const char* bad : { "1,,2", "-1", "x", "1,", "0,1a" }) {
+        bool threw = false;
+        try {
+            parse_device_list(bad);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        CHECK(threw);
+    }
+}
+
+static void test_summarize() {
+    const Distribution d = summarize({ 5.0, 1.0, 3.0, 2.0, 4.0 });
+    CHECK(d.count == 5);
+    CHECK(d.min == 1.0 && d.max == 5.0);
+    CHECK(d.median == 3.0);
+    CHECK(std::fabs(d.p95 - 4.8) < 1e-12);
+    CHECK(std::fabs(d.p99 - 4.96) < 1e-12);
+    CHECK(d.mean == 3.0);
+    CHECK(std::fabs(d.stddev - std::sqrt(2.5)) < 1e-12);
+
+    CHECK(summarize({}).count == 0);
+    const Distribution one = summarize({ 7.0 });
+    CHECK(one.median == 7.0 && one.p99 == 7.0 && one.stddev == 0.0);
+    CHECK(percentile({}, 0.5) == 0.0);
+    CHECK(percentile({ 10.0, 20.0 }, 0.25) == 12.5);
+    CHECK(percentile({ 10.0, 20.0 }, 1.0) == 20.0);
+}
+
+int main() {
+    try {
+        test_nan_policies();
+        test_signed_zeros();
+        test_argmax_ties();
+        test_simd_agreement();
+        test_range_index();
+        test_buffer_pool_classes();
+        test_parse_device_list();
+        test_summarize();
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "Unexpected exception: %s\n", e.what());
+        return 1;
+    }
+    if (failures) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed (float folds: %s)\n", cpu_simd_name());
+    return 0;
+}